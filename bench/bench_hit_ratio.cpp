@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include "debug.h"
+#include "hash.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Eviction policies hit ratio benchmark.
+ *
+ * Replays the Zipfian trace against the single shard that fits only a part of the keys. Every request is a get, and
+ * the missed key is set, as the look-aside cache does. Part of the requests may go to the keys that are never
+ * requested again, it models scans that flood the cache with one-hit wonders. Writes refused by the full shard or by
+ * the admission filter are counted as rejected.
+ * Usage: bench_hit_ratio [keys count] [requests count] [zipf alpha] [cache size, percents of keys] [scan percents]
+ */
+
+/**
+ * Length of the value.
+ */
+const uint64 BENCH_VAL_LEN = 64;
+
+struct bench_policy {
+    const char *name;
+    uint storage;
+    uint policy;
+    bool admission;
+};
+
+const std::vector<bench_policy> BENCH_POLICIES = {
+    {"none", STORAGE_PAGES, EVICT_POLICY_NONE, false},
+    {"ring (fifo)", STORAGE_RING, EVICT_POLICY_NONE, false},
+    {"clock", STORAGE_PAGES, EVICT_POLICY_CLOCK, false},
+    {"s3fifo", STORAGE_PAGES, EVICT_POLICY_S3FIFO, false},
+    {"clock+tinylfu", STORAGE_PAGES, EVICT_POLICY_CLOCK, true},
+    {"s3fifo+tinylfu", STORAGE_PAGES, EVICT_POLICY_S3FIFO, true},
+};
+
+int main(int argc, char **argv) {
+    uint64 keys_cnt = argc > 1 ? uint64(atoi(argv[1])) : 100000;
+    uint64 reqs = argc > 2 ? uint64(atoi(argv[2])) : 2000000;
+    double alpha = argc > 3 ? atof(argv[3]) : 0.99;
+    uint64 size_prcnt = argc > 4 ? uint64(atoi(argv[4])) : 10;
+    uint64 scan_prcnt = argc > 5 ? uint64(atoi(argv[5])) : 0;
+    auto dbg = new debug(VERBOSE_LVL_NONE);
+
+    // Ranks are drawn by binary search over the cumulative distribution.
+    std::vector<double> cdf(keys_cnt);
+    double sum = 0;
+    for (uint64 k = 0; k < keys_cnt; k++) {
+        sum += 1 / std::pow(double(k + 1), alpha);
+        cdf[k] = sum;
+    }
+
+    // The same trace for all policies. Scan keys follow the Zipfian ones and never repeat.
+    std::mt19937_64 rnd(42);
+    std::uniform_real_distribution<double> uni(0, sum);
+    std::vector<uint64> trace(reqs);
+    uint64 scan_next = keys_cnt;
+    for (auto &r : trace) {
+        if (rnd() % 100 < scan_prcnt) {
+            r = fnv64a("key_" + std::to_string(scan_next++));
+        } else {
+            uint64 k = uint64(std::lower_bound(cdf.begin(), cdf.end(), uni(rnd)) - cdf.begin());
+            r = fnv64a("key_" + std::to_string(std::min(k, keys_cnt - 1)));
+        }
+    }
+
+    uint64 max_size = keys_cnt * size_prcnt / 100 * (BENCH_VAL_LEN + sizeof(shard_entry_hdr));
+    std::vector<byte> val(BENCH_VAL_LEN, 'x');
+    std::vector<byte> buf(BENCH_VAL_LEN);
+    byte *buf_p = buf.data();
+
+    std::cout << keys_cnt << " keys, " << reqs << " requests, zipf alpha " << alpha << ", cache fits "
+              << size_prcnt << "% of keys, " << scan_prcnt << "% scan requests" << std::endl;
+    std::cout << std::setw(16) << "policy" << std::setw(12) << "hit ratio" << std::setw(12) << "rejected"
+              << std::setw(12) << "evicted" << std::endl;
+    for (auto &p : BENCH_POLICIES) {
+        shard_config cfg;
+        cfg.max_size = max_size;
+        cfg.storage = p.storage;
+        cfg.evict_policy = p.policy;
+        cfg.admission = p.admission;
+        auto shrd = new Shard(0, cfg, dbg);
+
+        uint64 hits = 0, rejected = 0, len_f = 0;
+        for (auto key : trace) {
+            if (shrd->get(key, buf_p, buf.size(), len_f) == ERR_OK) {
+                hits++;
+            } else if (shrd->set(key, val.data(), val.size()) != ERR_OK) {
+                rejected++;
+            }
+        }
+        shard_stats st{};
+        shrd->get_stats(st);
+
+        std::cout << std::setw(16) << p.name
+                  << std::setw(12) << std::fixed << std::setprecision(4) << double(hits) / double(reqs)
+                  << std::setw(12) << rejected
+                  << std::setw(12) << st.evicted << std::endl;
+
+        delete shrd;
+    }
+
+    delete dbg;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "debug.h"
+#include "hash.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Shard IO throughput benchmark.
+ *
+ * Writes and reads back values of various sizes to the single shard and reports bytes/sec for both directions.
+ * Usage: bench_io [rounds] [pages|ring]
+ */
+
+/**
+ * Sizes of values to benchmark.
+ * Covers typical JSON documents (1-4 KB) and large blobs that should take non-temporal path.
+ */
+const std::vector<uint64> BENCH_SIZES = {64, 1024, 4096, 65536, 262144, 1048576};
+
+/**
+ * Payload volume to write per size per round.
+ * Value: 64 MB
+ */
+const uint64 BENCH_VOLUME = 67108864;
+
+double since_s(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+int main(int argc, char **argv) {
+    uint rounds = argc > 1 ? uint(atoi(argv[1])) : 3;
+    uint storage = argc > 2 && std::string(argv[2]) == "ring" ? STORAGE_RING : STORAGE_PAGES;
+    auto dbg = new debug(VERBOSE_LVL_NONE);
+
+    // Extra room for page rounding and records headers.
+    shard_config cfg;
+    cfg.max_size = BENCH_VOLUME * 2;
+    cfg.storage = storage;
+
+    std::cout << std::setw(10) << "size" << std::setw(16) << "set MB/s" << std::setw(16) << "get MB/s" << std::endl;
+    for (auto sz : BENCH_SIZES) {
+        uint64 cnt = BENCH_VOLUME / sz;
+
+        std::vector<byte> val(sz, 'x');
+        std::vector<byte> buf(sz);
+        byte *buf_p = buf.data();
+        uint64 len_f = 0;
+
+        // Hash keys the same way as BigCache does.
+        std::vector<uint64> keys(cnt);
+        for (uint64 k = 0; k < cnt; k++) {
+            keys[k] = fnv64a("key_" + std::to_string(k));
+        }
+
+        double set_s = 0, get_s = 0;
+        for (uint r = 0; r < rounds; r++) {
+            auto shrd = new Shard(0, cfg, dbg);
+
+            auto t = std::chrono::steady_clock::now();
+            for (uint64 k = 0; k < cnt; k++) {
+                if (shrd->set(keys[k], val.data(), sz) != ERR_OK) {
+                    std::cerr << "set failed at size " << sz << " key " << k << std::endl;
+                    return 1;
+                }
+            }
+            set_s += since_s(t);
+
+            t = std::chrono::steady_clock::now();
+            for (uint64 k = 0; k < cnt; k++) {
+                if (shrd->get(keys[k], buf_p, sz, len_f) != ERR_OK) {
+                    std::cerr << "get failed at size " << sz << " key " << k << std::endl;
+                    return 1;
+                }
+            }
+            get_s += since_s(t);
+
+            delete shrd;
+        }
+
+        double mb = double(BENCH_VOLUME) * rounds / 1048576;
+        std::cout << std::setw(10) << sz
+                  << std::setw(16) << std::fixed << std::setprecision(1) << mb / set_s
+                  << std::setw(16) << std::fixed << std::setprecision(1) << mb / get_s << std::endl;
+    }
+
+    delete dbg;
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include "debug.h"
+#include "hash.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Shard random get latency benchmark.
+ *
+ * Fills the single shard with small values and reads random keys, so every get touches cold memory. Compares page
+ * allocation modes: TLB misses dominate when working set is large and backed by regular 4 KB pages.
+ * Usage: bench_latency [shard size MB] [gets count]
+ */
+
+/**
+ * Length of the value.
+ */
+const uint64 BENCH_VAL_LEN = 256;
+
+/**
+ * Count of gets measured by one timer call, amortizes cost of the clock.
+ */
+const uint64 BENCH_BATCH = 16;
+
+struct bench_mode {
+    const char *name;
+    uint page_alloc;
+    bool populate;
+};
+
+const std::vector<bench_mode> BENCH_MODES = {
+    {"heap", PAGE_ALLOC_HEAP, false},
+    {"mmap", PAGE_ALLOC_MMAP, false},
+    {"mmap+populate", PAGE_ALLOC_MMAP, true},
+    {"thp", PAGE_ALLOC_THP, false},
+    {"thp+populate", PAGE_ALLOC_THP, true},
+    {"hugetlb", PAGE_ALLOC_HUGETLB, false},
+};
+
+int main(int argc, char **argv) {
+    uint64 size_mb = argc > 1 ? uint64(atoi(argv[1])) : 1024;
+    uint64 gets = argc > 2 ? uint64(atoi(argv[2])) : 2000000;
+    auto dbg = new debug(VERBOSE_LVL_NONE);
+
+    uint64 cnt = size_mb * 1048576 / (BENCH_VAL_LEN + sizeof(shard_entry_hdr)) * 9 / 10;
+    std::vector<uint64> keys(cnt);
+    for (uint64 k = 0; k < cnt; k++) {
+        keys[k] = fnv64a("key_" + std::to_string(k));
+    }
+    std::vector<byte> val(BENCH_VAL_LEN, 'x');
+    std::vector<byte> buf(BENCH_VAL_LEN);
+    byte *buf_p = buf.data();
+
+    // The same random sequence for all modes.
+    std::mt19937_64 rnd(42);
+    std::vector<uint64> seq(gets);
+    for (auto &i : seq) {
+        i = rnd() % cnt;
+    }
+
+    std::cout << "shard " << size_mb << " MB, " << cnt << " entries of " << BENCH_VAL_LEN << " b, "
+              << gets << " random gets" << std::endl;
+    std::cout << std::setw(16) << "mode" << std::setw(12) << "fill ms" << std::setw(12) << "avg ns"
+              << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << std::endl;
+    for (auto &m : BENCH_MODES) {
+        shard_config cfg;
+        cfg.max_size = size_mb * 1048576;
+        cfg.page_alloc = m.page_alloc;
+        cfg.page_populate = m.populate;
+
+        auto t = std::chrono::steady_clock::now();
+        auto shrd = new Shard(0, cfg, dbg);
+        for (uint64 k = 0; k < cnt; k++) {
+            if (shrd->set(keys[k], val.data(), val.size()) != ERR_OK) {
+                std::cerr << "set failed at key " << k << std::endl;
+                return 1;
+            }
+        }
+        auto fill_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
+        std::vector<double> lat;
+        lat.reserve(gets / BENCH_BATCH);
+        uint64 len_f = 0;
+        double total = 0;
+        for (uint64 i = 0; i + BENCH_BATCH <= gets; i += BENCH_BATCH) {
+            t = std::chrono::steady_clock::now();
+            for (uint64 j = i; j < i + BENCH_BATCH; j++) {
+                if (shrd->get(keys[seq[j]], buf_p, buf.size(), len_f) != ERR_OK) {
+                    std::cerr << "get failed at key " << seq[j] << std::endl;
+                    return 1;
+                }
+            }
+            auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count();
+            lat.push_back(ns / BENCH_BATCH);
+            total += ns;
+        }
+        std::sort(lat.begin(), lat.end());
+
+        std::cout << std::setw(16) << m.name
+                  << std::setw(12) << std::fixed << std::setprecision(1) << fill_ms
+                  << std::setw(12) << std::fixed << std::setprecision(1) << total / (lat.size() * BENCH_BATCH)
+                  << std::setw(12) << std::fixed << std::setprecision(1) << lat[lat.size() / 2]
+                  << std::setw(12) << std::fixed << std::setprecision(1) << lat[lat.size() * 99 / 100] << std::endl;
+
+        delete shrd;
+    }
+
+    delete dbg;
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "debug.h"
+#include "hash.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Shard read scaling benchmark.
+ *
+ * Fills few shards with small values and runs random gets from growing count of threads. Every thread reads all
+ * shards, so threads contend on the same locks. Optionally a writer thread overwrites random keys concurrently.
+ * Usage: bench_read_scale [shards] [max threads] [ms per step] [writer 0|1] [locked|optimistic]
+ */
+
+/**
+ * Count of entries per shard.
+ */
+const uint64 BENCH_ENTRIES = 65536;
+
+/**
+ * Length of the value.
+ */
+const uint64 BENCH_VAL_LEN = 128;
+
+int main(int argc, char **argv) {
+    uint shards_cnt = argc > 1 ? uint(atoi(argv[1])) : 4;
+    uint thr_max = argc > 2 ? uint(atoi(argv[2])) : 64;
+    uint step_ms = argc > 3 ? uint(atoi(argv[3])) : 500;
+    bool writer = argc > 4 && atoi(argv[4]) != 0;
+    bool optimistic = argc > 5 && std::string(argv[5]) == "optimistic";
+    auto dbg = new debug(VERBOSE_LVL_NONE);
+
+    shard_config cfg;
+    cfg.max_size = BENCH_ENTRIES * (BENCH_VAL_LEN + sizeof(shard_entry_hdr)) * 2;
+    cfg.read_mode = optimistic ? READ_MODE_OPTIMISTIC : READ_MODE_LOCKED;
+    std::vector<Shard*> shards;
+    for (uint i = 0; i < shards_cnt; i++) {
+        shards.push_back(new Shard(i, cfg, dbg));
+    }
+
+    // Distribute keys over shards the same way as BigCache does.
+    std::vector<uint64> keys(BENCH_ENTRIES * shards_cnt);
+    std::vector<byte> val(BENCH_VAL_LEN, 'x');
+    for (uint64 k = 0; k < keys.size(); k++) {
+        keys[k] = fnv64a("key_" + std::to_string(k));
+        if (shards[keys[k] % shards_cnt]->fset(keys[k], val.data(), val.size()) != ERR_OK) {
+            std::cerr << "set failed at key " << k << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << shards_cnt << " shards, " << keys.size() << " entries of " << BENCH_VAL_LEN << " b, "
+              << std::thread::hardware_concurrency() << " cpus, " << (optimistic ? "optimistic" : "locked") << " reads"
+              << (writer ? ", with writer" : "") << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(16) << "Mgets/s" << std::setw(16) << "per thread"
+              << std::endl;
+    for (uint thr_cnt = 1; thr_cnt <= thr_max; thr_cnt *= 2) {
+        std::atomic<bool> stop{false};
+        std::atomic<uint64> total{0};
+        std::vector<std::thread> pool;
+        for (uint t = 0; t < thr_cnt; t++) {
+            pool.emplace_back([&, t]() {
+                std::mt19937_64 rnd(t);
+                std::vector<byte> buf(BENCH_VAL_LEN);
+                byte *buf_p = buf.data();
+                uint64 len_f = 0, cnt = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (uint i = 0; i < 64; i++) {
+                        auto key = keys[rnd() % keys.size()];
+                        shards[key % shards_cnt]->get(key, buf_p, buf.size(), len_f);
+                    }
+                    cnt += 64;
+                }
+                total += cnt;
+            });
+        }
+        if (writer) {
+            pool.emplace_back([&]() {
+                std::mt19937_64 rnd(~0ULL);
+                while (!stop.load(std::memory_order_relaxed)) {
+                    auto key = keys[rnd() % keys.size()];
+                    shards[key % shards_cnt]->fset(key, val.data(), val.size());
+                }
+            });
+        }
+
+        auto t = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(step_ms));
+        stop = true;
+        for (auto &thr : pool) {
+            thr.join();
+        }
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+
+        double mops = double(total) / s / 1e6;
+        std::cout << std::setw(10) << thr_cnt
+                  << std::setw(16) << std::fixed << std::setprecision(2) << mops
+                  << std::setw(16) << std::fixed << std::setprecision(2) << mops / thr_cnt << std::endl;
+    }
+
+    for (auto shrd : shards) {
+        delete shrd;
+    }
+    delete dbg;
+    return 0;
+}
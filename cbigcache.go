@@ -9,7 +9,8 @@ package cbigcache
 */
 import "C"
 import (
-	"bytes"
+	"sync"
+	"time"
 	"unsafe"
 )
 
@@ -23,24 +24,39 @@ type CBigCache struct {
 	handler C.CBigCache
 	// Flag to check is cache alive or dead.
 	alive bool
-	// Maximum buffer length that will used for read the data.
-	maxBufSize uint
+}
+
+// Context of the read call.
+// C side writes the actual length through the pointer, so the var lives in the pooled struct instead of escaping to
+// the heap on every call.
+type getCtx struct {
+	// Actual length of the entry, output var of C calls.
+	lenActual C.uint64
+	// Intermediate buffer of Get.
+	buf []byte
+}
+
+var getCtxPool = sync.Pool{New: func() any {
+	return &getCtx{buf: make([]byte, getBufInitLen)}
+}}
+
+// Pass the key to C without copy and terminating zero, C side never keeps the pointer.
+func keyC(key string) (*C.char, C.uint) {
+	if len(key) == 0 {
+		return nil, 0
+	}
+	return (*C.char)(unsafe.Pointer(unsafe.StringData(key))), C.uint(len(key))
 }
 
 // Init new instance of BigCache.
 func NewCBigCache(config *Config) (*CBigCache, error) {
-	// Init debugger first.
-	verboseLevel := C.uint(config.VerboseLevel)
-	C.cbc_debug_init(verboseLevel)
-
 	// Prepare config and create new instance of CBigCache.
 	configJson, _ := config.Marshal()
 	configJsonC := C.CString(configJson)
 	defer C.free(unsafe.Pointer(configJsonC))
 	cbc := &CBigCache{
-		handler:    C.cbc_new(configJsonC),
-		alive:      true,
-		maxBufSize: 1,
+		handler: C.cbc_new(configJsonC),
+		alive:   true,
 	}
 	return cbc, nil
 }
@@ -56,27 +72,45 @@ func (c *CBigCache) Free() error {
 	return ErrorOk
 }
 
+// Run expiration of the whole cache at once, without waiting for the next cycle.
+// The expiration runs in background, the call doesn't wait for it.
+func (c *CBigCache) Expire() error {
+	if !c.alive {
+		return ErrorCacheIsDead
+	}
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
+	C.cbc_expire(ptrCbc)
+	return ErrorOk
+}
+
 // Save bytes under a given key in cache.
+// The entry lives the default time of the cache, see Config.Expire.
 func (c *CBigCache) Set(key string, data []byte) error {
+	return c.SetTTL(key, data, 0)
+}
+
+// SetTTL saves bytes under a given key in cache with its own lifetime.
+// Lifetime has millisecond resolution, non-positive ttl means the default time of the cache.
+func (c *CBigCache) SetTTL(key string, data []byte, ttl time.Duration) error {
 	if !c.alive {
 		return ErrorCacheIsDead
 	}
+	if ttl < 0 {
+		ttl = 0
+	}
 
-	ptrKey := C.CString(key)
-	defer C.free(unsafe.Pointer(ptrKey))
+	ptrKey, keyLen := keyC(key)
 
-	// Convert slice of bytes to C-like bytes (unsigned chars).
+	// Convert slice of bytes to C-like bytes (unsigned chars). Data is binary-safe, so the length passes explicitly.
 	dataLen := uint(len(data))
-	ptrData := (*C.uchar)(unsafe.Pointer(&data[0]))
+	var ptrData *C.uchar
+	if dataLen > 0 {
+		ptrData = (*C.uchar)(unsafe.Pointer(&data[0]))
+	}
 
 	// Call the C.CBigCache instance.
 	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
-	errCode := ErrorCode(C.cbc_set(ptrCbc, ptrKey, ptrData))
-
-	// Update maximum buffer size for further reads.
-	if errCode == ErrorCodeOk && dataLen > c.maxBufSize {
-		c.maxBufSize = dataLen
-	}
+	errCode := ErrorCode(C.cbc_set_ttl(ptrCbc, ptrKey, keyLen, ptrData, C.uint64(dataLen), C.uint64(ttl)))
 
 	return errorRegistry[errCode]
 }
@@ -84,36 +118,57 @@ func (c *CBigCache) Set(key string, data []byte) error {
 // Gets bytes for a given key.
 // Successful result is a filled slice of bytes and count of read bytes.
 // In any other cases the third result var will contain a corresponding error.
+// The data is read to the pooled buffer and copied to the result of exact size, use GetInto to avoid the allocation.
 func (c *CBigCache) Get(key string) ([]byte, uint, error) {
-	if !c.alive {
-		return nil, 0, ErrorCacheIsDead
+	ctx := getCtxPool.Get().(*getCtx)
+	var (
+		res []byte
+		err error
+	)
+	ctx.buf, err = c.getInto(ctx, key, ctx.buf[:0])
+	if err == nil {
+		res = append([]byte(nil), ctx.buf...)
 	}
+	if cap(ctx.buf) <= getBufMaxLen {
+		getCtxPool.Put(ctx)
+	}
+	return res, uint(len(res)), err
+}
 
-	ptrKey := C.CString(key)
-	defer C.free(unsafe.Pointer(ptrKey))
-
-	// +1 to max length need to save zero byte.
-	lenMax := c.maxBufSize + 1
-	ptrLenMax := C.uint(lenMax)
+// GetInto reads bytes for a given key to dst, overwriting its contents.
+// Returns dst resliced to the length of the data. If the data doesn't fit cap(dst) the new slice is allocated, so
+// reuse of the returned slice makes reads allocation-free.
+func (c *CBigCache) GetInto(key string, dst []byte) ([]byte, error) {
+	ctx := getCtxPool.Get().(*getCtx)
+	dst, err := c.getInto(ctx, key, dst)
+	getCtxPool.Put(ctx)
+	return dst, err
+}
 
-	// Prepare buffer.
-	buf := make([]byte, lenMax)
-	ptrBuf := (*C.uchar)(unsafe.Pointer(&buf[0]))
+func (c *CBigCache) getInto(ctx *getCtx, key string, dst []byte) ([]byte, error) {
+	if !c.alive {
+		return dst[:0], ErrorCacheIsDead
+	}
 
-	// Call the C.CBigCache instance.
+	ptrKey, keyLen := keyC(key)
 	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
-	errCode := ErrorCode(C.cbc_get(ptrCbc, ptrKey, ptrBuf, ptrLenMax))
 
-	if errCode != ErrorCodeOk {
-		return nil, 0, errorRegistry[errCode]
+	for {
+		dst = dst[:cap(dst)]
+		var ptrBuf *C.uchar
+		if len(dst) > 0 {
+			ptrBuf = (*C.uchar)(unsafe.Pointer(&dst[0]))
+		}
+		errCode := ErrorCode(C.cbc_get(ptrCbc, ptrKey, keyLen, ptrBuf, C.uint64(len(dst)), &ctx.lenActual))
+		// Buffer is too small, grow it to the actual length and retry. Entry may be overwritten with longer data
+		// between the calls, so loop till it fits. The length is checked even on success, so the slice never goes
+		// beyond the buffer.
+		if errCode == ErrorCodeOk && uint64(ctx.lenActual) <= uint64(cap(dst)) {
+			return dst[:ctx.lenActual], nil
+		}
+		if errCode != ErrorCodeOk && errCode != ErrorCodeBufLenLow {
+			return dst[:0], errorRegistry[errCode]
+		}
+		dst = make([]byte, uint(ctx.lenActual))
 	}
-
-	// Get the actual length of a result to trim useless bytes at the end of th result.
-	lenActual := lenMax
-	if zeroIndex := bytes.IndexByte(buf, byte('\x00')); zeroIndex != -1 {
-		lenActual = uint(zeroIndex)
-	}
-
-	// Return lenActual bytes of result.
-	return buf[:lenActual], lenActual, nil
 }
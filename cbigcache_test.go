@@ -114,3 +114,280 @@ func TestIOParallel(t *testing.T) {
 	time.Sleep(2 * time.Minute)
 	_ = cbc.Free()
 }
+
+func TestGetInto(t *testing.T) {
+	cbc := benchCache()
+
+	data := bytes.Repeat([]byte("0123456789"), 1000)
+	if err := cbc.Set("get_into", data); err != nil {
+		t.Fatal(err)
+	}
+
+	// Short buffer grows to the actual length.
+	buf, err := cbc.GetInto("get_into", make([]byte, 0, 16))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(buf, data) {
+		t.Error("received data isn't equal with original")
+	}
+
+	// Large enough buffer is reused.
+	buf1, err := cbc.GetInto("get_into", buf)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if &buf1[0] != &buf[0] || !bytes.Equal(buf1, data) {
+		t.Error("buffer isn't reused")
+	}
+
+	if _, err = cbc.GetInto("get_into_404", buf); err != ErrorKeyNotFound {
+		t.Error("expected", ErrorKeyNotFound, "got", err)
+	}
+}
+
+func TestGetIntoOptimistic(t *testing.T) {
+	config := DefaultConfig(10 * time.Minute)
+	config.Shards = 4
+	config.ReadMode = ReadModeOptimistic
+	cbc, err := NewCBigCache(config)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer func() { _ = cbc.Free() }()
+
+	data := bytes.Repeat([]byte("0123456789"), 100)
+	if err = cbc.Set("get_into", data); err != nil {
+		t.Fatal(err)
+	}
+
+	// Nil and empty buffers grow to the actual length as well.
+	for _, dst := range [][]byte{nil, {}, make([]byte, 0, 16)} {
+		buf, err := cbc.GetInto("get_into", dst)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if !bytes.Equal(buf, data) {
+			t.Error("received data isn't equal with original")
+		}
+	}
+}
+
+func TestSetTTL(t *testing.T) {
+	cbc := benchCache()
+
+	data := []byte("short-lived")
+	if err := cbc.SetTTL("set_ttl", data, 20*time.Millisecond); err != nil {
+		t.Fatal(err)
+	}
+	if buf, err := cbc.GetInto("set_ttl", nil); err != nil || !bytes.Equal(buf, data) {
+		t.Fatal("entry isn't available before expiration:", err)
+	}
+	time.Sleep(30 * time.Millisecond)
+	if _, err := cbc.GetInto("set_ttl", nil); err != ErrorKeyExpired && err != ErrorKeyNotFound {
+		t.Error("expected expired entry, got", err)
+	}
+}
+
+func TestExpire(t *testing.T) {
+	config := DefaultConfig(10 * time.Minute)
+	config.Shards = 4
+	config.MaxSize = 4 * Megabyte
+	cbc, err := NewCBigCache(config)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if err = cbc.SetTTL("expire", []byte("short-lived"), 10*time.Millisecond); err != nil {
+		t.Fatal(err)
+	}
+	time.Sleep(20 * time.Millisecond)
+	if err = cbc.Expire(); err != nil {
+		t.Fatal(err)
+	}
+	var st *Stats
+	for i := 0; i < 100; i++ {
+		if st, err = cbc.Stats(); err != nil || st.Expired > 0 {
+			break
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+	if err != nil || st.Expired != 1 || st.ExpiredLazy != 0 {
+		t.Error("entry isn't expired on demand:", err, st)
+	}
+	// Only the shard with due entries was planned.
+	sst, err := cbc.SchedStats(SchedTaskExpire)
+	if err != nil || sst.Cycles == 0 || sst.ShardsPlanned != 1 {
+		t.Error("unexpected expire scheduler stats:", err, sst)
+	}
+	if _, err = cbc.SchedStats(SchedTask(2)); err == nil {
+		t.Error("unknown task accepted")
+	}
+
+	// Supervisors wake up on free, so it doesn't wait for their periods.
+	start := time.Now()
+	_ = cbc.Free()
+	if took := time.Since(start); took > time.Second {
+		t.Error("free took", took)
+	}
+}
+
+func TestEvictPolicy(t *testing.T) {
+	data := bytes.Repeat([]byte("x"), 1024)
+	for _, policy := range []ConfigEvictPolicy{EvictPolicyNone, EvictPolicyClock, EvictPolicyS3FIFO} {
+		config := DefaultConfig(10 * time.Minute)
+		config.Shards = 4
+		config.MaxSize = 4 * Megabyte
+		config.EvictPolicy = policy
+		cbc, err := NewCBigCache(config)
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		// Twice as much data as the cache fits.
+		var noSpace int
+		for i := 0; i < 8*1024; i++ {
+			if err = cbc.Set(randKey(32), data); err == ErrorNoSpace {
+				noSpace++
+			} else if err != nil {
+				t.Fatal(policy, err)
+			}
+		}
+		st, err := cbc.Stats()
+		if err != nil {
+			t.Fatal(err)
+		}
+		if policy == EvictPolicyNone {
+			if noSpace == 0 || st.Evicted != 0 {
+				t.Error(policy, "full cache accepted writes:", noSpace, st.Evicted)
+			}
+		} else if noSpace != 0 || st.Evicted == 0 {
+			t.Error(policy, "full cache didn't evict:", noSpace, st.Evicted)
+		}
+		_ = cbc.Free()
+	}
+}
+
+func TestAdmission(t *testing.T) {
+	data := bytes.Repeat([]byte("x"), 1024)
+	config := DefaultConfig(10 * time.Minute)
+	config.Shards = 4
+	config.MaxSize = 4 * Megabyte
+	config.Admission = true
+	cbc, err := NewCBigCache(config)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer func() { _ = cbc.Free() }()
+
+	// Twice as much data of one-hit keys as the cache fits.
+	var rejected int
+	for i := 0; i < 8*1024; i++ {
+		if err = cbc.Set(randKey(32), data); err == ErrorNotAdmitted {
+			rejected++
+		} else if err != nil {
+			t.Fatal(err)
+		}
+	}
+	st, err := cbc.Stats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if rejected == 0 || st.Rejected != uint64(rejected) {
+		t.Error("full cache admitted everything:", rejected, st.Rejected)
+	}
+}
+
+var (
+	benchCbc  *CBigCache
+	benchOnce sync.Once
+)
+
+// Shared cache of the benchmarks, it lives till the process exit.
+func benchCache() *CBigCache {
+	benchOnce.Do(func() {
+		config := DefaultConfig(10 * time.Minute)
+		config.Shards = 16
+		config.ForceSet = true
+		config.MaxSize = 64 * Megabyte
+		benchCbc, _ = NewCBigCache(config)
+	})
+	return benchCbc
+}
+
+func benchKeys(n int) []string {
+	keys := make([]string, n)
+	for i := range keys {
+		keys[i] = randKey(20)
+	}
+	return keys
+}
+
+func BenchmarkSet(b *testing.B) {
+	cbc := benchCache()
+	keys := benchKeys(1024)
+	data := bytes.Repeat([]byte("x"), 512)
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := cbc.Set(keys[i%len(keys)], data); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkGet(b *testing.B) {
+	cbc := benchCache()
+	keys := benchKeys(1024)
+	data := bytes.Repeat([]byte("x"), 512)
+	for _, k := range keys {
+		_ = cbc.Set(k, data)
+	}
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, _, err := cbc.Get(keys[i%len(keys)]); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkGetInto(b *testing.B) {
+	cbc := benchCache()
+	keys := benchKeys(1024)
+	data := bytes.Repeat([]byte("x"), 512)
+	for _, k := range keys {
+		_ = cbc.Set(k, data)
+	}
+	buf := make([]byte, 0, 1024)
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var err error
+		if buf, err = cbc.GetInto(keys[i%len(keys)], buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkGetIntoParallel(b *testing.B) {
+	cbc := benchCache()
+	keys := benchKeys(1024)
+	data := bytes.Repeat([]byte("x"), 512)
+	for _, k := range keys {
+		_ = cbc.Set(k, data)
+	}
+	b.ReportAllocs()
+	b.ResetTimer()
+	b.RunParallel(func(pb *testing.PB) {
+		buf := make([]byte, 0, 1024)
+		i := 0
+		for pb.Next() {
+			var err error
+			if buf, err = cbc.GetInto(keys[i%len(keys)], buf); err != nil {
+				b.Fatal(err)
+			}
+			i++
+		}
+	})
+}
@@ -20,9 +20,46 @@ type Config struct {
 	// VacuumNs contains the same value in nanoseconds. You may omit Ns field.
 	Vacuum   time.Duration `json:"-"`
 	VacuumNs uint64        `json:"vacuum_ns"`
+	// Max time of the shard lock hold by a single vacuum step. Foreground operations wait no longer than that.
+	// VacuumBudgetUs contains the same value in microseconds. You may omit Us field.
+	VacuumBudget   time.Duration `json:"-"`
+	VacuumBudgetUs uint64        `json:"vacuum_budget_us"`
+	// Max time of the shard lock hold by a single expiration batch.
+	// ExpireBudgetUs contains the same value in microseconds. You may omit Us field.
+	ExpireBudget   time.Duration `json:"-"`
+	ExpireBudgetUs uint64        `json:"expire_budget_us"`
+	// Max count of evictions by a single expiration batch.
+	ExpireBatch uint64 `json:"expire_batch"`
 	// Cache max size in bytes.
 	// Use MemorySize values.
 	MaxSize MemorySize `json:"max_size"`
+	// Storage engine of the shards.
+	// Use ConfigStorage values.
+	Storage ConfigStorage `json:"storage"`
+	// Allocation mode of the shard pages.
+	// Use ConfigPageAlloc values.
+	PageAlloc ConfigPageAlloc `json:"page_alloc"`
+	// Pre-fault memory of the shard pages on allocation.
+	PagePopulate bool `json:"page_populate"`
+	// Count of empty pages that every shard keeps allocated after usage drop, others are returned to the system.
+	PageReleaseKeep uint `json:"page_release_keep"`
+	// Read mode of the shards.
+	// Use ConfigReadMode values.
+	ReadMode ConfigReadMode `json:"read_mode"`
+	// Eviction policy of the full shards.
+	// Use ConfigEvictPolicy values.
+	EvictPolicy ConfigEvictPolicy `json:"evict_policy"`
+	// Admit new keys to the full shards only if they are requested more often than the keys they replace.
+	// Rejected writes fail with ErrorNotAdmitted. Requires an eviction policy.
+	Admission bool `json:"admission"`
+	// Count of background workers that run expiration and vacuum over the shards.
+	// Zero means count of CPUs, but no more than count of shards.
+	Workers uint `json:"workers"`
+	// Bind every background worker to its own CPU.
+	WorkerAffinity bool `json:"worker_affinity"`
+	// CPU budget of every background task (expiration and vacuum), percents of the single CPU time.
+	// Shards that don't fit the budget are deferred to the next cycles.
+	BackgroundCPUBudget uint `json:"bg_cpu_budget"`
 	// Level of a displayed verbose messages.
 	// Use ConfigVerboseLevel values.
 	VerboseLevel ConfigVerboseLevel `json:"verbose_lvl"`
@@ -33,12 +70,25 @@ type Config struct {
 // make maximum two instances of CBigCache without size limit.
 func DefaultConfig(expire time.Duration) *Config {
 	return &Config{
-		Shards:       1024,
-		ForceSet:     false,
-		Expire:       expire,
-		Vacuum:       10 * time.Minute,
-		MaxSize:      0,
-		VerboseLevel: VerboseLevelNone,
+		Shards:              1024,
+		ForceSet:            false,
+		Expire:              expire,
+		Vacuum:              10 * time.Minute,
+		VacuumBudget:        200 * time.Microsecond,
+		ExpireBudget:        200 * time.Microsecond,
+		ExpireBatch:         1024,
+		MaxSize:             0,
+		Storage:             StoragePages,
+		PageAlloc:           PageAllocMmap,
+		PagePopulate:        false,
+		PageReleaseKeep:     1,
+		ReadMode:            ReadModeLocked,
+		EvictPolicy:         EvictPolicyS3FIFO,
+		Admission:           false,
+		Workers:             0,
+		WorkerAffinity:      false,
+		BackgroundCPUBudget: 25,
+		VerboseLevel:        VerboseLevelNone,
 	}
 }
 
@@ -50,6 +100,12 @@ func (c *Config) Marshal() (string, error) {
 	if c.VacuumNs == 0 {
 		c.VacuumNs = uint64(c.Vacuum.Nanoseconds())
 	}
+	if c.VacuumBudgetUs == 0 {
+		c.VacuumBudgetUs = uint64(c.VacuumBudget.Microseconds())
+	}
+	if c.ExpireBudgetUs == 0 {
+		c.ExpireBudgetUs = uint64(c.ExpireBudget.Microseconds())
+	}
 	b, err := json.Marshal(c)
 	return string(b), err
 }
@@ -19,6 +19,44 @@ const (
 	// Log info messages with level 3.
 	VerboseLevelDebug3 ConfigVerboseLevel = 6
 
+	// Storage engines.
+	// Paged storage with free blocks index, entries may be split to several blocks.
+	StoragePages ConfigStorage = "pages"
+	// Circular log, entries are evicted FIFO when the ring wraps.
+	StorageRing ConfigStorage = "ring"
+
+	// Allocation modes of the shard pages.
+	// Regular heap allocation.
+	PageAllocHeap ConfigPageAlloc = "heap"
+	// Anonymous mapping backed by regular pages.
+	PageAllocMmap ConfigPageAlloc = "mmap"
+	// Anonymous mapping backed by transparent huge pages.
+	PageAllocTHP ConfigPageAlloc = "thp"
+	// Anonymous mapping backed by explicit huge pages, requires reserved vm.nr_hugepages.
+	// Falls back to PageAllocTHP if no huge pages available.
+	PageAllocHugeTLB ConfigPageAlloc = "hugetlb"
+
+	// Read modes of the shards.
+	// Reads take the shard lock in shared mode.
+	ReadModeLocked ConfigReadMode = "locked"
+	// Reads don't take the lock and retry if a writer intervened. Scales better on many cores under read-mostly load.
+	ReadModeOptimistic ConfigReadMode = "optimistic"
+
+	// Eviction policies, they choose entries to evict when the shard is full. Ring storage always evicts the oldest
+	// entries.
+	// No eviction, writes to the full shard fail with ErrorNoSpace.
+	EvictPolicyNone ConfigEvictPolicy = "none"
+	// CLOCK: the oldest entry is evicted unless it was read since the previous pass.
+	EvictPolicyClock ConfigEvictPolicy = "clock"
+	// S3-FIFO: new entries stay in the small queue until they are read, so one-hit wonders don't push out the rest.
+	EvictPolicyS3FIFO ConfigEvictPolicy = "s3fifo"
+
+	// Background tasks.
+	// Expiration of the entries.
+	SchedTaskExpire SchedTask = 0
+	// Vacuum of the shards.
+	SchedTaskVacuum SchedTask = 1
+
 	// Success.
 	ErrorCodeOk ErrorCode = 0
 	// Shard not found for given key.
@@ -38,6 +76,11 @@ const (
 	ErrorCodeKeyExists ErrorCode = 6
 	// Buffer that you reserved for data is too small.
 	ErrorCodeBufLenLow ErrorCode = 7
+	// Key is longer than 65535 bytes.
+	ErrorCodeKeyTooLong ErrorCode = 8
+	// Admission filter rejected the key, since it's requested less often than keys it should replace.
+	// See Config.Admission.
+	ErrorCodeNotAdmitted ErrorCode = 9
 
 	// Cache sizes.
 	Byte     MemorySize = 1
@@ -45,4 +88,9 @@ const (
 	Megabyte            = Kilobyte * 1024
 	Gigabyte            = Megabyte * 1024
 	Terabyte            = Gigabyte * 1024
+
+	// Initial length of the pooled buffer of Get.
+	getBufInitLen = 4096
+	// Pooled buffers longer than that are dropped after use to keep the pool small.
+	getBufMaxLen = 65536
 )
@@ -11,6 +11,8 @@ var (
 	ErrorKeyExpired        = errors.New("key found, but expired")
 	ErrorKeyExists         = errors.New("key already exists")
 	ErrorBufLenLow         = errors.New("insufficient buffer length")
+	ErrorKeyTooLong        = errors.New("key is too long")
+	ErrorNotAdmitted       = errors.New("key is requested less often than keys it should replace")
 
 	ErrorCacheIsDead = errors.New("cache is dead now")
 
@@ -23,5 +25,7 @@ var (
 		ErrorCodeKeyExpired:  ErrorKeyExpired,
 		ErrorCodeKeyExists:   ErrorKeyExists,
 		ErrorCodeBufLenLow:   ErrorBufLenLow,
+		ErrorCodeKeyTooLong:  ErrorKeyTooLong,
+		ErrorCodeNotAdmitted: ErrorNotAdmitted,
 	}
 )
@@ -0,0 +1,121 @@
+#ifndef CBIGCACHE_ADMIT_FILTER_H
+#define CBIGCACHE_ADMIT_FILTER_H
+
+/**
+ * @file TinyLFU admission filter of the shard.
+ */
+
+#include <atomic>
+#include <vector>
+#include "const.h"
+#include "types.h"
+
+/**
+ * TinyLFU admission filter.
+ *
+ * Estimates how often keys are requested: the doorkeeper bloom filter takes the first request of the key, and the
+ * next ones increment the count-min sketch of ADMIT_DEPTH rows of 4-bit counters, 16 counters per word. So keys that
+ * are requested once never reach the sketch. After ADMIT_SAMPLE_FACTOR increments per counter of the row, the filter
+ * ages: counters halve and the doorkeeper clears, so the estimate follows the recent popularity.
+ * The full shard admits the new key only if its estimate is greater than the estimate of the eviction victim.
+ * Requests are recorded lock-free by readers, the words are written only if the counter isn't saturated or the
+ * doorkeeper bit isn't set yet, so reads of the popular keys write nothing. Lost updates of racing readers only make
+ * the estimate a bit lower. Aging halves the counters by CAS, so it doesn't lose increments of concurrent readers.
+ * Caution! age() should be protected with the shard's exclusive lock, only one thread may age the filter at once.
+ */
+class admit_filter {
+public:
+    /**
+     * The constructor.
+     *
+     * @param slots count of counters in the sketch row, will be rounded up to power of two
+     */
+    explicit admit_filter(uint64 slots);
+
+    admit_filter(const admit_filter&) = delete;
+    admit_filter &operator=(const admit_filter&) = delete;
+
+    /**
+     * Record the request of the key.
+     *
+     * @param hash hash of the key
+     */
+    void record(uint64 hash);
+
+    /**
+     * Estimate count of requests of the key since the last aging.
+     *
+     * @param hash hash of the key
+     * @return estimate, doorkeeper adds one
+     */
+    uint64 estimate(uint64 hash);
+
+    /**
+     * Check the candidate may replace the victim.
+     *
+     * @param cand   hash of the new key
+     * @param victim hash of the key to evict
+     * @return true if the candidate is requested more often
+     */
+    bool admit(uint64 cand, uint64 victim);
+
+    /**
+     * Age the filter if enough increments are recorded since the previous aging.
+     *
+     * @return true if aged
+     */
+    bool age();
+
+private:
+    /**
+     * Counters of the sketch, ADMIT_DEPTH rows one after another.
+     */
+    std::vector<std::atomic<uint64>> table;
+
+    /**
+     * Bits of the doorkeeper.
+     */
+    std::vector<std::atomic<uint64>> door;
+
+    /**
+     * Count of bits of the counter index in the row.
+     */
+    uint bits = 0;
+
+    /**
+     * Count of increments since the last aging.
+     */
+    std::atomic<uint64> additions{0};
+
+    /**
+     * Count of increments that triggers aging.
+     */
+    uint64 sample = 0;
+
+    /**
+     * Get index of the key's counter in the row, every row has own seed.
+     *
+     * @param hash hash of the key
+     * @param row  index of the row, rows after ADMIT_DEPTH are used by the doorkeeper
+     * @return index of the counter
+     */
+    uint64 index(uint64 hash, uint row);
+
+    /**
+     * Add the key to the doorkeeper.
+     *
+     * @param hash hash of the key
+     * @return true if the key was there already
+     */
+    bool door_put(uint64 hash);
+
+    /**
+     * Check the key is in the doorkeeper.
+     *
+     * @param hash hash of the key
+     * @return true if found
+     */
+    bool door_has(uint64 hash);
+};
+
+#endif //CBIGCACHE_ADMIT_FILTER_H
@@ -1,14 +1,20 @@
 #ifndef CBIGCACHE_BIGCACHE_H
 #define CBIGCACHE_BIGCACHE_H
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <string>
 #include <thread>
 #include "const.h"
 #include "debug.h"
+#include "lease.h"
 #include "shard.h"
+#include "stats.h"
 #include "ts_counter.h"
 #include "types.h"
+#include "worker_pool.h"
 
 /**
  * Main class.
@@ -30,8 +36,47 @@ public:
     /**
      * Set byte array <code>data</code> to cache under the key <code>key</code>.
      *
+     * Data is binary-safe, zero bytes are stored as is.
      * @param key  string key
      * @param data byte array
+     * @param len  length of the data
+     * @return error code
+     */
+    error set(const std::string &key, const byte *data, uint64 len);
+
+    /**
+     * Set byte array <code>data</code> with its own lifetime to cache under the key <code>key</code>.
+     *
+     * Lifetime has millisecond resolution: the entry is reported expired right after <code>ttl_ns</code>, and evicted
+     * by the next bulk expiration after that.
+     * @param key    string key
+     * @param data   byte array
+     * @param len    length of the data
+     * @param ttl_ns lifetime of the entry in nanoseconds, zero means the cache's expire_ns
+     * @return error code
+     */
+    error set(const std::string &key, const byte *data, uint64 len, uint64 ttl_ns);
+
+    /**
+     * Set byte array <code>data</code> to cache under the binary key <code>key</code>.
+     *
+     * Allows to pass the key without string copy.
+     * @see BigCache::set(const std::string&, const byte*, uint64, uint64)
+     * @param key    key bytes
+     * @param klen   length of the key
+     * @param data   byte array
+     * @param len    length of the data
+     * @param ttl_ns lifetime of the entry in nanoseconds, zero means the cache's expire_ns
+     * @return error code
+     */
+    error set(const byte *key, uint klen, const byte *data, uint64 len, uint64 ttl_ns);
+
+    /**
+     * Set null-terminated byte array <code>data</code> to cache under the key <code>key</code>.
+     *
+     * @see BigCache::set(const std::string&, const byte*, uint64)
+     * @param key  string key
+     * @param data null-terminated byte array
      * @return error code
      */
     error set(const std::string &key, const byte *data);
@@ -39,14 +84,79 @@ public:
     /**
      * Get bytes of the entry corresponding to key <code>key</code>.
      *
+     * Buffer isn't null-terminated. On ERR_BUF_LEN_LOW <code>len_f</code> contains the required length.
      * @param key   string key
      * @param buf   output buffer
      * @param len   max length of the buffer
      * @param len_f actual length of the entry bytes in the cache, output var
      * @return error code
      */
+    error get(const std::string &key, byte* (&buf), uint64 len, uint64 &len_f);
+
+    /**
+     * Get bytes of the entry corresponding to binary key <code>key</code>.
+     *
+     * @see BigCache::get(const std::string&, byte*&, uint64, uint64&)
+     * @param key   key bytes
+     * @param klen  length of the key
+     * @param buf   output buffer
+     * @param len   max length of the buffer
+     * @param len_f actual length of the entry bytes in the cache, output var
+     * @return error code
+     */
+    error get(const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f);
+
+    /**
+     * Get bytes of the entry corresponding to key <code>key</code> as null-terminated string.
+     *
+     * @param key string key
+     * @param buf output buffer
+     * @param len max length of the buffer, including terminating zero byte
+     * @return error code
+     */
     error get(const std::string &key, byte* (&buf), uint len);
 
+    /**
+     * Get length of the entry bytes corresponding to key <code>key</code>.
+     *
+     * @param key   string key
+     * @param len_f actual length of the entry bytes in the cache, output var
+     * @return error code
+     */
+    error len(const std::string &key, uint64 &len_f);
+
+    /**
+     * Get length of the entry bytes corresponding to binary key <code>key</code>.
+     *
+     * @see BigCache::len(const std::string&, uint64&)
+     */
+    error len(const byte *key, uint klen, uint64 &len_f);
+
+    /**
+     * Lease bytes of the entry corresponding to key <code>key</code> without copying.
+     *
+     * @see Shard::lease()
+     * @param key string key
+     * @param l   output lease, must be released with BigCache::release()
+     * @return error code
+     */
+    error lease(const std::string &key, shard_lease &l);
+
+    /**
+     * Lease bytes of the entry corresponding to binary key <code>key</code> without copying.
+     *
+     * @see BigCache::lease(const std::string&, shard_lease&)
+     */
+    error lease(const byte *key, uint klen, shard_lease &l);
+
+    /**
+     * Release the lease taken by BigCache::lease().
+     *
+     * @param l lease
+     * @return error code
+     */
+    error release(shard_lease &l);
+
     /**
      * Evict the entry corresponding to key <code>key</code>.
      *
@@ -55,52 +165,82 @@ public:
      */
     error evict(const std::string &key);
 
+    /**
+     * Evict the entry corresponding to binary key <code>key</code>.
+     *
+     * @see BigCache::evict(const std::string&)
+     */
+    error evict(const byte *key, uint klen);
+
+    /**
+     * Get metrics of the whole cache.
+     *
+     * @param st output stats
+     */
+    void stats(shard_stats &st);
+
+    /**
+     * Get metrics of the single shard.
+     *
+     * @param shard_idx index of the shard
+     * @param st        output stats
+     * @return error code
+     */
+    error stats(uint shard_idx, shard_stats &st);
+
+    /**
+     * Get decisions metrics of the background task scheduler.
+     *
+     * @param task background task, see SCHED_TASK_* consts
+     * @param st   output stats
+     * @return error code
+     */
+    error sched(uint task, sched_stats &st);
+
+    /**
+     * Wake up the expiration supervisor to run the expiration cycle at once.
+     * The cycle runs asynchronously, the call doesn't wait for it.
+     */
+    void expire_now();
+
     /**
      * Expiration supervisor thread control worker.
-     * Spawns a child threads for each shard and calculate expiration timings.
+     * Runs expiration of the shards chosen by the scheduler on the workers.
      */
     void expire_ctl();
 
     /**
-     * Bulk expiration operations over chunk of four shards.
+     * Calculate sleep time of the expiration supervisor till the earliest moment when any shard has entries to expire,
+     * but no longer than the current period of the expiration scheduler.
      *
-     * @param shrd0
-     * @param shrd1
-     * @param shrd2
-     * @param shrd3
+     * @return sleep time in nanoseconds
      */
-    void expire_shard(Shard *shrd0, Shard *shrd1, Shard *shrd2, Shard *shrd3);
+    uint64 expire_wait();
 
     /**
      * Do an expiration operation on a single shard.
      *
      * @param shrd
      */
-    void expire_shard_singe(Shard *shrd);
+    void expire_shard(Shard *shrd);
 
     /**
      * Vacuuming supervisor thread control worker.
-     * Spawns a child threads for each shard and calculate vacuuming timings.
+     * Runs vacuum of the shards chosen by the scheduler on the workers.
      */
     void vacuum_ctl();
 
     /**
-     * Bulk vacuuming operations over chunk of four shards.
+     * Do a vacuum operation on a single shard.
      *
-     * @param shrd0
-     * @param shrd1
-     * @param shrd2
-     * @param shrd3
+     * @param shrd
      */
-    void vacuum_shard(Shard *shrd0, Shard *shrd1, Shard *shrd2, Shard *shrd3);
+    void vacuum_shard(Shard *shrd);
 
     /**
-     * Do an expiration operation on a single shard.
-     *
-     * @param shrd
+     * Stop the supervisors. Sleeping supervisors wake up at once, and the shard tasks that aren't started yet are
+     * skipped.
      */
-    void vacuum_shard_singe(Shard *shrd);
-
     void freeze();
 
 private:
@@ -130,6 +270,12 @@ private:
      */
     bool force_set = false;
 
+    /**
+     * Storage engine of the shards.
+     * @see STORAGE_* consts
+     */
+    uint storage = STORAGE_PAGES;
+
     /**
      * Max size of the whole cache.
      * Note that this param defines only size of payload data and doesn't contain size of indices, etc...
@@ -146,7 +292,8 @@ private:
 
     /**
      * Expiration supervisor thread.
-     * This thread just control expiration timing and spawn child threads that makes all direct work of expiration.
+     * This thread just control expiration timing and dispatches per-shard tasks to the workers that makes all direct
+     * work of expiration.
      */
     std::thread expire_thr;
 
@@ -155,7 +302,12 @@ private:
      * Note, setting this flag to true wouldn't stop expiration operations that already started and executed. This flag
      * only forbids the further running of expiration operations.
      */
-    bool expire_thr_stop_sig = false;
+    std::atomic<bool> expire_thr_stop_sig{false};
+
+    /**
+     * Flag to run the expiration cycle without waiting, guarded by mux_ctl.
+     */
+    bool expire_kick = false;
 
     // todo remove if unused
     ts_counter *expire_cntr;
@@ -168,9 +320,99 @@ private:
      */
     uint64 vacuum_ns = DEF_VACUUM_NS;
 
+    /**
+     * Max time of continuous shard lock hold during vacuum.
+     * Foreground operations on the shard wouldn't wait longer.
+     * Measure: microseconds.
+     */
+    uint64 vacuum_budget_us = DEF_VACUUM_BUDGET_US;
+
+    /**
+     * Max time of continuous shard lock hold during bulk expiration.
+     * Measure: microseconds.
+     */
+    uint64 expire_budget_us = DEF_EXPIRE_BUDGET_US;
+
+    /**
+     * Max count of evictions per shard lock hold during bulk expiration.
+     */
+    uint64 expire_batch = DEF_EXPIRE_BATCH;
+
+    /**
+     * Allocation mode of the shard pages.
+     * @see PAGE_ALLOC_* consts
+     */
+    uint page_alloc = PAGE_ALLOC_MMAP;
+
+    /**
+     * Pre-fault memory of the shard pages on allocation.
+     */
+    bool page_populate = false;
+
+    /**
+     * Count of empty pages to keep allocated in every shard.
+     */
+    uint64 page_release_keep = DEF_PAGE_RELEASE_KEEP;
+
+    /**
+     * Read mode of the shards.
+     * @see READ_MODE_* consts
+     */
+    uint read_mode = READ_MODE_LOCKED;
+
+    /**
+     * Eviction policy of the shards.
+     * @see EVICT_POLICY_* consts
+     */
+    uint evict_policy = DEF_EVICT_POLICY;
+
+    /**
+     * Filter writes to the full shards with the admission filter.
+     */
+    bool admission = false;
+
+    /**
+     * Count of background workers.
+     */
+    uint workers_cnt = DEF_WORKERS;
+
+    /**
+     * Bind background workers to CPUs.
+     */
+    bool worker_affinity = false;
+
+    /**
+     * Pool of background workers shared by expiration and vacuum.
+     */
+    worker_pool *workers;
+
+    /**
+     * CPU budget of every background task, percents of the single CPU time.
+     */
+    uint bg_cpu_budget = DEF_BG_CPU_BUDGET;
+
+    /**
+     * Scheduler of the expiration.
+     */
+    pacer *pacer_e;
+
+    /**
+     * Scheduler of the vacuum.
+     */
+    pacer *pacer_v;
+
+    /**
+     * Run the cycle of the background task over the shards chosen by its scheduler.
+     *
+     * @param task        background task, see SCHED_TASK_* consts
+     * @param interval_ns time since the previous cycle
+     */
+    void sched_cycle(uint task, uint64 interval_ns);
+
     /**
      * Vacuuming supervisor thread.
-     * This thread just control vacuuming timing and spawn child threads that makes all direct work of vacuuming.
+     * This thread just control vacuuming timing and dispatches per-shard tasks to the workers that makes all direct
+     * work of vacuuming.
      */
     std::thread vacuum_thr;
 
@@ -179,7 +421,27 @@ private:
      * Note, setting this flag to true wouldn't stop vacuuming operations that already started and executed. This flag
      * only forbids the further running of vacuuming operations.
      */
-    bool vacuum_thr_stop_sig = false;
+    std::atomic<bool> vacuum_thr_stop_sig{false};
+
+    /**
+     * Mutex of the supervisors' sleep.
+     */
+    std::mutex mux_ctl;
+
+    /**
+     * Supervisors sleep on this condition variable, so freeze() and expire_now() may wake them up.
+     */
+    std::condition_variable cv_ctl;
+
+    /**
+     * Sleep of the supervisor till the timeout, stop signal or kick.
+     *
+     * @param ns       timeout in nanoseconds
+     * @param stop_sig stop signal of the supervisor
+     * @param kick     flag to wake up on demand, reset on wake up; may be null
+     * @return false if the supervisor should stop
+     */
+    bool ctl_wait(uint64 ns, const std::atomic<bool> &stop_sig, bool *kick);
 
     // todo remove if unused
     ts_counter *vacuum_cntr;
@@ -44,6 +44,228 @@ const uint64 DEF_EXPIRE_NS = 60000000000;
  */
 const uint64 DEF_VACUUM_NS = 600000000000;
 
+/**
+ * Default max time of continuous shard lock hold during vacuum.
+ * Foreground operations on the shard wouldn't wait longer than this period (plus copy of the single entry).
+ * Value: 200 us
+ */
+const uint64 DEF_VACUUM_BUDGET_US = 200;
+
+/**
+ * Count of index slots to scan per budget check during vacuum.
+ */
+const uint64 VACUUM_SCAN_STEP = 256;
+
+/**
+ * Default max time of continuous shard lock hold during bulk expiration.
+ * Value: 200 us
+ */
+const uint64 DEF_EXPIRE_BUDGET_US = 200;
+
+/**
+ * Default max count of wheel operations (evictions and moves between levels) per shard lock hold during bulk
+ * expiration.
+ */
+const uint64 DEF_EXPIRE_BATCH = 1024;
+
+/**
+ * Storage engines of the shard.
+ */
+
+/**
+ * Paged storage with free blocks index.
+ * Entry may be split to the several blocks.
+ * Config value: "pages"
+ */
+const uint STORAGE_PAGES = 0;
+
+/**
+ * Log-structured circular buffer.
+ * Entries appends to the head of the ring and evicts from the tail when the ring wraps.
+ * Config value: "ring"
+ */
+const uint STORAGE_RING = 1;
+
+/**
+ * Allocation modes of shard pages.
+ */
+
+/**
+ * Regular heap allocation.
+ * Config value: "heap"
+ */
+const uint PAGE_ALLOC_HEAP = 0;
+
+/**
+ * Anonymous mapping backed by regular pages.
+ * Config value: "mmap"
+ */
+const uint PAGE_ALLOC_MMAP = 1;
+
+/**
+ * Anonymous mapping aligned to huge page and advised to back by transparent huge pages (MADV_HUGEPAGE).
+ * Config value: "thp"
+ */
+const uint PAGE_ALLOC_THP = 2;
+
+/**
+ * Anonymous mapping backed by explicit huge pages (MAP_HUGETLB).
+ * Requires reserved pages in vm.nr_hugepages, falls back to PAGE_ALLOC_THP otherwise.
+ * Config value: "hugetlb"
+ */
+const uint PAGE_ALLOC_HUGETLB = 3;
+
+/**
+ * Size of the huge page.
+ * Value: 2 MB
+ */
+const uint64 HUGE_PAGE_SIZE = 2097152;
+
+/**
+ * Default count of empty pages that shard keeps allocated after usage drop.
+ * Hysteresis for the pages release: new writes take these pages without reserve/release thrashing.
+ */
+const uint64 DEF_PAGE_RELEASE_KEEP = 1;
+
+/**
+ * Default count of background workers that run expiration and vacuum over the shards.
+ * Zero means count of CPUs, but no more than count of shards.
+ */
+const uint DEF_WORKERS = 0;
+
+/**
+ * Default CPU budget of every background task (expiration and vacuum), percents of the single CPU time.
+ */
+const uint DEF_BG_CPU_BUDGET = 25;
+
+/**
+ * Shard is hot if more than 1/PACER_HOT_RATIO of its foreground writes waited for the lock since the previous cycle.
+ * Background work on hot shards is deferred.
+ */
+const uint64 PACER_HOT_RATIO = 8;
+
+/**
+ * Max count of cycles the shard's background work may be deferred for.
+ */
+const uint PACER_MAX_DEFER = 4;
+
+/**
+ * Background task speeds up while more than 1/PACER_ACCEL_RATIO of memory is reclaimable.
+ */
+const uint64 PACER_ACCEL_RATIO = 4;
+
+/**
+ * Background tasks.
+ */
+const uint SCHED_TASK_EXPIRE = 0;
+const uint SCHED_TASK_VACUUM = 1;
+
+/**
+ * Count of size classes of free blocks.
+ * Class <code>c</code> contains blocks with length in range [2^c, 2^(c+1)).
+ */
+const uint FREE_CLS_CNT = 64;
+
+/**
+ * Minimal length of the value to write it to the shard using non-temporal stores.
+ * Such values wouldn't pollute CPU caches.
+ * Value: 64 KB
+ */
+const uint64 NT_COPY_MIN_LEN = 65536;
+
+/**
+ * Read modes of the shard.
+ */
+
+/**
+ * Reads take the shard's lock in shared mode.
+ * Config value: "locked"
+ */
+const uint READ_MODE_LOCKED = 0;
+
+/**
+ * Reads don't take the lock, they validate the result using shard's sequence counter and retry if a writer
+ * intervened.
+ * Config value: "optimistic"
+ */
+const uint READ_MODE_OPTIMISTIC = 1;
+
+/**
+ * Count of optimistic read attempts before fallback to the locked read.
+ */
+const uint READ_OPTIMISTIC_RETRIES = 8;
+
+/**
+ * Eviction policies of the paged storage, they choose entries to evict when the shard is full. Ring storage always
+ * evicts the oldest records.
+ */
+
+/**
+ * No eviction, writes to the full shard fail with ERR_NO_SPACE.
+ * Config value: "none"
+ */
+const uint EVICT_POLICY_NONE = 0;
+
+/**
+ * CLOCK (second chance): the oldest entry is evicted unless it was read since the previous pass.
+ * Config value: "clock"
+ */
+const uint EVICT_POLICY_CLOCK = 1;
+
+/**
+ * S3-FIFO: new entries go to the small FIFO queue and move to the main queue only if they were read there. Keys of
+ * entries evicted from the small queue are remembered by the ghost table and return straight to the main queue.
+ * Config value: "s3fifo"
+ */
+const uint EVICT_POLICY_S3FIFO = 2;
+
+/**
+ * Default eviction policy.
+ */
+const uint DEF_EVICT_POLICY = EVICT_POLICY_S3FIFO;
+
+/**
+ * Count of entry queues of the eviction policy.
+ */
+const uint EVICT_QUEUES = 2;
+
+/**
+ * Shard bytes per slot of the access counters table of the eviction policy. Counters are addressed by key hash, so
+ * the table is sized to have a slot per entry of this size on average.
+ */
+const uint64 EVICT_SLOT_BYTES = 128;
+
+/**
+ * Min count of slots of the access counters table.
+ */
+const uint64 EVICT_MIN_SLOTS = 64;
+
+/**
+ * Max value of the access counter.
+ */
+const uint EVICT_FREQ_MAX = 3;
+
+/**
+ * Size of the S3-FIFO small queue, percents of the shard size.
+ */
+const uint64 S3FIFO_SMALL_PRCNT = 10;
+
+/**
+ * Count of rows of the admission filter's count-min sketch.
+ */
+const uint ADMIT_DEPTH = 4;
+
+/**
+ * Max value of the 4-bit counter of the admission filter's sketch.
+ */
+const uint64 ADMIT_FREQ_MAX = 15;
+
+/**
+ * Admission filter ages after this many increments per counter of the sketch row: all counters halve and the
+ * doorkeeper clears.
+ */
+const uint64 ADMIT_SAMPLE_FACTOR = 10;
+
 /**
  * Min/max constants.
  */
@@ -51,12 +273,50 @@ const uint64 DEF_VACUUM_NS = 600000000000;
 const uint MIN_SHARDS_CNT = 4;
 const uint MAX_SHARDS_CNT = 4096;
 
+/**
+ * Max length of the key.
+ * Keys are stored inline with the entry to verify hash matches.
+ */
+const uint MAX_KEY_LEN = 65535;
+
 /**
  * Minimal value of the lifetime period.
  * Value: 1 sec
  */
 const uint64 MIN_EXPIRE_NS = 1000000000;
 
+/**
+ * Resolution of the expiration index, the tick of the timing wheel.
+ * Bulk expiration evicts the entry no later than the next tick after its expire moment.
+ * Value: 1 ms
+ */
+const uint64 EXPIRE_RESOLUTION_NS = 1000000;
+
+/**
+ * Minimal period of the expiration supervisor.
+ * The supervisor sleeps till the earliest moment when any shard has entries to expire, but no less than that and no
+ * more than the cache's expire_ns.
+ * Value: 100 ms
+ */
+const uint64 MIN_EXPIRE_INTERVAL_NS = 100000000;
+
+/**
+ * Count of levels of the expiration timing wheel.
+ * Every level covers WHEEL_SLOTS times longer period than the previous one, the first level slot is
+ * EXPIRE_RESOLUTION_NS long. Four levels cover about 4.6 hours, entries that expire later wait in the overflow list.
+ */
+const uint WHEEL_LEVELS = 4;
+
+/**
+ * Bits of the wheel tick per level.
+ */
+const uint WHEEL_SLOT_BITS = 6;
+
+/**
+ * Count of slots in the level of the wheel.
+ */
+const uint WHEEL_SLOTS = 1 << WHEEL_SLOT_BITS;
+
 /**
  * Minimal value of the auto vacuum period.
  * Value: 1 min
@@ -154,4 +414,14 @@ const error ERR_KEY_EXISTS = 6;
  */
 const error ERR_BUF_LEN_LOW = 7;
 
+/**
+ * Key is longer than MAX_KEY_LEN.
+ */
+const error ERR_KEY_TOO_LONG = 8;
+
+/**
+ * The entry was rejected by the admission filter: it's requested less often than the entry it should replace.
+ */
+const error ERR_NOT_ADMITTED = 9;
+
 #endif //CBIGCACHE_CONST_H
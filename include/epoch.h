@@ -0,0 +1,125 @@
+#ifndef CBIGCACHE_EPOCH_H
+#define CBIGCACHE_EPOCH_H
+
+/**
+ * @file Epoch-based memory reclamation.
+ */
+
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "types.h"
+
+/**
+ * Count of reader slots in the domain.
+ * Readers beyond this count don't get a slot and must fall back to locked reads.
+ */
+const uint EPOCH_SLOTS = 64;
+
+/**
+ * Slot index that means "no free slot".
+ */
+const uint EPOCH_NO_SLOT = EPOCH_SLOTS;
+
+/**
+ * Size of the CPU cache line.
+ */
+const uint64 EPOCH_CACHE_LINE = 64;
+
+/**
+ * Reader slot, padded to the cache line so epochs of different readers never share a line.
+ * Padding is used instead of alignas, since over-aligned new isn't available in C++14.
+ */
+struct epoch_slot {
+    /**
+     * Epoch the reader entered in, zero if the slot is free.
+     */
+    std::atomic<uint64> epoch;
+
+    byte pad[EPOCH_CACHE_LINE - sizeof(std::atomic<uint64>)];
+};
+
+/**
+ * Epoch-based reclamation domain.
+ *
+ * Lock-free readers publish the epoch they started in to their own slot. Writers don't free memory that readers may
+ * still reference, they retire it with the current epoch instead, and the memory is released only when every active
+ * reader has entered after it was retired.
+ * Caution! Retire and reclaim aren't thread-safe, the shard calls them under its exclusive lock. Enter and exit may
+ * be called from any thread.
+ */
+class epoch_domain {
+public:
+    /**
+     * The constructor.
+     */
+    epoch_domain();
+
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain &operator=(const epoch_domain&) = delete;
+
+    /**
+     * The destructor.
+     * Releases all retired memory, so no readers should be active.
+     */
+    ~epoch_domain();
+
+    /**
+     * Enter the read-side critical section.
+     *
+     * @return slot index to pass to exit() or EPOCH_NO_SLOT if all slots are busy
+     */
+    uint enter();
+
+    /**
+     * Leave the read-side critical section.
+     *
+     * @param slot slot index returned by enter()
+     */
+    void exit(uint slot);
+
+    /**
+     * Defer release of the memory till all current readers leave.
+     *
+     * @param fn function that releases the memory
+     */
+    void retire(std::function<void()> fn);
+
+    /**
+     * Release retired memory that no active reader may reference.
+     *
+     * @return count of released objects
+     */
+    uint64 reclaim();
+
+    /**
+     * Release all retired memory regardless of readers.
+     */
+    void drain();
+
+    /**
+     * Get count of retired and not yet released objects.
+     *
+     * @return count
+     */
+    uint64 pending();
+
+private:
+    /**
+     * Global epoch, advances on every retire.
+     */
+    std::atomic<uint64> epoch;
+
+    /**
+     * Reader slots.
+     */
+    epoch_slot slots[EPOCH_SLOTS];
+
+    /**
+     * Retired objects, pairs of <retire epoch, release function> ordered by epoch.
+     */
+    std::vector<std::pair<uint64, std::function<void()>>> retired;
+};
+
+#endif //CBIGCACHE_EPOCH_H
@@ -0,0 +1,192 @@
+#ifndef CBIGCACHE_EVICT_POLICY_H
+#define CBIGCACHE_EVICT_POLICY_H
+
+/**
+ * @file Eviction policies of the shard.
+ */
+
+#include <atomic>
+#include <vector>
+#include "const.h"
+#include "types.h"
+
+/**
+ * Decision of the policy to evict the entry.
+ * @see evict_policy::decide()
+ */
+const uint EVICT_VICTIM = EVICT_QUEUES;
+
+/**
+ * Describes usage of the policy queues, the shard maintains it.
+ */
+struct evict_usage {
+    /**
+     * Size of the entries in every queue, headers included.
+     * Measure: bytes.
+     */
+    uint64 bytes[EVICT_QUEUES];
+
+    /**
+     * Count of the entries in every queue.
+     */
+    uint64 cnt[EVICT_QUEUES];
+
+    /**
+     * Max size of the shard.
+     * Measure: bytes.
+     */
+    uint64 max;
+};
+
+/**
+ * Base class of the eviction policies.
+ *
+ * The shard keeps entries in EVICT_QUEUES FIFO queues linked through the entries' headers, and the policy only
+ * decides. New entry goes to the tail of the queue chosen by admit(). When the shard needs space, it takes the head
+ * of the queue chosen by victim_queue() and asks decide() whether to evict it or to move it to the tail of some
+ * queue.
+ * Reads are counted by touch() in the table of small counters addressed by the key hash. It's lock-free, so readers
+ * call it under the shared lock or without any lock at all, and never write if the counter is saturated already.
+ * Keys with colliding slots share the counter, it only makes the policy keep some cold entries a bit longer.
+ * Caution! All methods except touch() should be protected with the shard's exclusive lock.
+ */
+class evict_policy {
+public:
+    /**
+     * The constructor.
+     *
+     * @param slots count of the access counters, will be rounded up to power of two
+     */
+    explicit evict_policy(uint64 slots);
+
+    virtual ~evict_policy() = default;
+
+    evict_policy(const evict_policy&) = delete;
+    evict_policy &operator=(const evict_policy&) = delete;
+
+    /**
+     * Count the read of the entry.
+     *
+     * @param hash hash of the key
+     */
+    inline void touch(uint64 hash) {
+        auto &c = this->freq[this->slot(hash)];
+        byte v = c.load(std::memory_order_relaxed);
+        if (v < EVICT_FREQ_MAX) {
+            c.store(byte(v + 1), std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Choose the queue of the new entry.
+     *
+     * @param hash hash of the key
+     * @param u    usage of the queues
+     * @return index of the queue
+     */
+    virtual uint admit(uint64 hash, const evict_usage &u) = 0;
+
+    /**
+     * Choose the queue to take the eviction candidate from.
+     *
+     * @param u usage of the queues
+     * @return index of the queue
+     */
+    virtual uint victim_queue(const evict_usage &u) = 0;
+
+    /**
+     * Decide what to do with the candidate at the head of the queue.
+     *
+     * @param q    index of the queue
+     * @param hash hash of the key
+     * @return EVICT_VICTIM to evict the entry or index of the queue to move it to
+     */
+    virtual uint decide(uint q, uint64 hash) = 0;
+
+    /**
+     * Notify the policy that the candidate was evicted.
+     *
+     * @param q    index of the queue the entry was in
+     * @param hash hash of the key
+     * @param u    usage of the queues
+     */
+    virtual void evicted(uint q, uint64 hash, const evict_usage &u);
+
+protected:
+    /**
+     * Access counters.
+     */
+    std::vector<std::atomic<byte>> freq;
+
+    /**
+     * Count of bits of the slot index.
+     */
+    uint bits = 0;
+
+    /**
+     * Get slot of the key in the tables of the policy.
+     * Low bits of the hash are the same in the shard, so the slot takes high bits of the mixed hash.
+     *
+     * @param hash hash of the key
+     * @return slot index
+     */
+    inline uint64 slot(uint64 hash) {
+        return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - this->bits);
+    }
+};
+
+/**
+ * CLOCK policy.
+ * Single queue plays the role of the clock, the head is the hand: the entry that was read since the previous pass
+ * moves to the tail with the counter reset, otherwise it's evicted.
+ */
+class evict_clock : public evict_policy {
+public:
+    explicit evict_clock(uint64 slots);
+
+    uint admit(uint64 hash, const evict_usage &u) override;
+    uint victim_queue(const evict_usage &u) override;
+    uint decide(uint q, uint64 hash) override;
+};
+
+/**
+ * S3-FIFO policy.
+ * Queue 0 is the small queue of S3FIFO_SMALL_PRCNT percents of the shard, queue 1 is the main one. The entry that
+ * was read while in the small queue moves to the main queue, otherwise it's evicted and its key goes to the ghost
+ * table. The entry of the main queue moves to the tail while its counter is above zero, every move decrements it.
+ * The ghost table keeps fingerprints of the keys in slots of the counters, new fingerprint overwrites the old one, so
+ * the table forgets keys after about as many evictions as it has slots.
+ */
+class evict_s3fifo : public evict_policy {
+public:
+    explicit evict_s3fifo(uint64 slots);
+
+    uint admit(uint64 hash, const evict_usage &u) override;
+    uint victim_queue(const evict_usage &u) override;
+    uint decide(uint q, uint64 hash) override;
+    void evicted(uint q, uint64 hash, const evict_usage &u) override;
+
+private:
+    /**
+     * Ghost table: fingerprints of the keys evicted from the small queue, zero means empty slot.
+     */
+    std::vector<uint> ghost;
+
+    /**
+     * Get fingerprint of the key, never zero.
+     */
+    static inline uint fingerprint(uint64 hash) {
+        return uint(hash >> 32) | 1;
+    }
+};
+
+/**
+ * Make the policy object.
+ *
+ * @param policy   policy, see EVICT_POLICY_* consts
+ * @param max_size max size of the shard, defines count of the access counters
+ * @return policy object or nullptr for EVICT_POLICY_NONE
+ */
+evict_policy *evict_policy_new(uint policy, uint64 max_size);
+
+#endif //CBIGCACHE_EVICT_POLICY_H
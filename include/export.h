@@ -11,6 +11,8 @@ extern "C" {
 
     #include <stdint.h>
     #include "types.h"
+    #include "lease.h"
+    #include "stats.h"
 
     /**
      * Unnamed pointer type to use BigCache class externally.
@@ -35,36 +37,134 @@ extern "C" {
     /**
      * Set the data <code>date</code> to cache under the key <code>key</code>.
      *
+     * Both key and data are binary-safe, exactly <code>klen</code> and <code>len</code> bytes are used.
      * @see BigCache::set()
      * @see ERR_* consts
      * @param cbc_ptr CBigCache object
-     * @param key     string key
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
      * @param data    bytes array
+     * @param len     length of the data
      * @return error code
      */
-    error cbc_set(CBigCache *cbc_ptr, char *key, byte *data);
+    error cbc_set(CBigCache *cbc_ptr, char *key, uint klen, byte *data, uint64 len);
+
+    /**
+     * Set the data <code>date</code> with its own lifetime to cache under the key <code>key</code>.
+     *
+     * @see cbc_set()
+     * @see BigCache::set(const byte*, uint, const byte*, uint64, uint64)
+     * @param cbc_ptr CBigCache object
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
+     * @param data    bytes array
+     * @param len     length of the data
+     * @param ttl_ns  lifetime of the entry in nanoseconds, zero means the cache's default
+     * @return error code
+     */
+    error cbc_set_ttl(CBigCache *cbc_ptr, char *key, uint klen, byte *data, uint64 len, uint64 ttl_ns);
 
     /**
      * Get the entry's data.
      *
-     * Fill the buffer with the entry's bytes.
+     * Fill the buffer with the entry's bytes. Buffer isn't null-terminated.
      * @see BigCache::get()
      * @param cbc_ptr CBigCache object
-     * @param key     string key
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
      * @param buf     output buffer
      * @param len     max length of the buffer
+     * @param len_f   actual length of the entry's data, output var. Filled on ERR_BUF_LEN_LOW as well
+     * @return error code
+     */
+    error cbc_get(CBigCache *cbc_ptr, char *key, uint klen, byte *buf, uint64 len, uint64 *len_f);
+
+    /**
+     * Get length of the entry's data.
+     *
+     * Allows to allocate the buffer of exact size before cbc_get().
+     * @see BigCache::len()
+     * @param cbc_ptr CBigCache object
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
+     * @param len_f   actual length of the entry's data, output var
+     * @return error code
+     */
+    error cbc_len(CBigCache *cbc_ptr, char *key, uint klen, uint64 *len_f);
+
+    /**
+     * Lease the entry's data without copying.
+     *
+     * Segments of the lease point to the cache memory and stay valid until cbc_release().
+     * @see BigCache::lease()
+     * @param cbc_ptr CBigCache object
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
+     * @param lease   output lease
+     * @return error code
+     */
+    error cbc_get_ref(CBigCache *cbc_ptr, char *key, uint klen, struct shard_lease *lease);
+
+    /**
+     * Release the lease taken by cbc_get_ref().
+     *
+     * @see BigCache::release()
+     * @param cbc_ptr CBigCache object
+     * @param lease   lease
      * @return error code
      */
-    error cbc_get(CBigCache *cbc_ptr, char *key, byte *buf, uint len);
+    error cbc_release(CBigCache *cbc_ptr, struct shard_lease *lease);
 
     /**
      * Evict entry from the cache.
      *
      * @param cbc_ptr CBigCache object
-     * @param key     string key
+     * @param key     key bytes, not null-terminated
+     * @param klen    length of the key
+     * @return error code
+     */
+    error cbc_evict(CBigCache *cbc_ptr, char *key, uint klen);
+
+    /**
+     * Get metrics of the whole cache.
+     *
+     * @see BigCache::stats()
+     * @param cbc_ptr CBigCache object
+     * @param st      output stats
+     * @return error code
+     */
+    error cbc_stats(CBigCache *cbc_ptr, struct shard_stats *st);
+
+    /**
+     * Get metrics of the single shard.
+     *
+     * @see BigCache::stats()
+     * @param cbc_ptr   CBigCache object
+     * @param shard_idx index of the shard
+     * @param st        output stats
+     * @return error code
+     */
+    error cbc_shard_stats(CBigCache *cbc_ptr, uint shard_idx, struct shard_stats *st);
+
+    /**
+     * Run expiration cycle at once, asynchronously.
+     *
+     * @see BigCache::expire_now()
+     * @param cbc_ptr CBigCache object
+     * @return error code
+     */
+    error cbc_expire(CBigCache *cbc_ptr);
+
+    /**
+     * Get decisions metrics of the background task scheduler.
+     *
+     * @see BigCache::sched()
+     * @param cbc_ptr CBigCache object
+     * @param task    background task
+     * @param st      output stats
      * @return error code
      */
-    error cbc_evict(CBigCache *cbc_ptr, char *key);
+    error cbc_sched_stats(CBigCache *cbc_ptr, uint task, struct sched_stats *st);
 
 #ifdef __cplusplus
 }
@@ -26,4 +26,13 @@
  */
 uint64 fnv64a(const std::string &s);
 
+/**
+ * Calculate FNV-64 hash of <code>len</code> bytes of <code>s</code>.
+ *
+ * @param s
+ * @param len
+ * @return hash
+ */
+uint64 fnv64a(const byte *s, uint64 len);
+
 #endif //CBIGCACHE_HASH_H
@@ -13,6 +13,22 @@
  */
 uint64 byte_len(const byte *data);
 
+/**
+ * Copy <code>len</code> bytes from <code>src</code> to <code>dst</code> bypassing CPU caches.
+ *
+ * Uses SSE2 non-temporal stores when available and falls back to memcpy otherwise.
+ * Caution! Call mem_fence_nt() after series of copies to make stores visible to other threads.
+ * @param dst
+ * @param src
+ * @param len
+ */
+void mem_copy_nt(byte *dst, const byte *src, uint64 len);
+
+/**
+ * Order non-temporal stores made by mem_copy_nt().
+ */
+void mem_fence_nt();
+
 /**
  * Check if given number is power of two.
  *
@@ -88,6 +104,14 @@ bool atob(const std::string &s);
  */
 uint64 unix_time_now_ns();
 
+/**
+ * Returns monotonic time in nanoseconds.
+ * Uses to measure durations.
+ *
+ * @return uint64
+ */
+uint64 mono_time_now_ns();
+
 /**
  * Returns current formatted UNIX time.
  *
@@ -0,0 +1,60 @@
+#ifndef CBIGCACHE_LEASE_H
+#define CBIGCACHE_LEASE_H
+
+/**
+ * @file Zero-copy read lease.
+ */
+
+#include "types.h"
+
+/**
+ * Describes contiguous part of the entry's data in the shard's memory.
+ */
+struct shard_segment {
+    /**
+     * Pointer to the data.
+     */
+    const byte *ptr;
+
+    /**
+     * Length of the data.
+     */
+    uint64 len;
+};
+
+/**
+ * Describes lease of the entry's data.
+ *
+ * Segments point straight into shard pages. The entry is pinned till the lease is released: eviction, overwrite and
+ * expiration remove it from the index, but its blocks aren't reused, vacuum doesn't move it and its pages aren't
+ * released. Plain struct to pass it through C API as is.
+ * Caution! Lease must be released exactly once and before the cache is destroyed.
+ */
+struct shard_lease {
+    /**
+     * Array of the segments, allocated by the lease.
+     */
+    struct shard_segment *segs;
+
+    /**
+     * Count of the segments.
+     */
+    uint64 segs_cnt;
+
+    /**
+     * Total length of the data.
+     */
+    uint64 len;
+
+    /**
+     * Owner shard, internal.
+     */
+    void *shard;
+
+    /**
+     * Address of the pinned entry, internal.
+     */
+    uint64 addr;
+};
+
+#endif //CBIGCACHE_LEASE_H
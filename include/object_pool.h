@@ -0,0 +1,135 @@
+#ifndef CBIGCACHE_OBJECT_POOL_H
+#define CBIGCACHE_OBJECT_POOL_H
+
+/**
+ * @file Pool of fixed-size objects.
+ */
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "types.h"
+
+/**
+ * Count of objects in the single chunk of the pool.
+ */
+const uint64 POOL_CHUNK_SIZE = 256;
+
+/**
+ * Free-list pool of objects of type <code>T</code>.
+ *
+ * Memory is taken from the global allocator by chunks of POOL_CHUNK_SIZE objects and never returns back until the pool
+ * is destroyed, so released objects are recycled without allocator calls. All chunks are released in bulk by the
+ * destructor, objects still in use are discarded without destruction, so <code>T</code> should be trivially
+ * destructible.
+ * Caution! The pool isn't thread-safe, every shard owns its own pool and uses it under the shard's lock.
+ */
+template <typename T>
+class object_pool {
+public:
+    /**
+     * The constructor.
+     */
+    object_pool() = default;
+
+    object_pool(const object_pool&) = delete;
+    object_pool &operator=(const object_pool&) = delete;
+
+    /**
+     * The destructor.
+     */
+    ~object_pool() {
+        for (auto c : this->chunks) {
+            delete[] c;
+        }
+    }
+
+    /**
+     * Take the object from the pool and initialize it with <code>args</code>.
+     *
+     * @param args initializer of the object
+     * @return pointer to the object
+     */
+    template <typename... Args>
+    T *alloc(Args&&... args) {
+        if (this->head == nullptr) {
+            this->grow();
+        }
+        auto n = this->head;
+        this->head = n->next;
+        this->used++;
+        return new (&n->data) T{std::forward<Args>(args)...};
+    }
+
+    /**
+     * Return the object to the pool.
+     *
+     * @param p pointer to the object taken from this pool
+     */
+    void free(T *p) {
+        p->~T();
+        auto n = reinterpret_cast<node*>(p);
+        n->next = this->head;
+        this->head = n;
+        this->used--;
+    }
+
+    /**
+     * Get count of objects in use.
+     *
+     * @return count
+     */
+    uint64 size() {
+        return this->used;
+    }
+
+    /**
+     * Get count of objects allocated by the pool, both used and free.
+     *
+     * @return count
+     */
+    uint64 capacity() {
+        return this->chunks.size() * POOL_CHUNK_SIZE;
+    }
+
+private:
+    static_assert(std::is_trivially_destructible<T>::value, "pool discards objects without destruction");
+
+    /**
+     * Slot of the pool, contains either the object or the link to the next free slot.
+     */
+    union node {
+        node *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+    };
+
+    /**
+     * Allocated chunks.
+     */
+    std::vector<node*> chunks;
+
+    /**
+     * Head of the free-list.
+     */
+    node *head = nullptr;
+
+    /**
+     * Count of objects in use.
+     */
+    uint64 used = 0;
+
+    /**
+     * Allocate new chunk and push its slots to the free-list.
+     */
+    void grow() {
+        auto c = new node[POOL_CHUNK_SIZE];
+        this->chunks.push_back(c);
+        for (uint64 i = POOL_CHUNK_SIZE; i > 0; i--) {
+            c[i - 1].next = this->head;
+            this->head = &c[i - 1];
+        }
+    }
+};
+
+#endif //CBIGCACHE_OBJECT_POOL_H
@@ -0,0 +1,143 @@
+#ifndef CBIGCACHE_PACER_H
+#define CBIGCACHE_PACER_H
+
+/**
+ * @file Pacing of the background work.
+ */
+
+#include <mutex>
+#include <vector>
+#include "stats.h"
+#include "types.h"
+
+/**
+ * Load of the shard as seen by the pacer.
+ */
+struct shard_load {
+    /**
+     * Count of foreground write operations since the shard creation.
+     */
+    uint64 ops;
+
+    /**
+     * Count of lock acquisitions that had to wait since the shard creation.
+     */
+    uint64 contended;
+
+    /**
+     * Bytes the background task may reclaim now, zero if the task has nothing to do.
+     */
+    uint64 reclaimable;
+
+    /**
+     * Size of memory the reclaimable bytes belong to.
+     */
+    uint64 size;
+};
+
+/**
+ * Scheduler of the periodic background task (expiration or vacuum) over the shards.
+ *
+ * Every cycle the pacer ranks shards that have work by reclaimable bytes and picks as many of them as fit to the CPU
+ * budget, according to the measured cost of the single shard task. Shards with high lock contention are deferred to
+ * let the foreground go, but no longer than PACER_MAX_DEFER cycles, as well as the shards that didn't fit the budget.
+ * The period of the task shrinks while the cycles fit the budget and much memory is reclaimable, and returns back
+ * otherwise.
+ * Caution! Plan and account are called by the single supervisor thread, stats may be taken from any thread.
+ */
+class pacer {
+public:
+    /**
+     * The constructor.
+     *
+     * @param cpu_prcnt     CPU budget, percents of the single CPU time
+     * @param period_ns     base period of the task
+     * @param min_period_ns min period of the task
+     */
+    pacer(uint cpu_prcnt, uint64 period_ns, uint64 min_period_ns);
+
+    /**
+     * Plan the cycle.
+     *
+     * @param loads       current load of every shard
+     * @param interval_ns time since the previous cycle
+     * @param order       indexes of the shards to run, in order of priority, output var
+     */
+    void plan(const std::vector<shard_load> &loads, uint64 interval_ns, std::vector<uint> &order);
+
+    /**
+     * Account the finished cycle.
+     *
+     * @param busy_ns sum of the run time of the tasks
+     * @param cnt     count of the tasks
+     */
+    void account(uint64 busy_ns, uint64 cnt);
+
+    /**
+     * Get current period of the task.
+     *
+     * @return period in nanoseconds
+     */
+    uint64 get_period();
+
+    /**
+     * Get decisions metrics.
+     *
+     * @param st output stats
+     */
+    void get_stats(sched_stats &st);
+
+private:
+    /**
+     * CPU budget in percents.
+     */
+    uint cpu_prcnt;
+
+    /**
+     * Base period of the task.
+     */
+    uint64 period_base;
+
+    /**
+     * Min period of the task.
+     */
+    uint64 period_min;
+
+    /**
+     * Current period of the task.
+     */
+    uint64 period;
+
+    /**
+     * Smoothed cost of the single shard task.
+     * Measure: nanoseconds.
+     */
+    uint64 cost_ns = 0;
+
+    /**
+     * Loads of the shards on the previous plan.
+     */
+    std::vector<shard_load> prev;
+
+    /**
+     * Count of cycles every shard is deferred for.
+     */
+    std::vector<uint> deferred;
+
+    /**
+     * Interval of the last planned cycle.
+     */
+    uint64 interval = 0;
+
+    /**
+     * Decisions metrics.
+     */
+    sched_stats st{};
+
+    /**
+     * Mutex of the state.
+     */
+    std::mutex mux;
+};
+
+#endif //CBIGCACHE_PACER_H
@@ -0,0 +1,102 @@
+#ifndef CBIGCACHE_PAGE_PROVIDER_H
+#define CBIGCACHE_PAGE_PROVIDER_H
+
+/**
+ * @file Memory provider for shard pages.
+ */
+
+#include "debug.h"
+#include "types.h"
+
+/**
+ * Allocates and releases memory of the shard pages.
+ *
+ * Depending on the mode memory comes from the heap or from anonymous mappings backed by regular, transparent huge or
+ * explicit huge (hugetlbfs) pages. Huge page modes round the length up to HUGE_PAGE_SIZE. If explicit huge pages
+ * aren't available (no pages reserved in vm.nr_hugepages), provider falls back to transparent huge pages.
+ * @see PAGE_ALLOC_* consts
+ */
+class page_provider {
+public:
+    /**
+     * The constructor.
+     *
+     * @param mode     allocation mode, see PAGE_ALLOC_* consts
+     * @param populate pre-fault memory on allocation
+     * @param dbg_p    debugger object
+     */
+    page_provider(uint mode, bool populate, debug *dbg_p);
+
+    /**
+     * Allocate memory of <code>size</code> bytes.
+     * Throws an exception if system has no memory.
+     *
+     * @param size length in bytes
+     * @return pointer to the memory
+     */
+    byte *alloc(uint64 size);
+
+    /**
+     * Release memory allocated by alloc().
+     *
+     * @param p    pointer to the memory
+     * @param size the same length as passed to alloc()
+     */
+    void free(byte *p, uint64 size);
+
+    /**
+     * Get count of bytes of the memory that are resident in RAM.
+     *
+     * @param p    pointer to the memory
+     * @param size the same length as passed to alloc()
+     * @return count of bytes
+     */
+    uint64 resident(byte *p, uint64 size);
+
+    /**
+     * Get actual allocation mode.
+     * May differ from requested one after fallback.
+     *
+     * @return mode
+     */
+    uint get_mode();
+
+private:
+    /**
+     * Debugger instance.
+     */
+    debug *dbg;
+
+    /**
+     * Allocation mode.
+     */
+    uint mode;
+
+    /**
+     * Pre-fault flag.
+     */
+    bool populate;
+
+    /**
+     * Mode of the first allocation, defines length rounding for all further allocations.
+     */
+    uint mode_map;
+
+    /**
+     * Calculate length of the mapping for <code>size</code> bytes.
+     *
+     * @param size length in bytes
+     * @return length of the mapping
+     */
+    uint64 map_len(uint64 size);
+
+    /**
+     * Map anonymous memory aligned to HUGE_PAGE_SIZE and advise kernel to back it by transparent huge pages.
+     *
+     * @param len length of the mapping
+     * @return pointer to the memory or nullptr
+     */
+    byte *map_thp(uint64 len);
+};
+
+#endif //CBIGCACHE_PAGE_PROVIDER_H
@@ -1,12 +1,26 @@
 #ifndef CBIGCACHE_SHARD_H
 #define CBIGCACHE_SHARD_H
 
+#include <atomic>
 #include <map>
 #include <mutex>
-#include <list>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 #include "const.h"
+#include "debug.h"
+#include "epoch.h"
+#include "admit_filter.h"
+#include "evict_policy.h"
+#include "lease.h"
+#include "object_pool.h"
+#include "pacer.h"
+#include "page_provider.h"
+#include "shard_index.h"
 #include "shard_page.h"
+#include "shard_config.h"
 #include "shard_entry.h"
+#include "stats.h"
 #include "types.h"
 
 /**
@@ -17,12 +31,11 @@ public:
     /**
      * The constructor.
      *
-     * @param idx       shard's index
-     * @param max_size  max size of the shard
-     * @param expire_ns lifetime period of the entry in the shard
-     * @param debug_p   Debugger object
+     * @param idx     shard's index
+     * @param cfg     shard's settings
+     * @param debug_p Debugger object
      */
-    Shard(uint idx, uint64 max_size, uint64 expire_ns, debug *dbg_p);
+    Shard(uint idx, const shard_config &cfg, debug *dbg_p);
 
     /**
      * The destructor.
@@ -39,51 +52,208 @@ public:
     /**
      * Set the entry bytes in the shard.
      *
-     * @see Shard::_set()
+     * Key bytes are stored inline with the entry and compared on every lookup, so keys with colliding hashes are
+     * different entries. Bytes are binary-safe, zero bytes are stored as is.
+     * @see Shard::__set()
+     * @param hash   hash of the key
+     * @param key    key bytes
+     * @param klen   length of the key, must not exceed MAX_KEY_LEN
+     * @param bytes  bytes array
+     * @param len    length of the bytes
+     * @param ttl_ns lifetime of the entry in nanoseconds, zero means the shard's default
+     * @return error code
+     */
+    error set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 ttl_ns = 0);
+
+    /**
+     * Set the entry bytes in the shard without key.
+     *
+     * Such entry is identified only by the hash.
+     * @see Shard::set(uint64, const byte*, uint, const byte*, uint64)
      * @param key   hash key
      * @param bytes bytes array
+     * @param len   length of the bytes
      * @return error code
      */
-    error set(uint64 key, const byte *bytes);
+    error set(uint64 key, const byte *bytes, uint64 len);
 
     /**
-     * Force set of entry's bytes.
+     * Set null-terminated bytes in the shard without key.
      *
-     * Works the same as Shard::set(), but overwrites existing keys.
-     * @see Shard::_set()
+     * @see Shard::set(uint64, const byte*, uint64)
      * @param key   hash key
-     * @param bytes bytes array
+     * @param bytes null-terminated bytes array
      * @return error code
      */
+    error set(uint64 key, const byte *bytes);
+
+    /**
+     * Force set of entry's bytes.
+     *
+     * Works the same as Shard::set(), but overwrites existing key.
+     * @see Shard::set(uint64, const byte*, uint, const byte*, uint64)
+     */
+    error fset(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 ttl_ns = 0);
+
+    /**
+     * Force set of entry's bytes without key.
+     *
+     * @see Shard::set(uint64, const byte*, uint64)
+     */
+    error fset(uint64 key, const byte *bytes, uint64 len);
+
+    /**
+     * Force set of null-terminated bytes without key.
+     *
+     * @see Shard::fset(uint64, const byte*, uint64)
+     */
     error fset(uint64 key, const byte *bytes);
 
     /**
      * Get entry bytes from the shard.
      *
-     * @param key   hash key
+     * Buffer isn't null-terminated. If the buffer is too small ERR_BUF_LEN_LOW returns and <code>len_f</code> still
+     * contains the actual length, so the caller may retry with the exact size.
+     * In optimistic read mode the buffer may be overwritten even if error returns.
+     * @param hash  hash of the key
+     * @param key   key bytes
+     * @param klen  length of the key
      * @param buf   output buffer
      * @param len   max length of the buffer
-     * @param len_f actual length of the buffer
+     * @param len_f actual length of the entry bytes, output var
+     * @return error code
+     */
+    error get(uint64 hash, const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f);
+
+    /**
+     * Get bytes of the entry stored without key.
+     *
+     * @see Shard::get(uint64, const byte*, uint, byte*&, uint64, uint64&)
+     */
+    error get(uint64 key, byte* (&buf), uint64 len, uint64 &len_f);
+
+    /**
+     * Get bytes of the entry stored without key as null-terminated string.
+     *
+     * @see Shard::get(uint64, byte*&, uint64, uint64&)
+     * @param key hash key
+     * @param buf output buffer
+     * @param len max length of the buffer, including terminating zero byte
      * @return error code
      */
     error get(uint64 key, byte* (&buf), uint len);
 
+    /**
+     * Get length of the entry bytes.
+     *
+     * Allows to allocate buffer of exact size before the get.
+     * @param hash  hash of the key
+     * @param key   key bytes
+     * @param klen  length of the key
+     * @param len_f actual length of the entry bytes, output var
+     * @return error code
+     */
+    error len(uint64 hash, const byte *key, uint klen, uint64 &len_f);
+
+    /**
+     * Get length of the entry stored without key.
+     *
+     * @see Shard::len(uint64, const byte*, uint, uint64&)
+     */
+    error len(uint64 key, uint64 &len_f);
+
+    /**
+     * Lease the entry bytes without copying.
+     *
+     * Fills <code>l</code> with segments pointing to the shard's memory and pins the entry. Pinned entry may be
+     * evicted or overwritten, but its bytes stay intact until Shard::release().
+     * @see shard_lease
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
+     * @param l    output lease
+     * @return error code
+     */
+    error lease(uint64 hash, const byte *key, uint klen, shard_lease &l);
+
+    /**
+     * Release the lease taken by Shard::lease().
+     *
+     * Blocks of the entry evicted during the lease return to the free space with the last release.
+     * @param l lease
+     */
+    void release(shard_lease &l);
+
+    /**
+     * Get snapshot of shard's metrics.
+     *
+     * @param st output stats
+     */
+    void get_stats(shard_stats &st);
+
+    /**
+     * Get load of the shard for the background task scheduler.
+     *
+     * @param task background task, see SCHED_TASK_* consts
+     * @param ld   output load
+     */
+    void get_load(uint task, shard_load &ld);
+
+    /**
+     * Get size of the header of the entry's first block in the shard with the given settings.
+     * Ring records and entries of the shard without eviction policy take shorter headers.
+     *
+     * @param cfg shard's settings
+     * @return size in bytes
+     */
+    static uint64 head_size(const shard_config &cfg);
+
     /**
      * Start bulk expiration.
      *
-     * During this operation all expired entries will be evicted.
+     * During this operation all expired entries will be evicted and empty pages released. Returns at once without the
+     * exclusive lock if nothing is due and nothing may be released.
      * @see Shard::evict()
+     * @see Shard::expire_next()
      * @return error code
      */
     error bulk_expire();
 
+    /**
+     * Get the earliest moment when bulk expiration may have entries to evict. Entries of the upper wheel levels are
+     * reported at the beginning of their slot, so the moment may come earlier than the actual expiration.
+     *
+     * @return UNIX time in nanoseconds or UINT64_MAX if no entry expires
+     */
+    uint64 expire_next();
+
+    /**
+     * Start bulk vacuum.
+     *
+     * Relocates live entries in order of their addresses: every entry slides down to the free space right before it
+     * or moves to the lower free block that fits it whole, and chained entries rewrite into single blocks. Free gaps
+     * merge and move to the upper pages. The lock is released every vacuum_budget_us microseconds to let foreground
+     * operations go.
+     * @return error code
+     */
+    error bulk_vacuum();
+
     /**
      * Evict entry from the shard.
      *
      * In fact the entry will be removed only from the index. The real data of the entry will become a garbage.
-     * @param key hash key
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
      * @return error code
      */
+    error evict(uint64 hash, const byte *key, uint klen);
+
+    /**
+     * Evict entry stored without key.
+     *
+     * @see Shard::evict(uint64, const byte*, uint)
+     */
     error evict(uint64 key);
 
 private:
@@ -97,6 +267,11 @@ private:
      */
     std::map<uint, shard_page*> data;
 
+    /**
+     * Memory provider of the pages.
+     */
+    page_provider *provider = nullptr;
+
     /**
      * Shard index.
      */
@@ -109,6 +284,13 @@ private:
      */
     uint64 sz_max = 0;
 
+    /**
+     * Size of the header of the entry's first block.
+     * Measure: bytes.
+     * @see Shard::head_size()
+     */
+    uint64 sz_head = 0;
+
     /**
      * Page size.
      * Measure: bytes.
@@ -129,120 +311,739 @@ private:
 
     /**
      * Allocated size in shard.
+     * Decreases when empty pages are released.
      * Measure: bytes.
      */
     uint64 sz_alloc = 0;
 
     /**
-     * High address of the shard.
-     * Note it's internal address, not address in virtual memory.
+     * Lifetime period.
+     * Measure: nanoseconds.
+     */
+    uint64 expire_ns = 0;
+
+    /**
+     * Count of empty pages to keep allocated.
      */
-    uint64 addr_hi = 0;
+    uint64 page_keep = DEF_PAGE_RELEASE_KEEP;
 
     /**
-     * Lifetime period.
+     * Count of pages released to the system.
+     */
+    uint64 cnt_pages_released = 0;
+
+    /**
+     * Storage engine.
+     * @see STORAGE_* consts
+     */
+    uint storage = STORAGE_PAGES;
+
+    /**
+     * Max time of continuous lock hold during vacuum.
      * Measure: nanoseconds.
      */
-    uint64 expire_ns = 0;
+    uint64 vacuum_budget_ns = 0;
 
     /**
-     * How many pages already allocated.
+     * Count of entries relocated by vacuum.
      */
-    uint page_init_cnt = 0;
+    uint64 cnt_vacuum_moved = 0;
+
+    /**
+     * Count of entries evicted due to expiration.
+     */
+    uint64 cnt_expired = 0;
+
+    /**
+     * Count of expired entries evicted on access.
+     */
+    uint64 cnt_expired_lazy = 0;
+
+    /**
+     * Count of entries evicted by the eviction policy.
+     */
+    uint64 cnt_evicted = 0;
+
+    /**
+     * Count of writes rejected by the admission filter.
+     */
+    uint64 cnt_rejected = 0;
+
+    /**
+     * Count of foreground write operations.
+     */
+    uint64 cnt_writes = 0;
+
+    /**
+     * Count of lock acquisitions that had to wait.
+     */
+    std::atomic<uint64> cnt_contended{0};
+
+    /**
+     * Max time of continuous lock hold during bulk expiration.
+     * Measure: nanoseconds.
+     */
+    uint64 expire_budget_ns = 0;
+
+    /**
+     * Max count of wheel operations per lock hold during bulk expiration.
+     */
+    uint64 expire_batch = DEF_EXPIRE_BATCH;
+
+    /**
+     * Histogram of lock hold times by bulk expiration.
+     * @see shard_stats::expire_hold_hist
+     */
+    uint64 expire_hold_hist[STATS_HOLD_BUCKETS] = {};
+
+    /**
+     * Longest lock hold by bulk expiration.
+     * Measure: nanoseconds.
+     */
+    uint64 expire_hold_max = 0;
+
+    /**
+     * Read mode.
+     * @see READ_MODE_* consts
+     */
+    uint read_mode = READ_MODE_LOCKED;
+
+    /**
+     * Ring storage: address of the next record to write.
+     */
+    uint64 ring_head = 0;
+
+    /**
+     * Ring storage: address of the oldest record.
+     */
+    uint64 ring_tail = 0;
 
     /**
      * Index of usage data.
      * The key is a hash of entry's string key.
-     * The value is an linked list of use queue.
-     * Complexity: O(log n)
-     * @see shard_entry_root
+     * The value is an address of the entry's first block header in the shard's memory.
+     * Complexity: O(1)
+     * @see shard_entry_hdr
+     * @see shard_index
      */
-    std::map<uint64, shard_entry_root*> idx_used;
+    shard_index idx_used;
 
     /**
-     * Index of free blocks in the shard.
-     * Stores a list of free blocks in the shard.
-     * Complexity: O(1)
+     * Index of free blocks in the shard ordered by offset.
+     * Uses to find adjacent blocks and merge them on free.
+     * Complexity: O(log n)
      * @see shard_entry_free
      */
-    std::list<shard_entry_free*> idx_free;
+    std::map<uint64, shard_entry_free*> idx_free;
 
     /**
-     * Index of keys expiration time.
-     * Stores a pair <expire time in ns, hashes of keys>.
-     * Complexity: O(log n)
+     * Pool of free blocks descriptors.
+     * Blocks split and merge on every write and eviction, so descriptors are recycled without the global allocator.
+     */
+    object_pool<shard_entry_free> pool_free;
+
+    /**
+     * Segregated lists of free blocks by size class.
+     * @see FREE_CLS_CNT
+     */
+    shard_entry_free *free_cls[FREE_CLS_CNT];
+
+    /**
+     * Total count of used blocks of all entries.
+     */
+    uint64 cnt_blocks = 0;
+
+    /**
+     * Hierarchical timing wheel of entries expiration.
+     * Every slot is a head of the doubly linked list of entries, links are stored in entries' headers. Level
+     * <code>l</code> slot <code>s</code> keeps entries that expire in tick with bits <code>s</code> at position
+     * <code>l * WHEEL_SLOT_BITS</code>, within the current span of the upper level. Slots of the upper levels cascade
+     * down when the current tick reaches them.
+     * Complexity: O(1) insert and remove, expiration is proportional to the count of expired entries.
+     * @see WHEEL_LEVELS
+     */
+    uint64 wheel_heads[WHEEL_LEVELS][WHEEL_SLOTS];
+
+    /**
+     * Bitmaps of non-empty slots per level of the wheel, allow to skip empty periods at once.
+     */
+    uint64 wheel_bits[WHEEL_LEVELS];
+
+    /**
+     * Head of the list of entries that expire beyond the span of the wheel.
+     */
+    uint64 wheel_far = ENTRY_ADDR_NIL;
+
+    /**
+     * Size of the entries in every slot of the wheel, headers included, indexed by the slot id: the level times
+     * WHEEL_SLOTS plus the position, the overflow list goes last.
+     * Measure: bytes.
+     */
+    uint64 wheel_bytes[WHEEL_LEVELS * WHEEL_SLOTS + 1];
+
+    /**
+     * Next tick of the wheel to process. All entries of the previous ticks are expired.
+     * Measure: EXPIRE_RESOLUTION_NS.
+     */
+    uint64 wheel_tick = 0;
+
+    /**
+     * Turn of the top level of the wheel the overflow list was placed again at.
+     */
+    uint64 wheel_far_turn = 0;
+
+    /**
+     * Eviction policy of the paged storage, nullptr if the shard doesn't evict.
+     */
+    evict_policy *policy = nullptr;
+
+    /**
+     * Admission filter of the full shard, nullptr if admission is off or the shard doesn't evict.
+     */
+    admit_filter *admit = nullptr;
+
+    /**
+     * Heads and tails of the eviction queues. Every queue is a doubly linked list of entries, links are stored in
+     * entries' headers. Eviction takes entries from the heads.
+     * Complexity: O(1) insert and remove.
+     * @see evict_policy
+     */
+    uint64 evict_heads[EVICT_QUEUES];
+    uint64 evict_tails[EVICT_QUEUES];
+
+    /**
+     * Usage of the eviction queues.
+     */
+    evict_usage evict_use{};
+
+    /**
+     * Shared mutex to acquire access to the shard.
+     * Write operations (set, evict, expire, vacuum moves) take it exclusively, read operations (get, len, stats)
+     * take it shared and run concurrently.
+     */
+    std::shared_timed_mutex mux;
+
+    /**
+     * Sequence counter of the shard's writes.
+     * Odd value means that the writer is modifying the shard at the moment. Optimistic readers read without the lock
+     * and accept the result only if the counter is even and didn't change meanwhile.
+     */
+    std::atomic<uint64> seq{0};
+
+    /**
+     * Reclamation domain of the memory that optimistic readers may reference: pages released to the system and old
+     * tables of the index.
+     */
+    epoch_domain epoch;
+
+    /**
+     * Index of entries pinned by leases.
+     * The key is an address of the entry's first block.
+     * Leases are taken under the shared lock, so the index has its own mutex. Lock order: mux, then mux_pins.
+     * @see shard_pin
+     */
+    std::unordered_map<uint64, shard_pin> pins;
+
+    /**
+     * Mutex of the pins index.
+     */
+    std::mutex mux_pins;
+
+    /**
+     * Check the entry at address <code>addr</code> is pinned by leases.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr address of the entry's first block
+     * @param kill mark pinned entry dead
+     * @return true if pinned
+     */
+    bool entry_pinned(uint64 addr, bool kill);
+
+    /**
+     * Take the lock exclusively and start write sequence.
+     */
+    void write_lock();
+
+    /**
+     * Take the lock shared.
+     */
+    void read_lock();
+
+    /**
+     * Finish write sequence, reclaim retired memory and release the lock.
+     */
+    void write_unlock();
+
+    /**
+     * Read the entry without lock.
+     *
+     * Makes up to READ_OPTIMISTIC_RETRIES attempts, each validated by sequence counter.
+     * @param hash  hash of the key
+     * @param key   key bytes
+     * @param klen  length of the key
+     * @param buf      output buffer
+     * @param len      max length of the buffer
+     * @param len_f    actual length of the entry bytes, output var
+     * @param err      error code, output var
+     * @param len_only get only the length, buf and len are ignored
+     * @return true if consistent result was read, false if the caller should fall back to the locked read
+     */
+    bool read_optimistic(uint64 hash, const byte *key, uint klen, byte *buf, uint64 len, uint64 &len_f,
+                         error &err, bool len_only);
+
+    /**
+     * Single attempt of the optimistic read.
+     *
+     * @see Shard::read_optimistic()
+     * @return true if no writer intervened
+     */
+    bool read_attempt(uint64 hash, const byte *key, uint klen, byte *buf, uint64 len, uint64 &len_f, error &err,
+                      bool len_only);
+
+    /**
+     * Check that no writer ran since sequence <code>seq</code> was read.
+     *
+     * @param seq sequence counter value taken before the read
+     * @return true if read data is consistent
+     */
+    bool read_validate(uint64 seq);
+
+    /**
+     * Allocate memory for the page.
+     * Calls on the first write to the page.
+     *
+     * @param idx_page index of the page
+     */
+    void page_reserve(uint idx_page);
+
+    /**
+     * Release memory of the pages fully covered by free blocks, except page_keep lowest of them.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @return count of released pages
+     */
+    uint64 page_release();
+
+    /**
+     * Check if some pages may be released, i.e. reserved memory has at least page_keep + 1 pages not used by blocks.
+     *
+     * @return true if page_release() may release something
+     */
+    bool page_releasable();
+
+    /**
+     * Add free block to the list of its size class.
+     *
+     * @param f free block
+     */
+    void free_link(shard_entry_free *f);
+
+    /**
+     * Remove free block from the list of its size class.
+     *
+     * @param f free block
+     */
+    void free_unlink(shard_entry_free *f);
+
+    /**
+     * Find the free block that fits <code>len</code> bytes.
+     *
+     * Checks the size class of the length first and then takes any block of upper classes.
+     * @param len required length
+     * @return free block or nullptr if no single block fits
      */
-    std::map<uint64, std::map<uint64, bool>> idx_expire;
+    shard_entry_free *free_find(uint64 len);
 
     /**
-     * Mutex to acquire access to write in the shard.
-     * Uses for whole types of write operations: set, evict, vacuum.
+     * Find the largest free block.
+     *
+     * @return free block or nullptr if shard has no free space
      */
-    std::mutex mux;
+    shard_entry_free *free_largest();
 
     /**
-     * Allocate memory for the new page.
-     * Calls when more space required.
+     * Cut <code>len</code> bytes from the beginning of free block.
+     * The block will be removed if no space left in it.
+     *
+     * @param f   free block
+     * @param len used length
      */
-    void page_reserve();
+    void free_take(shard_entry_free *f, uint64 len);
+
+    /**
+     * Register free block and merge it with adjacent free blocks.
+     *
+     * @param offset start address
+     * @param len    length of the block
+     */
+    void free_put(uint64 offset, uint64 len);
+
+    /**
+     * Move the entry to the lowest free block that fits it whole.
+     *
+     * Single block entries move only to lower addresses, chained entries move to any block or rechain if shard
+     * has no such block.
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr address of the entry's first block
+     * @param buf  temporary buffer
+     * @return true if entry was moved
+     */
+    bool vacuum_entry(uint64 addr, std::vector<byte> &buf);
+
+    /**
+     * Evict the entry if it's expired.
+     *
+     * Readers find expired entries under the shared lock, so they reclaim them after the unlock.
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
+     */
+    void expire_lazy(uint64 hash, const byte *key, uint klen);
+
+    /**
+     * Free space for the new entry by evicting one entry chosen by the policy.
+     *
+     * Expired entries at the heads of the queues are evicted at once. Leased entries can't free space, so they move to
+     * the tail. If the shard has the admission filter, the live victim is evicted only if the new key is requested
+     * more often.
+     * Caution! Call of this func should be protect with mutex.
+     * @param hash     hash of the new key
+     * @param resident the key is overwritten, it was in the shard already and bypasses admission
+     * @return ERR_NO_SPACE if the shard has no policy or no entry may be evicted, ERR_NOT_ADMITTED if the filter
+     * prefers the victim
+     */
+    error evict_one(uint64 hash, bool resident);
+
+    /**
+     * Link the entry to the queue of the eviction policy after the entry <code>after</code>.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr  address of the entry's first block
+     * @param q     index of the queue
+     * @param after address of the entry to link after, ENTRY_ADDR_NIL to link to the head
+     */
+    void evict_link(uint64 addr, uint q, uint64 after);
+
+    /**
+     * Remove the entry from its queue of the eviction policy.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr  address of the entry's first block
+     * @param prev  address of the previous entry in the queue or ENTRY_ADDR_NIL, output var
+     * @return index of the queue
+     */
+    uint evict_unlink(uint64 addr, uint64 &prev);
+
+    /**
+     * Get size of the entry in the shard, headers of all blocks included.
+     *
+     * @param addr address of the entry's first block
+     * @return size in bytes
+     */
+    uint64 entry_size(uint64 addr);
+
+    /**
+     * Get the next tick when the wheel has entries to expire or to cascade.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @return tick or UINT64_MAX if the wheel is empty
+     */
+    uint64 wheel_next();
+
+    /**
+     * Get the size of the entries the wheel would evict if it advanced up to the moment <code>now</code>.
+     *
+     * Upper level slot that is only partially due counts in proportion of its due ticks, as entries are spread over
+     * the slot evenly.
+     * Caution! Call of this func should be protect with mutex.
+     * @param now UNIX time in nanoseconds
+     * @return size in bytes
+     */
+    uint64 wheel_due(uint64 now);
+
+    /**
+     * Get the size of the records bulk expiration would reclaim from the tail of the ring now.
+     *
+     * Walks no more than expire_batch records, the same as the single batch of the bulk expiration.
+     * Caution! Call of this func should be protect with mutex.
+     * @param now UNIX time in nanoseconds
+     * @return size in bytes
+     */
+    uint64 ring_due(uint64 now);
 
     /**
      * Internal setter function.
      *
      * Caution! Call of this func should be protect with mutex.
-     * @param key   hash key
-     * @param bytes bytes array
-     * @param force rewrite existing key flag
+     * @param hash   hash of the key
+     * @param key    key bytes
+     * @param klen   length of the key
+     * @param bytes  bytes array
+     * @param len    length of the bytes
+     * @param ttl_ns lifetime of the entry in nanoseconds, zero means the shard's default
+     * @param force  rewrite existing key flag
      * @return error code
      */
-    error __set(uint64 key, const byte *bytes, bool force);
+    error __set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 ttl_ns, bool force);
 
     /**
      * Internal getter function.
      *
+     * Both storages use the same entry format, so it reads pages and ring records alike.
      * Caution! Call of this func should be protect with mutex.
-     * @param key   hash key
+     * @param hash  hash of the key
+     * @param key   key bytes
+     * @param klen  length of the key
      * @param buf   output buffer
      * @param len   max length of the buffer
-     * @param len_f actual length of the buffer
+     * @param len_f actual length of the entry bytes, output var
      * @return error code
      */
-    error __get(uint64 key, byte* (&buf), uint len);
+    error __get(uint64 hash, const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f);
+
+    /**
+     * Internal length getter function.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param hash  hash of the key
+     * @param key   key bytes
+     * @param klen  length of the key
+     * @param addr  address of the entry's first block, output var
+     * @param len_f actual length of the entry bytes, output var
+     * @return error code
+     */
+    error __len(uint64 hash, const byte *key, uint klen, uint64 &addr, uint64 &len_f);
+
+    /**
+     * Ring storage setter.
+     *
+     * Appends the record to the head of the ring and evicts the oldest records if there is no space.
+     * Records are reclaimed in the order of writes, so the record with shorter lifetime than its predecessors is
+     * reported expired on read, but its space is reclaimed only when the tail reaches it.
+     * Caution! Call of this func should be protect with mutex.
+     * @see Shard::__set()
+     * @param expire expire moment in nanoseconds
+     */
+    error ring_set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 expire, bool force);
+
+    /**
+     * Evict the oldest record of the ring and move the tail to the next one.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param expired_only stop and return false if the oldest record is live and not expired yet
+     * @return true if the tail was moved
+     */
+    bool ring_pop(bool expired_only);
+
+    /**
+     * Register the entry in the expiration wheel.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr   address of the entry's first block
+     * @param expire expire moment in nanoseconds
+     */
+    void wheel_insert(uint64 addr, uint64 expire);
+
+    /**
+     * Remove the entry from the expiration wheel.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr address of the entry's first block
+     */
+    void wheel_remove(uint64 addr);
+
+    /**
+     * Advance the wheel up to the moment <code>now</code> and evict expired entries.
+     *
+     * Stops when expire_batch operations are done or monotonic time reaches <code>deadline</code>. Entries stay in the
+     * wheel till the eviction, so the next call continues from the same point.
+     * Caution! Call of this func should be protect with mutex.
+     * @param now      UNIX time in nanoseconds
+     * @param deadline monotonic time in nanoseconds
+     * @param cnt      count of evicted entries, output var
+     * @return true if the wheel reached <code>now</code>
+     */
+    bool wheel_expire(uint64 now, uint64 deadline, uint64 &cnt);
+
+    /**
+     * Get the list head of the wheel the entry expiring at tick <code>tick</code> belongs to.
+     *
+     * @param tick expire tick
+     * @param lvl  level of the slot, WHEEL_LEVELS for the overflow list, output var
+     * @param pos  position of the slot in the level, output var
+     * @return pointer to the list head
+     */
+    uint64 *wheel_slot(uint64 tick, uint &lvl, uint &pos);
+
+    /**
+     * Push the entry to the list of the slot.
+     *
+     * @param addr address of the entry's first block
+     * @param tick expire tick
+     */
+    void wheel_link(uint64 addr, uint64 tick);
+
+    /**
+     * Remove the head entry of the slot's list.
+     *
+     * @param lvl level of the slot
+     * @param pos position of the slot in the level
+     * @return address of the removed entry
+     */
+    uint64 wheel_pop(uint lvl, uint pos);
 
     /**
-     * Register key in expiration index.
+     * Account the lock hold by bulk expiration in the histogram.
      *
-     * @param expire UNIX time in nanoseconds
-     * @param key    hash key
+     * @param ns duration of the hold in nanoseconds
      */
-    void reg_expire(uint64 expire, uint64 key);
+    void expire_hold(uint64 ns);
+
+    /**
+     * Write links of the wheel to the entry's header.
+     *
+     * @param addr address of the entry's first block
+     * @param prev address of the previous entry in the list
+     * @param next address of the next entry in the list
+     */
+    void wheel_set_links(uint64 addr, uint64 prev, uint64 next);
+
+    /**
+     * Find the entry by hash and key bytes.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
+     * @param addr address of the entry's first block, output var
+     * @return true if found
+     */
+    bool entry_find(uint64 hash, const byte *key, uint klen, uint64 &addr);
+
+    /**
+     * Check the entry at address <code>addr</code> has given hash and key.
+     *
+     * @param addr address of the entry's first block
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
+     * @param peek use racy peek_span() instead of read_span(), for optimistic readers
+     * @return true if the entry matches, false if not or if peek failed
+     */
+    bool entry_match(uint64 addr, uint64 hash, const byte *key, uint klen, bool peek);
+
+    /**
+     * Read header of the block at address <code>addr</code>.
+     * Ring records and short headers of the paged blocks are unpacked to the full header.
+     *
+     * @param addr address in shard
+     * @return header
+     */
+    shard_entry_hdr entry_hdr(uint64 addr);
+
+    /**
+     * Read header of the block without lock, the same way as entry_hdr() does.
+     *
+     * @see Shard::peek_span()
+     * @param addr address in shard
+     * @param hdr  header, output var
+     * @return false if the header is out of shard or crosses not reserved page
+     */
+    bool entry_peek(uint64 addr, shard_entry_hdr &hdr);
+
+    /**
+     * Get size of the block's header in memory.
+     *
+     * @param hdr header of the block
+     * @return size in bytes
+     */
+    inline uint64 hdr_size(const shard_entry_hdr &hdr) {
+        return (hdr.flags & ENTRY_FLAG_CONT) != 0 ? ENTRY_HDR_CONT_SIZE : this->sz_head;
+    }
+
+    /**
+     * Allocate blocks for the entry and write headers and data to them.
+     *
+     * Prefers single block that fits the whole entry, otherwise chains the largest free blocks. Every block starts
+     * with its own header, the first one is followed by the key. If free space is over during chaining, already
+     * written blocks are released.
+     * Caution! Call of this func should be protect with mutex.
+     * @param hash   hash of the key
+     * @param key    key bytes
+     * @param klen   length of the key
+     * @param expire expire moment in nanoseconds
+     * @param bytes  bytes array
+     * @param len    length of the bytes
+     * @param first  free block to use for the first block of the entry or nullptr
+     * @param addr   address of the first block, output var
+     * @return true on success, false if shard has no space
+     */
+    bool entry_write(uint64 hash, const byte *key, uint klen, uint64 expire, const byte *bytes, uint64 len,
+                     shard_entry_free *first, uint64 &addr);
+
+    /**
+     * Return all blocks of the entry starting at address <code>addr</code> to the free index.
+     *
+     * Caution! Call of this func should be protect with mutex.
+     * @param addr address of the first block
+     */
+    void entry_free(uint64 addr);
 
     /**
      * Internal eviction function.
      *
      * Caution! Call of this func should be protect with mutex.
-     * @param key hash key
+     * @param hash hash of the key
+     * @param key  key bytes
+     * @param klen length of the key
      * @return error code
      */
-    error __evict(uint64 key, bool skip_check = false, bool skip_idx_clear = false);
+    error __evict(uint64 hash, const byte *key, uint klen, bool skip_check = false);
+
+    /**
+     * Evict the entry at address <code>addr</code>.
+     *
+     * Pages storage returns its blocks to the free index, ring storage only forgets the record, its space will
+     * reclaim when the tail passes it.
+     * Caution! Call of this func should be protect with mutex.
+     * @param hash           hash of the key
+     * @param addr           address of the entry's first block
+     * @param skip_idx_clear don't remove the entry from the expiration wheel, it's already detached
+     */
+    void entry_evict(uint64 hash, uint64 addr, bool skip_idx_clear);
 
     /**
-     * Set the byte value at the address <code>addr</code>.
+     * Copy <code>len</code> bytes from <code>src</code> to the shard memory starting at address <code>addr</code>.
      *
+     * The range is split into per-page runs and every run is moved with a single copy. Values longer than
+     * NT_COPY_MIN_LEN are written with non-temporal stores.
      * Note <code>addr</code> is an internal address, not address in virtual memory.
      * @param addr address in shard
-     * @param b    single byte to save
+     * @param src  source bytes
+     * @param len  count of bytes to copy
      */
-    void set_byte(uint64 addr, byte b);
+    void write_span(uint64 addr, const byte *src, uint64 len);
 
     /**
-     * Get the byte at the address <code>addr</code>.
+     * Copy <code>len</code> bytes of the shard memory starting at address <code>addr</code> to <code>dst</code>.
      *
      * Note <code>addr</code> is an internal address, not address in virtual memory.
      * @param addr address in shard
-     * @return single byte
+     * @param dst  output buffer
+     * @param len  count of bytes to copy
+     */
+    void read_span(uint64 addr, byte *dst, uint64 len);
+
+    /**
+     * Racy version of read_span() for optimistic readers.
+     *
+     * Never throws and never reads out of shard's memory, but copied bytes are garbage if a writer ran meanwhile.
+     * @param addr address in shard
+     * @param dst  output buffer
+     * @param len  count of bytes to copy
+     * @return false if the range is out of shard or crosses not reserved page
      */
-    byte get_byte(uint64 addr);
+    bool peek_span(uint64 addr, byte *dst, uint64 len);
 };
 
 #endif //CBIGCACHE_SHARD_H
@@ -0,0 +1,86 @@
+#ifndef CBIGCACHE_SHARD_CONFIG_H
+#define CBIGCACHE_SHARD_CONFIG_H
+
+/**
+ * @file Shard's settings.
+ */
+
+#include "const.h"
+#include "types.h"
+
+/**
+ * Describes settings of the shard.
+ * BigCache fills it from the config JSON and passes the same object to every shard.
+ */
+struct shard_config {
+    /**
+     * Max size of the shard.
+     * Measure: bytes.
+     */
+    uint64 max_size = 0;
+
+    /**
+     * Lifetime period of the entry.
+     * Measure: nanoseconds.
+     */
+    uint64 expire_ns = DEF_EXPIRE_NS;
+
+    /**
+     * Storage engine.
+     * @see STORAGE_* consts
+     */
+    uint storage = STORAGE_PAGES;
+
+    /**
+     * Max time of continuous lock hold during vacuum.
+     * Measure: microseconds.
+     */
+    uint64 vacuum_budget_us = DEF_VACUUM_BUDGET_US;
+
+    /**
+     * Max time of continuous lock hold during bulk expiration.
+     * Measure: microseconds.
+     */
+    uint64 expire_budget_us = DEF_EXPIRE_BUDGET_US;
+
+    /**
+     * Max count of evictions per lock hold during bulk expiration.
+     */
+    uint64 expire_batch = DEF_EXPIRE_BATCH;
+
+    /**
+     * Allocation mode of the pages.
+     * @see PAGE_ALLOC_* consts
+     */
+    uint page_alloc = PAGE_ALLOC_MMAP;
+
+    /**
+     * Pre-fault memory of the pages on allocation (MAP_POPULATE).
+     */
+    bool page_populate = false;
+
+    /**
+     * Count of empty pages to keep allocated, others are released to the system.
+     */
+    uint64 page_release_keep = DEF_PAGE_RELEASE_KEEP;
+
+    /**
+     * Read mode.
+     * @see READ_MODE_* consts
+     */
+    uint read_mode = READ_MODE_LOCKED;
+
+    /**
+     * Eviction policy of the paged storage.
+     * @see EVICT_POLICY_* consts
+     */
+    uint evict_policy = DEF_EVICT_POLICY;
+
+    /**
+     * Filter writes to the full shard with the admission filter.
+     * @see admit_filter
+     */
+    bool admission = false;
+};
+
+#endif //CBIGCACHE_SHARD_CONFIG_H
@@ -5,10 +5,13 @@
  * @file Shard's internal structs.
  */
 
+#include <cstddef>
+#include "types.h"
+
 /**
- * Describes a block of usage data.
+ * Describes free block in shard's memory.
  */
-struct shard_entry_used {
+struct shard_entry_free {
     /**
      * Start address in the shard's memory.
      */
@@ -17,22 +20,79 @@ struct shard_entry_used {
     /**
      * Length of the block.
      */
-    uint len;
+    uint64 len;
 
     /**
-     * Pointer to the next block if current block isn't enough to store the entry.
+     * Pointers to the siblings in the size class list.
      */
-    shard_entry_used *next;
+    shard_entry_free *prev;
+    shard_entry_free *next;
 };
 
 /**
- * Describes entry in usage index.
+ * Entry header flag: padding till the end of the ring, not an entry.
+ */
+const uint ENTRY_FLAG_PAD = 1;
+
+/**
+ * Entry header flag: continuation block of the chained entry.
+ */
+const uint ENTRY_FLAG_CONT = 2;
+
+/**
+ * Entry header flag: the entry is linked to the second queue of the eviction policy (S3-FIFO main queue).
+ */
+const uint ENTRY_FLAG_QUEUE = 4;
+
+/**
+ * Position of the entry's expiration wheel slot in the header flags of the first block, the slot takes the upper bits.
+ * @see Shard::wheel_link()
  */
-struct shard_entry_root {
+const uint ENTRY_WHEEL_SHIFT = 7;
+
+/**
+ * Address of the next block of the last block in the chain.
+ */
+const uint64 ENTRY_ADDR_NIL = UINT64_MAX;
+
+/**
+ * Header of the entry's block in the paged storage.
+ *
+ * Stores inline in the shard's memory right before the block's data, so the entry needs no heap metadata: the index
+ * keeps only the address of the first block, and the expiration wheel and the eviction queues link entries through
+ * their headers. The entry may be split to the several blocks linked by <code>next</code>.
+ * Only the first block keeps the whole header, and only if the shard has the eviction policy, otherwise the queue
+ * links are cut off (ENTRY_HDR_HEAD_SIZE). Continuation blocks keep only the fields before <code>hash</code>
+ * (ENTRY_HDR_CONT_SIZE). Fields absent in memory read as ENTRY_ADDR_NIL links and zeroes.
+ * Data of the first block starts with <code>klen</code> bytes of the key, the value follows them. The key is never
+ * split between blocks.
+ * @see Shard::entry_hdr()
+ */
+struct shard_entry_hdr {
+    /**
+     * Length of the data after the header, including key bytes.
+     */
+    uint len;
+
+    /**
+     * Block flags, see ENTRY_FLAG_* consts.
+     */
+    uint16 flags;
+
     /**
-     * Total length of all block of usage data.
+     * Length of the key in the first block, zero in continuation blocks and for entries stored without key.
      */
-    uint total_len;
+    uint16 klen;
+
+    /**
+     * Address of the next block of the entry or ENTRY_ADDR_NIL.
+     */
+    uint64 next;
+
+    /**
+     * Hash key of the entry.
+     */
+    uint64 hash;
 
     /**
      * Expire moment in nanoseconds.
@@ -40,24 +100,77 @@ struct shard_entry_root {
     uint64 expire;
 
     /**
-     * Pointer to the first block of usage data.
+     * Intrusive links of the first block in the timing wheel slot: addresses of the neighbour entries or
+     * ENTRY_ADDR_NIL.
+     * @see Shard::wheel_link()
      */
-    shard_entry_used *root;
+    uint64 wheel_prev;
+    uint64 wheel_next;
+
+    /**
+     * Intrusive links of the first block in the queue of the eviction policy, the same way as the wheel links.
+     * @see Shard::evict_link()
+     */
+    uint64 evict_prev;
+    uint64 evict_next;
 };
 
 /**
- * Describes free block in shard's memory.
+ * Size of the header of the continuation block.
  */
-struct shard_entry_free {
+const uint64 ENTRY_HDR_CONT_SIZE = offsetof(shard_entry_hdr, hash);
+
+/**
+ * Size of the header of the first block in the shard without the eviction policy.
+ */
+const uint64 ENTRY_HDR_HEAD_SIZE = offsetof(shard_entry_hdr, evict_prev);
+
+/**
+ * Header of the ring storage record.
+ *
+ * Records are single blocks reclaimed in the order of writes, so they need neither chain, nor wheel, nor queue links.
+ * Padding till the end of the ring has the same header with ENTRY_FLAG_PAD.
+ */
+struct shard_ring_hdr {
     /**
-     * Start address in the shard's memory.
+     * Length of the data after the header, including key bytes.
      */
-    uint64 offset;
+    uint len;
 
     /**
-     * Length of the block.
+     * Record flags, see ENTRY_FLAG_* consts.
      */
-    uint64 len;
+    uint16 flags;
+
+    /**
+     * Length of the key.
+     */
+    uint16 klen;
+
+    /**
+     * Hash key of the entry.
+     */
+    uint64 hash;
+
+    /**
+     * Expire moment in nanoseconds.
+     */
+    uint64 expire;
+};
+
+/**
+ * Describes the entry pinned by read leases.
+ */
+struct shard_pin {
+    /**
+     * Count of active leases.
+     */
+    uint64 cnt;
+
+    /**
+     * The entry was evicted while pinned, its blocks are released by the last lease.
+     */
+    bool dead;
 };
 
 #endif //CBIGCACHE_SHARD_ENTRY_H
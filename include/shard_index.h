@@ -0,0 +1,521 @@
+#ifndef CBIGCACHE_SHARD_INDEX_H
+#define CBIGCACHE_SHARD_INDEX_H
+
+/**
+ * @file Open-addressing hash index of the shard.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "epoch.h"
+#include "types.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Count of slots in the group.
+ * Control bytes of the whole group are probed at once using SSE2.
+ */
+const uint INDEX_GROUP_SIZE = 16;
+
+/**
+ * Count of low bits of the key that uses to select the shard.
+ * These bits are the same for all keys in the shard, so the index ignores them.
+ * @see BigCache::get_shard()
+ * @see MAX_SHARDS_CNT
+ */
+const uint INDEX_HASH_SHIFT = 12;
+
+/**
+ * Count of low bits of the slot that keep the value.
+ * The rest bits keep the fragment of the hash key.
+ */
+const uint INDEX_VAL_BITS = 40;
+
+/**
+ * Max value that the index may keep.
+ * Values are addresses in the shard, so it limits the shard size.
+ * Value: 1 TB - 1
+ */
+const uint64 INDEX_VAL_MAX = (uint64(1) << INDEX_VAL_BITS) - 1;
+
+/**
+ * Initial count of groups in the index.
+ */
+const uint64 INDEX_INIT_GROUPS = 4;
+
+/**
+ * Count of groups of the old table to move to the new table on every write during resize.
+ */
+const uint64 INDEX_MIGRATE_STEP = 2;
+
+/**
+ * Control byte values.
+ * Full slots keep 7-bit tag of the key, so the highest bit marks special states.
+ */
+const byte INDEX_CTRL_EMPTY = 0x80;
+const byte INDEX_CTRL_DELETED = 0xFE;
+
+/**
+ * Describes a group of slots.
+ * Control bytes are stored inline right before the slots, so the probe of the group touches the same memory.
+ * Every slot packs the fragment of the hash key (upper bits) and the value (lower INDEX_VAL_BITS bits). The full key
+ * isn't stored: the fragment is enough to rehash the slot on resize, and the owner verifies candidates by the data
+ * the value points to.
+ */
+struct shard_index_group {
+    /**
+     * Control bytes, one per slot.
+     * Contains tag of the key in full slot and INDEX_CTRL_* const otherwise.
+     */
+    byte ctrl[INDEX_GROUP_SIZE];
+
+    /**
+     * Slots storage.
+     */
+    uint64 slots[INDEX_GROUP_SIZE];
+};
+
+/**
+ * Describes a table of groups.
+ */
+struct shard_index_table {
+    /**
+     * Array of groups.
+     */
+    shard_index_group *groups;
+
+    /**
+     * Mask to calculate group index, count of groups minus one.
+     */
+    uint64 mask;
+
+    /**
+     * Count of full slots.
+     */
+    uint64 used;
+
+    /**
+     * Count of deleted slots (tombstones).
+     */
+    uint64 deleted;
+};
+
+/**
+ * Snapshot of the index tables for optimistic readers.
+ * @see shard_index::view()
+ */
+struct shard_index_view {
+    /**
+     * Actual table.
+     */
+    shard_index_table tbl;
+
+    /**
+     * Old table, groups are nullptr if no resize is in progress.
+     */
+    shard_index_table tbl_old;
+};
+
+/**
+ * Swiss table-like index of the shard.
+ *
+ * Maps hash keys to 40-bit values. The same key may have several values (entries with colliding hashes), so every
+ * lookup takes a callback that tells which candidate is the required one. Uses groups of 16 slots with inline 8-bit
+ * control bytes that probes at once and triangular probing over groups. Resize is incremental: the new table is
+ * allocated and every write moves a couple of groups from the old one, so no single write does the whole rehash.
+ */
+class shard_index {
+public:
+    /**
+     * The constructor.
+     */
+    shard_index();
+
+    /**
+     * The destructor.
+     */
+    ~shard_index();
+
+    /**
+     * Find value of the key accepted by <code>match</code>.
+     *
+     * @param key   hash key
+     * @param match callback with signature bool(uint64 val), returns true for the required value
+     * @param val   found value, output var
+     * @return true if found
+     */
+    template <typename F>
+    bool find(uint64 key, F match, uint64 &val) {
+        uint64 g;
+        uint s;
+        if (table_find(this->tbl, key, match, g, s)) {
+            val = slot_val(this->tbl.groups[g].slots[s]);
+            return true;
+        }
+        if (this->tbl_old.groups != nullptr && table_find(this->tbl_old, key, match, g, s)) {
+            val = slot_val(this->tbl_old.groups[g].slots[s]);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Check the key has value <code>val</code>.
+     *
+     * @param key hash key
+     * @param val value
+     * @return true if found
+     */
+    bool contains(uint64 key, uint64 val);
+
+    /**
+     * Add new value of the key.
+     * Doesn't check existing values of the key, so the caller must erase or update the old value first.
+     *
+     * @param key hash key
+     * @param val value, must not exceed INDEX_VAL_MAX
+     */
+    void insert(uint64 key, uint64 val);
+
+    /**
+     * Replace value <code>val</code> of the key with <code>val_n</code>.
+     *
+     * @param key   hash key
+     * @param val   old value
+     * @param val_n new value
+     * @return true if old value was found
+     */
+    bool update(uint64 key, uint64 val, uint64 val_n);
+
+    /**
+     * Remove value <code>val</code> of the key from the index.
+     *
+     * @param key hash key
+     * @param val value
+     * @return true if value was found
+     */
+    bool erase(uint64 key, uint64 val);
+
+    /**
+     * Remove all keys.
+     */
+    void clear();
+
+    /**
+     * Get count of values in the index.
+     *
+     * @return count
+     */
+    uint64 size();
+
+    /**
+     * Get count of slots in the index, including old table during resize.
+     *
+     * @return count
+     */
+    uint64 capacity();
+
+    /**
+     * Walk over all values and call <code>fn</code> for each of them.
+     *
+     * Caution! Don't modify the index inside the callback.
+     * @param fn callback with signature void(uint64 val)
+     */
+    template <typename F>
+    void each(F fn) {
+        this->each_table(this->tbl, fn);
+        if (this->tbl_old.groups != nullptr) {
+            this->each_table(this->tbl_old, fn);
+        }
+    }
+
+    /**
+     * Walk over <code>cnt</code> slots starting from position <code>pos</code> and call <code>fn</code> for each value.
+     *
+     * Allows to scan the index by chunks. Slots of the old table follow slots of the actual one. Positions shift
+     * after resize, so values may be skipped or visited twice in this case.
+     * Caution! Don't modify the index inside the callback.
+     * @param pos start position
+     * @param cnt count of slots to scan
+     * @param fn  callback with signature void(uint64 val)
+     * @return position to continue from, it's greater or equal to capacity() when scan is finished
+     */
+    template <typename F>
+    uint64 scan(uint64 pos, uint64 cnt, F fn) {
+        uint64 cap = (this->tbl.mask + 1) * INDEX_GROUP_SIZE;
+        uint64 end = std::min(pos + cnt, this->capacity());
+        for (; pos < end; pos++) {
+            auto &t = pos < cap ? this->tbl : this->tbl_old;
+            uint64 p = pos < cap ? pos : pos - cap;
+            auto grp = &t.groups[p / INDEX_GROUP_SIZE];
+            uint s = p % INDEX_GROUP_SIZE;
+            if ((grp->ctrl[s] & INDEX_CTRL_EMPTY) == 0) {
+                fn(slot_val(grp->slots[s]));
+            }
+        }
+        return pos;
+    }
+
+    /**
+     * Set reclamation domain.
+     * If set, memory of the replaced tables is retired to the domain instead of immediate release, so optimistic
+     * readers may probe them till they leave.
+     *
+     * @param e reclamation domain
+     */
+    void set_reclaim(epoch_domain *e);
+
+    /**
+     * Take snapshot of the tables without lock.
+     *
+     * The snapshot may be torn if the writer runs concurrently, so the caller must validate it (e.g. using seqlock)
+     * before calling view_find().
+     * @return snapshot
+     */
+    shard_index_view view();
+
+    /**
+     * Find value of the key accepted by <code>match</code> in the snapshot.
+     *
+     * Tolerates concurrent modification of the tables: the probe is bounded and never leaves the tables memory, but
+     * the result is meaningful only if no writer ran meanwhile. So <code>match</code> must tolerate garbage values.
+     * @param v     snapshot
+     * @param key   hash key
+     * @param match callback with signature bool(uint64 val)
+     * @param val   found value, output var
+     * @return true if found
+     */
+    template <typename F>
+    static bool view_find(const shard_index_view &v, uint64 key, F match, uint64 &val) {
+        if (v.tbl.groups != nullptr && table_view_find(v.tbl, key, match, val)) {
+            return true;
+        }
+        return v.tbl_old.groups != nullptr && table_view_find(v.tbl_old, key, match, val);
+    }
+
+private:
+    /**
+     * Actual table.
+     */
+    shard_index_table tbl;
+
+    /**
+     * Old table.
+     * Isn't empty only during resize.
+     */
+    shard_index_table tbl_old;
+
+    /**
+     * Index of the next group in the old table to migrate.
+     */
+    uint64 migrate_pos = 0;
+
+    /**
+     * Reclamation domain of the replaced tables.
+     */
+    epoch_domain *reclaim = nullptr;
+
+    /**
+     * Get fragment of the key that stores in the slot.
+     * Takes the bits right above INDEX_HASH_SHIFT, since the lower bits are equal for all keys in the shard.
+     */
+    static inline uint64 key_frag(uint64 key) {
+        return (key >> INDEX_HASH_SHIFT) & ((uint64(1) << (64 - INDEX_VAL_BITS)) - 1);
+    }
+
+    /**
+     * Get the value stored in the slot.
+     */
+    static inline uint64 slot_val(uint64 slot) {
+        return slot & INDEX_VAL_MAX;
+    }
+
+    /**
+     * Get the key fragment stored in the slot.
+     */
+    static inline uint64 slot_frag(uint64 slot) {
+        return slot >> INDEX_VAL_BITS;
+    }
+
+    /**
+     * Calculate index of the first group to probe using key fragment.
+     */
+    static inline uint64 index_h1(uint64 frag, uint64 mask) {
+        uint64 h = frag * 0x9E3779B97F4A7C15ULL;
+        return (h ^ (h >> 32)) & mask;
+    }
+
+    /**
+     * Calculate 7-bit tag of the key.
+     * Takes the highest bits of the key, they are independent of both shard selection and key fragment bits.
+     */
+    static inline byte index_h2(uint64 key) {
+        return byte(key >> 57);
+    }
+
+    /**
+     * Get bitmask of slots in the group which control bytes are equal to <code>b</code>.
+     */
+    static inline uint group_match(const byte *ctrl, byte b) {
+#ifdef __SSE2__
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return uint(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(char(b)))));
+#else
+        uint m = 0;
+        for (uint i = 0; i < INDEX_GROUP_SIZE; i++) {
+            if (ctrl[i] == b) {
+                m |= 1u << i;
+            }
+        }
+        return m;
+#endif
+    }
+
+    /**
+     * Get bitmask of empty or deleted slots in the group.
+     */
+    static inline uint group_match_free(const byte *ctrl) {
+#ifdef __SSE2__
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return uint(_mm_movemask_epi8(c));
+#else
+        uint m = 0;
+        for (uint i = 0; i < INDEX_GROUP_SIZE; i++) {
+            if (ctrl[i] & INDEX_CTRL_EMPTY) {
+                m |= 1u << i;
+            }
+        }
+        return m;
+#endif
+    }
+
+    /**
+     * Allocate new empty table with <code>groups</code> groups.
+     *
+     * @param groups count of groups, must be power of two
+     * @return table
+     */
+    static shard_index_table table_alloc(uint64 groups);
+
+    /**
+     * Release memory of the table.
+     *
+     * @param t     table
+     * @param defer retire memory to the reclamation domain if it's set
+     */
+    void table_free(shard_index_table &t, bool defer);
+
+    /**
+     * Find slot of the key accepted by <code>match</code> in the table.
+     *
+     * @param t     table
+     * @param key   hash key
+     * @param match callback with signature bool(uint64 val)
+     * @param g_out group index, output var
+     * @param s_out slot index, output var
+     * @return true if found
+     */
+    template <typename F>
+    static bool table_find(shard_index_table &t, uint64 key, F match, uint64 &g_out, uint &s_out) {
+        byte tag = index_h2(key);
+        uint64 frag = key_frag(key);
+        uint64 g = index_h1(frag, t.mask);
+        // Triangular probing visits every group once when count of groups is power of two.
+        for (uint64 i = 1; i <= t.mask + 1; i++) {
+            auto grp = &t.groups[g];
+            uint m = group_match(grp->ctrl, tag);
+            while (m != 0) {
+                uint s = __builtin_ctz(m);
+                uint64 slot = grp->slots[s];
+                if (slot_frag(slot) == frag && match(slot_val(slot))) {
+                    g_out = g;
+                    s_out = s;
+                    return true;
+                }
+                m &= m - 1;
+            }
+            // Group with empty slot was never full, so the key can't be placed further.
+            if (group_match(grp->ctrl, INDEX_CTRL_EMPTY) != 0) {
+                return false;
+            }
+            g = (g + i) & t.mask;
+        }
+        return false;
+    }
+
+    /**
+     * Probe the table like table_find(), but read every slot once, since it may change between reads.
+     */
+    template <typename F>
+    static bool table_view_find(const shard_index_table &t, uint64 key, F match, uint64 &val) {
+        byte tag = index_h2(key);
+        uint64 frag = key_frag(key);
+        uint64 g = index_h1(frag, t.mask);
+        for (uint64 i = 1; i <= t.mask + 1; i++) {
+            auto grp = &t.groups[g];
+            byte ctrl[INDEX_GROUP_SIZE];
+            memcpy(ctrl, grp->ctrl, INDEX_GROUP_SIZE);
+            uint m = group_match(ctrl, tag);
+            while (m != 0) {
+                uint s = __builtin_ctz(m);
+                uint64 slot = grp->slots[s];
+                if (slot_frag(slot) == frag && match(slot_val(slot))) {
+                    val = slot_val(slot);
+                    return true;
+                }
+                m &= m - 1;
+            }
+            if (group_match(ctrl, INDEX_CTRL_EMPTY) != 0) {
+                return false;
+            }
+            g = (g + i) & t.mask;
+        }
+        return false;
+    }
+
+    /**
+     * Put the slot to the first available place of the table.
+     *
+     * @param t    table
+     * @param tag  control byte of the slot
+     * @param slot packed slot
+     */
+    static void table_put(shard_index_table &t, byte tag, uint64 slot);
+
+    /**
+     * Mark slot as deleted.
+     *
+     * @param t table
+     * @param g group index
+     * @param s slot index
+     */
+    static void table_del(shard_index_table &t, uint64 g, uint s);
+
+    /**
+     * Start resize if table is overloaded.
+     */
+    void grow();
+
+    /**
+     * Move next INDEX_MIGRATE_STEP groups of the old table to the actual one.
+     *
+     * @param steps count of groups to move
+     */
+    void migrate(uint64 steps);
+
+    template <typename F>
+    void each_table(shard_index_table &t, F fn) {
+        for (uint64 g = 0; g <= t.mask; g++) {
+            auto grp = &t.groups[g];
+            for (uint s = 0; s < INDEX_GROUP_SIZE; s++) {
+                if ((grp->ctrl[s] & INDEX_CTRL_EMPTY) == 0) {
+                    fn(slot_val(grp->slots[s]));
+                }
+            }
+        }
+    }
+};
+
+#endif //CBIGCACHE_SHARD_INDEX_H
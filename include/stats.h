@@ -0,0 +1,227 @@
+#ifndef CBIGCACHE_STATS_H
+#define CBIGCACHE_STATS_H
+
+/**
+ * @file Cache metrics.
+ */
+
+#include "types.h"
+
+/**
+ * Count of buckets of the lock hold time histograms.
+ */
+#define STATS_HOLD_BUCKETS 16
+
+/**
+ * Describes snapshot of shard's (or whole cache's) metrics.
+ * Plain struct to pass it through C API as is.
+ */
+struct shard_stats {
+    /**
+     * Max size of the payload.
+     * Measure: bytes.
+     */
+    uint64 sz_max;
+
+    /**
+     * Usage size.
+     * Measure: bytes.
+     */
+    uint64 sz_used;
+
+    /**
+     * Allocated size of the pages.
+     * Measure: bytes.
+     */
+    uint64 sz_alloc;
+
+    /**
+     * Size of the pages memory that is resident in RAM.
+     * Measure: bytes.
+     */
+    uint64 sz_resident;
+
+    /**
+     * Count of empty pages released to the system.
+     */
+    uint64 pages_released;
+
+    /**
+     * Count of entries.
+     */
+    uint64 entries;
+
+    /**
+     * Count of free blocks.
+     */
+    uint64 free_blocks;
+
+    /**
+     * Length of the largest free block.
+     * Measure: bytes.
+     */
+    uint64 free_largest;
+
+    /**
+     * Count of used blocks of all entries.
+     */
+    uint64 chain_blocks;
+
+    /**
+     * Count of entries relocated by vacuum.
+     */
+    uint64 vacuum_moved;
+
+    /**
+     * Count of entries pinned by read leases.
+     */
+    uint64 leases;
+
+    /**
+     * Count of entries evicted due to expiration.
+     */
+    uint64 expired;
+
+    /**
+     * Count of expired entries evicted on access, included to expired.
+     */
+    uint64 expired_lazy;
+
+    /**
+     * Histogram of shard lock hold times by bulk expiration. Bucket <code>i</code> counts holds from 2^(i-1) to 2^i
+     * microseconds, the first bucket counts holds shorter than 1 us and the last one all holds longer than its lower
+     * bound.
+     */
+    uint64 expire_hold_hist[STATS_HOLD_BUCKETS];
+
+    /**
+     * Longest shard lock hold by bulk expiration.
+     * Measure: nanoseconds.
+     */
+    uint64 expire_hold_max;
+
+    /**
+     * Count of entries evicted by the eviction policy to free space for new ones.
+     */
+    uint64 evicted;
+
+    /**
+     * Count of writes rejected by the admission filter.
+     */
+    uint64 rejected;
+
+    /**
+     * Count of foreground write operations.
+     */
+    uint64 writes;
+
+    /**
+     * Count of shard lock acquisitions that had to wait.
+     */
+    uint64 contended;
+
+    /**
+     * External fragmentation ratio of free space: 1 - largest free block / total free space.
+     * Zero means all free space is contiguous.
+     */
+    float64 frag_ratio;
+
+    /**
+     * Average count of blocks per entry.
+     */
+    float64 chain_avg;
+};
+
+/**
+ * Describes decisions of the background task scheduler.
+ * Plain struct to pass it through C API as is.
+ */
+struct sched_stats {
+    /**
+     * Count of cycles.
+     */
+    uint64 cycles;
+
+    /**
+     * Count of shard tasks run.
+     */
+    uint64 shards_planned;
+
+    /**
+     * Count of shard tasks deferred, since they didn't fit the CPU budget.
+     */
+    uint64 shards_throttled;
+
+    /**
+     * Count of shard tasks deferred due to lock contention on the shard.
+     */
+    uint64 shards_hot;
+
+    /**
+     * Count of period cuts due to much reclaimable memory.
+     */
+    uint64 accelerations;
+
+    /**
+     * Count of shard tasks allowed by the last cycle.
+     */
+    uint64 quota;
+
+    /**
+     * Current period of the task.
+     * Measure: nanoseconds.
+     */
+    uint64 period_ns;
+
+    /**
+     * Bytes that were reclaimable at the last cycle.
+     */
+    uint64 reclaimable;
+
+    /**
+     * Count of foreground write operations seen.
+     */
+    uint64 ops;
+
+    /**
+     * Count of contended shard lock acquisitions seen.
+     */
+    uint64 contended;
+
+    /**
+     * Total run time of the shard tasks.
+     * Measure: nanoseconds.
+     */
+    uint64 busy_ns;
+
+    /**
+     * Smoothed cost of the single shard task.
+     * Measure: nanoseconds.
+     */
+    uint64 cost_ns;
+
+    /**
+     * CPU usage of the last cycle, ratio of the busy time to the interval between cycles.
+     */
+    float64 cpu_usage;
+};
+
+#ifdef __cplusplus
+/**
+ * Calculate derived metrics (ratios) of the stats.
+ *
+ * @param st
+ */
+void stats_calc(shard_stats &st);
+
+/**
+ * Accumulate stats <code>src</code> into <code>dst</code>.
+ * Derived metrics of <code>dst</code> should be recalculated after all.
+ *
+ * @param dst
+ * @param src
+ */
+void stats_add(shard_stats &dst, const shard_stats &src);
+#endif
+
+#endif //CBIGCACHE_STATS_H
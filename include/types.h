@@ -5,6 +5,7 @@
 #include <sys/types.h>
 
 typedef uint8_t byte;
+typedef uint16_t uint16;
 typedef int64_t int64;
 typedef uint64_t uint64;
 typedef double float64;
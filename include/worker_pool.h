@@ -0,0 +1,169 @@
+#ifndef CBIGCACHE_WORKER_POOL_H
+#define CBIGCACHE_WORKER_POOL_H
+
+/**
+ * @file Pool of background workers.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "debug.h"
+#include "types.h"
+
+/**
+ * Max period of the single wait on the condition variable.
+ * Waits are timed, since the untimed condition_variable::wait() requires the newest libstdc++ ABI at runtime.
+ * Value: 100 ms
+ */
+const uint64 WORKER_WAIT_NS = 100000000;
+
+/**
+ * Pool of long-lived threads that run batches of independent tasks.
+ *
+ * Tasks of the batch are split to contiguous chunks, one per worker queue. Every worker takes tasks from the front of
+ * its own queue, and idle ones steal from the back of others, so the batch finishes when the real work is done, no
+ * matter how it is spread over the tasks.
+ * Batches may be run concurrently from several threads.
+ */
+class worker_pool {
+public:
+    /**
+     * The constructor.
+     *
+     * @param size     count of workers, zero means count of CPUs
+     * @param affinity bind every worker to its own CPU
+     * @param dbg      debug object
+     */
+    worker_pool(uint size, bool affinity, debug *dbg);
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool &operator=(const worker_pool&) = delete;
+
+    /**
+     * The destructor.
+     * Waits for the queued tasks and stops the workers.
+     */
+    ~worker_pool();
+
+    /**
+     * Run <code>fn(0) .. fn(n - 1)</code> on the workers and wait till all of them finish.
+     *
+     * @param n  count of tasks
+     * @param fn task function, gets index of the task
+     */
+    void run(uint64 n, const std::function<void(uint64)> &fn);
+
+    /**
+     * Get count of workers.
+     *
+     * @return count
+     */
+    uint size();
+
+    /**
+     * Get count of tasks taken from queues of other workers.
+     *
+     * @return count
+     */
+    uint64 get_steals();
+
+private:
+    /**
+     * Batch of tasks of the single run() call.
+     */
+    struct batch {
+        /**
+         * Task function.
+         */
+        const std::function<void(uint64)> *fn;
+
+        /**
+         * Count of unfinished tasks, guarded by mux.
+         */
+        uint64 left;
+    };
+
+    /**
+     * Task of the batch.
+     */
+    struct task {
+        batch *b;
+        uint64 i;
+    };
+
+    /**
+     * Task queue of the worker.
+     */
+    struct queue {
+        std::mutex mux;
+        std::deque<task> tasks;
+    };
+
+    /**
+     * Debug object.
+     */
+    debug *dbg;
+
+    /**
+     * Worker threads.
+     */
+    std::vector<std::thread> threads;
+
+    /**
+     * Task queues, one per worker.
+     */
+    std::vector<queue*> queues;
+
+    /**
+     * Mutex of the pool state: pending tasks, batches and stop flag.
+     */
+    std::mutex mux;
+
+    /**
+     * Idle workers wait for tasks here.
+     */
+    std::condition_variable cv_task;
+
+    /**
+     * Callers of run() wait for their batches here.
+     */
+    std::condition_variable cv_done;
+
+    /**
+     * Count of queued tasks that aren't taken yet.
+     */
+    uint64 pending = 0;
+
+    /**
+     * Flag to stop the workers.
+     */
+    bool stop = false;
+
+    /**
+     * Count of stolen tasks.
+     */
+    std::atomic<uint64> steals{0};
+
+    /**
+     * Worker thread loop.
+     *
+     * @param w index of the worker
+     */
+    void work(uint w);
+
+    /**
+     * Take the task from the own queue or steal it from another one.
+     *
+     * @param w index of the worker
+     * @param t task, output var
+     * @return true if the task is taken
+     */
+    bool take(uint w, task &t);
+};
+
+#endif //CBIGCACHE_WORKER_POOL_H
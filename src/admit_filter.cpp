@@ -0,0 +1,121 @@
+#include <algorithm>
+#include "admit_filter.h"
+
+/**
+ * Odd seeds of the rows of the sketch and of the doorkeeper probes.
+ */
+static const uint64 ADMIT_SEEDS[ADMIT_DEPTH + 2] = {
+    0x9E3779B97F4A7C15ULL,
+    0xC2B2AE3D27D4EB4FULL,
+    0x165667B19E3779F9ULL,
+    0xD6E8FEB86659FD93ULL,
+    0xFF51AFD7ED558CCDULL,
+    0xC4CEB9FE1A85EC53ULL,
+};
+
+/**
+ * Count of doorkeeper probes.
+ */
+static const uint ADMIT_DOOR_PROBES = 2;
+
+admit_filter::admit_filter(uint64 slots) : table(0), door(0) {
+    // Counters are packed by 16 per word.
+    slots = std::max(slots, uint64(16));
+    while ((uint64(1) << this->bits) < slots) {
+        this->bits++;
+    }
+    uint64 width = uint64(1) << this->bits;
+    this->table = std::vector<std::atomic<uint64>>(ADMIT_DEPTH * width / 16);
+    this->door = std::vector<std::atomic<uint64>>(width / 64 > 0 ? width / 64 : 1);
+    this->sample = width * ADMIT_SAMPLE_FACTOR;
+}
+
+uint64 admit_filter::index(uint64 hash, uint row) {
+    // Low bits of the hash are the same in the shard, so the index takes high bits of the mixed hash.
+    return ((hash ^ (hash >> 29)) * ADMIT_SEEDS[row]) >> (64 - this->bits);
+}
+
+void admit_filter::record(uint64 hash) {
+    if (!this->door_put(hash)) {
+        return;
+    }
+    uint64 width = uint64(1) << this->bits;
+    bool added = false;
+    for (uint r = 0; r < ADMIT_DEPTH; r++) {
+        uint64 i = this->index(hash, r);
+        auto &w = this->table[(r * width + i) / 16];
+        uint sh = uint(i % 16) * 4;
+        uint64 v = w.load(std::memory_order_relaxed);
+        while (((v >> sh) & ADMIT_FREQ_MAX) < ADMIT_FREQ_MAX) {
+            if (w.compare_exchange_weak(v, v + (uint64(1) << sh), std::memory_order_relaxed)) {
+                added = true;
+                break;
+            }
+        }
+    }
+    if (added) {
+        this->additions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64 admit_filter::estimate(uint64 hash) {
+    uint64 width = uint64(1) << this->bits;
+    uint64 est = ADMIT_FREQ_MAX;
+    for (uint r = 0; r < ADMIT_DEPTH; r++) {
+        uint64 i = this->index(hash, r);
+        uint64 v = this->table[(r * width + i) / 16].load(std::memory_order_relaxed);
+        est = std::min(est, (v >> (uint(i % 16) * 4)) & ADMIT_FREQ_MAX);
+    }
+    return est + (this->door_has(hash) ? 1 : 0);
+}
+
+bool admit_filter::admit(uint64 cand, uint64 victim) {
+    return this->estimate(cand) > this->estimate(victim);
+}
+
+bool admit_filter::age() {
+    uint64 cnt = this->additions.load(std::memory_order_relaxed);
+    if (cnt < this->sample) {
+        return false;
+    }
+    // Readers keep recording meanwhile, so every word halves by CAS and their increments are never lost. Increments
+    // that land after the word is halved just count as the recent ones.
+    for (auto &w : this->table) {
+        uint64 v = w.load(std::memory_order_relaxed);
+        while (!w.compare_exchange_weak(v, (v >> 1) & 0x7777777777777777ULL, std::memory_order_relaxed)) {
+        }
+    }
+    // Bit set by the reader right before the clear is dropped, it only costs the key one more request.
+    for (auto &w : this->door) {
+        w.store(0, std::memory_order_relaxed);
+    }
+    // Increments recorded since the load stay counted.
+    this->additions.fetch_sub(cnt - cnt / 2, std::memory_order_relaxed);
+    return true;
+}
+
+bool admit_filter::door_put(uint64 hash) {
+    bool found = true;
+    uint64 mask = this->door.size() * 64 - 1;
+    for (uint p = 0; p < ADMIT_DOOR_PROBES; p++) {
+        uint64 i = this->index(hash, ADMIT_DEPTH + p) & mask;
+        auto &w = this->door[i / 64];
+        uint64 bit = uint64(1) << (i % 64);
+        if ((w.load(std::memory_order_relaxed) & bit) == 0) {
+            w.fetch_or(bit, std::memory_order_relaxed);
+            found = false;
+        }
+    }
+    return found;
+}
+
+bool admit_filter::door_has(uint64 hash) {
+    uint64 mask = this->door.size() * 64 - 1;
+    for (uint p = 0; p < ADMIT_DOOR_PROBES; p++) {
+        uint64 i = this->index(hash, ADMIT_DEPTH + p) & mask;
+        if ((this->door[i / 64].load(std::memory_order_relaxed) & (uint64(1) << (i % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <thread>
 #include <vector>
 #include "bigcache.h"
@@ -37,6 +38,16 @@ BigCache::BigCache(const std::string &config) {
 
         this->force_set = jc->get_b("force_set", false);
 
+        auto storage_s = jc->get_s("storage", "pages");
+        if (storage_s == "ring") {
+            this->storage = STORAGE_RING;
+        } else if (storage_s == "pages") {
+            this->storage = STORAGE_PAGES;
+        } else {
+            this->dbg->warn("unknown storage '%s', fallback to pages", storage_s.c_str());
+            this->storage = STORAGE_PAGES;
+        }
+
         this->max_size = jc->get_inz("max_size", uint64(avail_mem_b() * DEF_MAX_SIZE_AVAIL_FACTOR));
         if (this->max_size <= 0) {
             this->dbg->warn("couldn't determine cache max size, fallback to default %ld b", DEF_MAX_SIZE);
@@ -54,18 +65,98 @@ BigCache::BigCache(const std::string &config) {
                     this->vacuum_ns, MIN_VACUUM_NS, DEF_VACUUM_NS);
             this->vacuum_ns = DEF_VACUUM_NS;
         }
+        this->vacuum_budget_us = jc->get_inz("vacuum_budget_us", DEF_VACUUM_BUDGET_US);
+        this->expire_budget_us = jc->get_inz("expire_budget_us", DEF_EXPIRE_BUDGET_US);
+        this->expire_batch = jc->get_inz("expire_batch", DEF_EXPIRE_BATCH);
+
+        auto page_alloc_s = jc->get_s("page_alloc", "mmap");
+        if (page_alloc_s == "heap") {
+            this->page_alloc = PAGE_ALLOC_HEAP;
+        } else if (page_alloc_s == "mmap") {
+            this->page_alloc = PAGE_ALLOC_MMAP;
+        } else if (page_alloc_s == "thp") {
+            this->page_alloc = PAGE_ALLOC_THP;
+        } else if (page_alloc_s == "hugetlb") {
+            this->page_alloc = PAGE_ALLOC_HUGETLB;
+        } else {
+            this->dbg->warn("unknown page alloc mode '%s', fallback to mmap", page_alloc_s.c_str());
+            this->page_alloc = PAGE_ALLOC_MMAP;
+        }
+        this->page_populate = jc->get_b("page_populate", false);
+        this->page_release_keep = jc->get_i("page_release_keep", DEF_PAGE_RELEASE_KEEP);
+
+        auto read_mode_s = jc->get_s("read_mode", "locked");
+        if (read_mode_s == "locked") {
+            this->read_mode = READ_MODE_LOCKED;
+        } else if (read_mode_s == "optimistic") {
+            this->read_mode = READ_MODE_OPTIMISTIC;
+        } else {
+            this->dbg->warn("unknown read mode '%s', fallback to locked", read_mode_s.c_str());
+            this->read_mode = READ_MODE_LOCKED;
+        }
+
+        auto evict_policy_s = jc->get_s("evict_policy", "s3fifo");
+        if (evict_policy_s == "none") {
+            this->evict_policy = EVICT_POLICY_NONE;
+        } else if (evict_policy_s == "clock") {
+            this->evict_policy = EVICT_POLICY_CLOCK;
+        } else if (evict_policy_s == "s3fifo") {
+            this->evict_policy = EVICT_POLICY_S3FIFO;
+        } else {
+            this->dbg->warn("unknown evict policy '%s', fallback to s3fifo", evict_policy_s.c_str());
+            this->evict_policy = EVICT_POLICY_S3FIFO;
+        }
+        this->admission = jc->get_b("admission", false);
+
+        this->workers_cnt = uint(jc->get_i("workers", DEF_WORKERS));
+        this->bg_cpu_budget = uint(jc->get_inz("bg_cpu_budget", DEF_BG_CPU_BUDGET));
+        this->worker_affinity = jc->get_b("worker_affinity", false);
     }
 
     this->shard_mask = this->shards_cnt - 1;
 
-    uint64 shard_size = this->max_size / this->shards_cnt;
+    shard_config shard_cfg;
+    shard_cfg.max_size = this->max_size / this->shards_cnt;
+    if (shard_cfg.max_size > INDEX_VAL_MAX) {
+        // Index keeps shard addresses in INDEX_VAL_BITS bits.
+        this->dbg->warn("shard size %ld b exceeds max %ld b, increase shards count", shard_cfg.max_size, INDEX_VAL_MAX);
+        shard_cfg.max_size = INDEX_VAL_MAX;
+    }
+    shard_cfg.expire_ns = this->expire_ns;
+    shard_cfg.storage = this->storage;
+    shard_cfg.vacuum_budget_us = this->vacuum_budget_us;
+    shard_cfg.expire_budget_us = this->expire_budget_us;
+    shard_cfg.expire_batch = this->expire_batch;
+    shard_cfg.page_alloc = this->page_alloc;
+    shard_cfg.page_populate = this->page_populate;
+    shard_cfg.page_release_keep = this->page_release_keep;
+    shard_cfg.read_mode = this->read_mode;
+    shard_cfg.evict_policy = this->evict_policy;
+    shard_cfg.admission = this->admission;
+
+    uint64 shard_size = shard_cfg.max_size;
     for (uint i = 0; i < this->shards_cnt; i++) {
-        this->shards[i] = new Shard(i, shard_size, this->expire_ns, this->dbg);
+        this->shards[i] = new Shard(i, shard_cfg, this->dbg);
         this->dbg->l2("shrd #%d inited at ptr %p with size %ld b", i, this->shards[i], shard_size);
     }
 
-    this->dbg->l1("cache inited with params:\n\t-shards: %ld\n\t-shard mask: %d\n\t-max size: %ld b\n\t-expire: %ld ns\n\t-vacuum: %ld ns",
-             this->shards_cnt, this->shard_mask, this->max_size, this->expire_ns, this->vacuum_ns);
+    this->dbg->l1("cache inited with params:\n\t-shards: %ld\n\t-shard mask: %d\n\t-max size: %ld b\n\t-expire: %ld ns\n\t-vacuum: %ld ns\n\t-vacuum budget: %ld us\n\t-expire budget: %ld us (batch %ld)\n\t-storage: %d\n\t-page alloc: %d (populate %d)\n\t-read mode: %d\n\t-evict policy: %d (admission %d)",
+             this->shards_cnt, this->shard_mask, this->max_size, this->expire_ns, this->vacuum_ns, this->vacuum_budget_us,
+             this->expire_budget_us, this->expire_batch,
+             this->storage, this->page_alloc, this->page_populate, this->read_mode,
+             this->evict_policy, this->admission);
+
+    // Init background workers, there is no use in more workers than shards.
+    uint workers_cnt = this->workers_cnt;
+    if (workers_cnt == 0) {
+        workers_cnt = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    this->workers = new worker_pool(std::min(workers_cnt, uint(this->shards_cnt)), this->worker_affinity, this->dbg);
+    this->dbg->l1("cache background workers: %d (affinity %d)", this->workers->size(), this->worker_affinity);
+
+    // Init schedulers of the background tasks.
+    this->pacer_e = new pacer(this->bg_cpu_budget, this->expire_ns, MIN_EXPIRE_INTERVAL_NS);
+    this->pacer_v = new pacer(this->bg_cpu_budget, this->vacuum_ns, MIN_VACUUM_NS);
 
     // Init expire supervisor thread.
     this->expire_cntr = new ts_counter();
@@ -84,6 +175,9 @@ BigCache::~BigCache() {
     // Sync supervisor threads
     this->expire_thr.join();
     this->vacuum_thr.join();
+    delete this->workers;
+    delete this->pacer_e;
+    delete this->pacer_v;
 
     for (uint i = 0; i < this->shards_cnt; i++) {
         delete this->shards[i];
@@ -93,194 +187,262 @@ BigCache::~BigCache() {
     delete this->vacuum_cntr;
 }
 
-error BigCache::set(const std::string &key, const byte *data) {
-    auto hashKey = fnv64a(key);
-    this->dbg->l3("set: key '%s' (hkey %ld), data %ld b", key.c_str(), hashKey, byte_len(data));
+error BigCache::set(const byte *key, uint klen, const byte *data, uint64 len, uint64 ttl_ns) {
+    auto hashKey = fnv64a(key, klen);
+    auto k = reinterpret_cast<const char*>(key);
+    this->dbg->l3("set: key '%.*s' (hkey %ld), data %ld b, ttl %ld ns", int(klen), k, hashKey, len, ttl_ns);
     auto shard = this->get_shard(hashKey);
     if (shard == nullptr) {
-        this->dbg->err("shard not found for key '%s' (%ld)", key.c_str(), hashKey);
+        this->dbg->err("shard not found for key '%.*s' (%ld)", int(klen), k, hashKey);
         return ERR_NO_SHARD;
     }
     this->dbg->l3("shrd #%d src_w", shard->get_idx());
-    return this->force_set ? shard->fset(hashKey, data) : shard->set(hashKey, data);
+    return this->force_set ? shard->fset(hashKey, key, klen, data, len, ttl_ns) :
+           shard->set(hashKey, key, klen, data, len, ttl_ns);
 }
 
-error BigCache::get(const std::string &key, byte* (&buf), uint len) {
-    auto hashKey = fnv64a(key);
-    this->dbg->l3("get: key '%s' (hkey %ld), supposed buffer length %ld b", key.c_str(), hashKey, len);
+error BigCache::set(const std::string &key, const byte *data, uint64 len) {
+    return this->set(key, data, len, 0);
+}
+
+error BigCache::set(const std::string &key, const byte *data, uint64 len, uint64 ttl_ns) {
+    return this->set(reinterpret_cast<const byte*>(key.data()), uint(key.size()), data, len, ttl_ns);
+}
+
+error BigCache::set(const std::string &key, const byte *data) {
+    return this->set(key, data, byte_len(data));
+}
+
+error BigCache::get(const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f) {
+    auto hashKey = fnv64a(key, klen);
+    auto k = reinterpret_cast<const char*>(key);
+    this->dbg->l3("get: key '%.*s' (hkey %ld), supposed buffer length %ld b", int(klen), k, hashKey, len);
     auto shard = this->get_shard(hashKey);
     if (shard == nullptr) {
-        this->dbg->err("shard not found for key '%s' (%ld)", key.c_str(), hashKey);
+        this->dbg->err("shard not found for key '%.*s' (%ld)", int(klen), k, hashKey);
         return ERR_NO_SHARD;
     }
     this->dbg->l3("shrd #%d src_r", shard->get_idx());
-    return shard->get(hashKey, buf, len);
+    return shard->get(hashKey, key, klen, buf, len, len_f);
 }
 
-error BigCache::evict(const std::string &key) {
-    auto hashKey = fnv64a(key);
-    this->dbg->l3("evk: key '%s' (hkey %ld)", key.c_str(), hashKey);
+error BigCache::get(const std::string &key, byte* (&buf), uint64 len, uint64 &len_f) {
+    return this->get(reinterpret_cast<const byte*>(key.data()), uint(key.size()), buf, len, len_f);
+}
+
+error BigCache::get(const std::string &key, byte* (&buf), uint len) {
+    if (len == 0) {
+        return ERR_BUF_LEN_LOW;
+    }
+    // Keep the last byte for the terminating zero.
+    uint64 len_f = 0;
+    auto err = this->get(key, buf, uint64(len - 1), len_f);
+    if (err == ERR_OK) {
+        buf[len_f] = '\000';
+    }
+    return err;
+}
+
+error BigCache::len(const byte *key, uint klen, uint64 &len_f) {
+    auto hashKey = fnv64a(key, klen);
+    auto shard = this->get_shard(hashKey);
+    if (shard == nullptr) {
+        this->dbg->err("shard not found for key '%.*s' (%ld)", int(klen), reinterpret_cast<const char*>(key), hashKey);
+        return ERR_NO_SHARD;
+    }
+    return shard->len(hashKey, key, klen, len_f);
+}
+
+error BigCache::len(const std::string &key, uint64 &len_f) {
+    return this->len(reinterpret_cast<const byte*>(key.data()), uint(key.size()), len_f);
+}
+
+error BigCache::lease(const byte *key, uint klen, shard_lease &l) {
+    auto hashKey = fnv64a(key, klen);
+    auto k = reinterpret_cast<const char*>(key);
+    this->dbg->l3("lease: key '%.*s' (hkey %ld)", int(klen), k, hashKey);
+    auto shard = this->get_shard(hashKey);
+    if (shard == nullptr) {
+        this->dbg->err("shard not found for key '%.*s' (%ld)", int(klen), k, hashKey);
+        return ERR_NO_SHARD;
+    }
+    return shard->lease(hashKey, key, klen, l);
+}
+
+error BigCache::lease(const std::string &key, shard_lease &l) {
+    return this->lease(reinterpret_cast<const byte*>(key.data()), uint(key.size()), l);
+}
+
+error BigCache::release(shard_lease &l) {
+    // Lease knows its shard, so the key isn't needed.
+    if (l.shard == nullptr) {
+        return ERR_OK;
+    }
+    static_cast<Shard*>(l.shard)->release(l);
+    return ERR_OK;
+}
+
+error BigCache::evict(const byte *key, uint klen) {
+    auto hashKey = fnv64a(key, klen);
+    auto k = reinterpret_cast<const char*>(key);
+    this->dbg->l3("evk: key '%.*s' (hkey %ld)", int(klen), k, hashKey);
     auto shard = this->get_shard(hashKey);
     if (shard == nullptr) {
-        this->dbg->err("shard not found for key '%s' (%ld)", key.c_str(), hashKey);
+        this->dbg->err("shard not found for key '%.*s' (%ld)", int(klen), k, hashKey);
         return ERR_NO_SHARD;
     }
     this->dbg->l3("shrd #%d src_e", shard->get_idx());
-    return shard->evict(hashKey);
+    return shard->evict(hashKey, key, klen);
+}
+
+error BigCache::evict(const std::string &key) {
+    return this->evict(reinterpret_cast<const byte*>(key.data()), uint(key.size()));
+}
+
+void BigCache::stats(shard_stats &st) {
+    st = shard_stats{};
+    for (auto &shard : this->shards) {
+        shard_stats st_s{};
+        shard.second->get_stats(st_s);
+        stats_add(st, st_s);
+    }
+    stats_calc(st);
+}
+
+error BigCache::stats(uint shard_idx, shard_stats &st) {
+    if (this->shards.count(shard_idx) == 0) {
+        return ERR_NO_SHARD;
+    }
+    this->shards[shard_idx]->get_stats(st);
+    return ERR_OK;
 }
 
 void BigCache::freeze() {
+    std::lock_guard<std::mutex> lock(this->mux_ctl);
     this->expire_thr_stop_sig = true;
     this->vacuum_thr_stop_sig = true;
+    this->cv_ctl.notify_all();
 }
 
-void BigCache::expire_ctl() {
-    uint64 prev_took = 0;
-    auto thr_e_id = std::this_thread::get_id();
-    while (true) {
-        bool skip = false;
-        // Check and warn if previous expiration took more time than expire_ns.
-        if (prev_took > this->expire_ns) {
-            this->dbg->warn("thr_e #%x: prev expire took %ld ns > expire time %ld ns, skip expire cycle. advise: increase shards count",
-                    thr_e_id, prev_took, this->expire_ns);
-            // Wait, but skip current cycle.
-            prev_took = 0;
-            skip = true;
-        }
-        std::this_thread::sleep_for(std::chrono::nanoseconds(this->expire_ns - prev_took));
-        if (skip) {
-            continue;
-        }
-
-        auto time_s = unix_time_now_ns();
-
-        this->dbg->l2("thr_e #%x: expire cycle start", thr_e_id);
-        std::vector<std::thread> thr_c_pool{};
-        if (this->shards_cnt >= 16) {
-            // Init and start shards_cnt/4 child threads.
-            // Each thread is responsible to do expiration check and cleanup for chunk of 4 shard.
-            for (uint i = 0; i < this->shards_cnt; i = i + 4) {
-                thr_c_pool.emplace_back(std::thread(&BigCache::expire_shard, this,
-                        this->shards[i], this->shards[i+1], this->shards[i+2], this->shards[i+3]));
-            }
-        } else {
-            // Init and start one thread for each shard.
-            for (uint i = 0; i < this->shards_cnt; i++) {
-                thr_c_pool.emplace_back(std::thread(&BigCache::expire_shard_singe, this, this->shards[i]));
-            }
-        }
-        this->dbg->l2("thr_e #%x: %d child threads started", thr_e_id, thr_c_pool.size());
-        for (auto &thr_c : thr_c_pool) {
-            thr_c.join();
-        }
+error BigCache::sched(uint task, sched_stats &st) {
+    if (task != SCHED_TASK_EXPIRE && task != SCHED_TASK_VACUUM) {
+        this->dbg->err("unknown background task %d", task);
+        return ERR_INTERNAL;
+    }
+    (task == SCHED_TASK_EXPIRE ? this->pacer_e : this->pacer_v)->get_stats(st);
+    return ERR_OK;
+}
 
-        auto time_e = unix_time_now_ns();
-        prev_took = time_e - time_s;
+void BigCache::expire_now() {
+    std::lock_guard<std::mutex> lock(this->mux_ctl);
+    this->expire_kick = true;
+    this->cv_ctl.notify_all();
+}
 
-        this->dbg->l2("thr_e #%x: expire cycle finish, time took %ld ns", thr_e_id, prev_took);
+bool BigCache::ctl_wait(uint64 ns, const std::atomic<bool> &stop_sig, bool *kick) {
+    // Huge timeouts are cut, so the deadline doesn't overflow the clock.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(std::min(ns, uint64(INT64_MAX / 2)));
+    std::unique_lock<std::mutex> lock(this->mux_ctl);
+    while (!stop_sig && (kick == nullptr || !*kick) && std::chrono::steady_clock::now() < deadline) {
+        this->cv_ctl.wait_until(lock, deadline);
+    }
+    if (kick != nullptr) {
+        *kick = false;
+    }
+    return !stop_sig;
+}
 
-        if (this->expire_thr_stop_sig) {
+void BigCache::expire_ctl() {
+    auto thr_e_id = std::this_thread::get_id();
+    uint64 prev_s = mono_time_now_ns();
+    while (true) {
+        if (!this->ctl_wait(this->expire_wait(), this->expire_thr_stop_sig, &this->expire_kick)) {
             this->dbg->l1("thr_e #%x: caught stop sig. exiting", thr_e_id);
             break;
         }
+        auto time_s = mono_time_now_ns();
+        this->dbg->l2("thr_e #%x: expire cycle start", thr_e_id);
+        this->sched_cycle(SCHED_TASK_EXPIRE, time_s - prev_s);
+        prev_s = time_s;
     }
 }
 
-void BigCache::expire_shard(Shard *shrd0, Shard *shrd1, Shard *shrd2, Shard *shrd3) {
-    this->dbg->l2("thr_ec #%x: expire start on shrd #%d, #%d, #%d, #%d",
-            std::this_thread::get_id(), shrd0->get_idx(), shrd1->get_idx(), shrd2->get_idx(), shrd3->get_idx());
-    this->expire_cntr->inc();
-    shrd0->bulk_expire();
-    shrd1->bulk_expire();
-    shrd2->bulk_expire();
-    shrd3->bulk_expire();
-    this->expire_cntr->dec();
-    this->dbg->l2("thr_ec #%x: expire finish on shrd #%d, #%d, #%d, #%d",
-            std::this_thread::get_id(), shrd0->get_idx(), shrd1->get_idx(), shrd2->get_idx(), shrd3->get_idx());
+uint64 BigCache::expire_wait() {
+    uint64 next = UINT64_MAX;
+    for (uint i = 0; i < this->shards_cnt; i++) {
+        next = std::min(next, this->shards[i]->expire_next());
+    }
+    auto now = unix_time_now_ns();
+    uint64 due = next > now ? next - now : 0;
+    return std::min(this->pacer_e->get_period(), std::max(due, MIN_EXPIRE_INTERVAL_NS));
+}
+
+void BigCache::sched_cycle(uint task, uint64 interval_ns) {
+    auto p = task == SCHED_TASK_EXPIRE ? this->pacer_e : this->pacer_v;
+    std::vector<shard_load> loads(this->shards_cnt);
+    for (uint i = 0; i < this->shards_cnt; i++) {
+        this->shards.at(i)->get_load(task, loads[i]);
+    }
+    std::vector<uint> order;
+    p->plan(loads, interval_ns, order);
+
+    std::atomic<uint64> busy{0};
+    this->workers->run(order.size(), [this, task, &order, &busy](uint64 i) {
+        auto time_s = mono_time_now_ns();
+        auto shrd = this->shards.at(order[i]);
+        if (task == SCHED_TASK_EXPIRE) {
+            this->expire_shard(shrd);
+        } else {
+            this->vacuum_shard(shrd);
+        }
+        busy += mono_time_now_ns() - time_s;
+    });
+    p->account(busy.load(), order.size());
+
+    this->dbg->l2("sched #%d: cycle finish, %d shards of %d run, busy %ld ns",
+            task, uint(order.size()), this->shards_cnt, busy.load());
 }
 
-void BigCache::expire_shard_singe(Shard *shrd) {
-    this->dbg->l2("thr_ecs #%x: expire start on shrd #%d",
+void BigCache::expire_shard(Shard *shrd) {
+    // Rest of the cycle is dropped on stop.
+    if (this->expire_thr_stop_sig) {
+        return;
+    }
+    this->dbg->l2("thr_w #%x: expire start on shrd #%d",
             std::this_thread::get_id(), shrd->get_idx());
     this->expire_cntr->inc();
     shrd->bulk_expire();
     this->expire_cntr->dec();
-    this->dbg->l2("thr_ecs #%x: expire finish on shrd #%d",
+    this->dbg->l2("thr_w #%x: expire finish on shrd #%d",
             std::this_thread::get_id(), shrd->get_idx());
 }
 
 void BigCache::vacuum_ctl() {
-    uint64 prev_took = 0;
     auto thr_v_id = std::this_thread::get_id();
+    uint64 prev_s = mono_time_now_ns();
     while (true) {
-        bool skip = false;
-        // Check and warn if previous vacuuming took more time than expire_ns.
-        if (prev_took > this->vacuum_ns) {
-            this->dbg->warn("thr_v #%x: prev vacuum took %ld ns > vacuum time %ld ns, skip vacuum cycle. advise: increase shards count",
-                            thr_v_id, prev_took, this->vacuum_ns);
-            // Wait, but skip current cycle.
-            prev_took = 0;
-            skip = true;
-        }
-        std::this_thread::sleep_for(std::chrono::nanoseconds(this->vacuum_ns - prev_took));
-        if (skip) {
-            continue;
-        }
-
-        auto time_s = unix_time_now_ns();
-
-        this->dbg->l2("thr_v #%x: vacuum cycle start", thr_v_id);
-        std::vector<std::thread> thr_c_pool{};
-        if (this->shards_cnt >= 16) {
-            // Init and start shards_cnt/4 child threads.
-            // Each thread is responsible to do vacuuming check and cleanup for chunk of 4 shard.
-            for (uint i = 0; i < this->shards_cnt; i = i + 4) {
-                thr_c_pool.emplace_back(std::thread(&BigCache::vacuum_shard, this,
-                                                    this->shards[i], this->shards[i+1], this->shards[i+2], this->shards[i+3]));
-            }
-        } else {
-            // Init and start one thread for each shard.
-            for (uint i = 0; i < this->shards_cnt; i++) {
-                thr_c_pool.emplace_back(std::thread(&BigCache::vacuum_shard_singe, this, this->shards[i]));
-            }
-        }
-        this->dbg->l2("thr_v #%x: %d child threads started", thr_v_id, thr_c_pool.size());
-        for (auto &thr_c : thr_c_pool) {
-            thr_c.join();
-        }
-
-        auto time_e = unix_time_now_ns();
-        prev_took = time_e - time_s;
-
-        this->dbg->l2("thr_v #%x: vacuum cycle finish, time took %ld ns", thr_v_id, prev_took);
-
-        if (this->vacuum_thr_stop_sig) {
+        if (!this->ctl_wait(this->pacer_v->get_period(), this->vacuum_thr_stop_sig, nullptr)) {
             this->dbg->l1("thr_v #%x: caught stop sig. exiting", thr_v_id);
             break;
         }
+        auto time_s = mono_time_now_ns();
+        this->dbg->l2("thr_v #%x: vacuum cycle start", thr_v_id);
+        this->sched_cycle(SCHED_TASK_VACUUM, time_s - prev_s);
+        prev_s = time_s;
     }
 }
 
-void BigCache::vacuum_shard(Shard *shrd0, Shard *shrd1, Shard *shrd2, Shard *shrd3) {
-    this->dbg->l2("thr_vc #%x: vacuum start on shrd #%d, #%d, #%d, #%d",
-                  std::this_thread::get_id(), shrd0->get_idx(), shrd1->get_idx(), shrd2->get_idx(), shrd3->get_idx());
-    this->vacuum_cntr->inc();
-//    shrd0->bulk_vacuum();
-//    shrd1->bulk_vacuum();
-//    shrd2->bulk_vacuum();
-//    shrd3->bulk_vacuum();
-    this->vacuum_cntr->dec();
-    this->dbg->l2("thr_ec #%x: vacuum finish on shrd #%d, #%d, #%d, #%d",
-                  std::this_thread::get_id(), shrd0->get_idx(), shrd1->get_idx(), shrd2->get_idx(), shrd3->get_idx());
-}
-
-void BigCache::vacuum_shard_singe(Shard *shrd) {
-    this->dbg->l2("thr_vcs #%x: vacuum start on shrd #%d",
+void BigCache::vacuum_shard(Shard *shrd) {
+    // Rest of the cycle is dropped on stop.
+    if (this->vacuum_thr_stop_sig) {
+        return;
+    }
+    this->dbg->l2("thr_w #%x: vacuum start on shrd #%d",
                   std::this_thread::get_id(), shrd->get_idx());
     this->vacuum_cntr->inc();
-//    shrd->bulk_vacuum();
+    shrd->bulk_vacuum();
     this->vacuum_cntr->dec();
-    this->dbg->l2("thr_vcs #%x: vacuum finish on shrd #%d",
+    this->dbg->l2("thr_w #%x: vacuum finish on shrd #%d",
                   std::this_thread::get_id(), shrd->get_idx());
 }
 
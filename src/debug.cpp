@@ -32,10 +32,10 @@ void debug::err(const char *fmt, ...) {
         return;
     }
 
-    char buf[256];
+    char buf[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
 
     std::stringstream ss;
     ss << "[er] " << unix_time_now_fmt() << " " << buf << std::endl;
@@ -47,10 +47,10 @@ void debug::warn(const char *fmt, ...) {
         return;
     }
 
-    char buf[256];
+    char buf[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
 
     this->__p(VERBOSE_LVL_WARN, buf);
 }
@@ -60,10 +60,10 @@ void debug::l1(const char *fmt, ...) {
         return;
     }
 
-    char buf[256];
+    char buf[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
 
     this->__p(VERBOSE_LVL_DBG1, buf);
 }
@@ -73,10 +73,10 @@ void debug::l2(const char *fmt, ...) {
         return;
     }
 
-    char buf[256];
+    char buf[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
 
     this->__p(VERBOSE_LVL_DBG2, buf);
 }
@@ -86,10 +86,10 @@ void debug::l3(const char *fmt, ...) {
         return;
     }
 
-    char buf[256];
+    char buf[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
 
     this->__p(VERBOSE_LVL_DBG3, buf);
 }
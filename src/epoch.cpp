@@ -0,0 +1,77 @@
+#include "epoch.h"
+
+/**
+ * Counter to spread threads over reader slots.
+ */
+static std::atomic<uint> epoch_thr_cnt{0};
+
+epoch_domain::epoch_domain() {
+    this->epoch.store(1);
+    for (auto &s : this->slots) {
+        s.epoch.store(0);
+    }
+}
+
+epoch_domain::~epoch_domain() {
+    this->drain();
+}
+
+uint epoch_domain::enter() {
+    // Every thread starts from its own slot, so in the common case it takes the same free slot every time.
+    static thread_local uint hint = epoch_thr_cnt.fetch_add(1) % EPOCH_SLOTS;
+    for (uint i = 0; i < EPOCH_SLOTS; i++) {
+        uint slot = (hint + i) % EPOCH_SLOTS;
+        uint64 free = 0;
+        if (this->slots[slot].epoch.compare_exchange_strong(free, this->epoch.load())) {
+            // Publish the slot before any read of the protected memory. Pairs with the fence in reclaim(): either
+            // the writer sees this slot, or the reader sees the memory already unlinked.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            hint = slot;
+            return slot;
+        }
+    }
+    return EPOCH_NO_SLOT;
+}
+
+void epoch_domain::exit(uint slot) {
+    this->slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+void epoch_domain::retire(std::function<void()> fn) {
+    this->retired.emplace_back(this->epoch.fetch_add(1), std::move(fn));
+}
+
+uint64 epoch_domain::reclaim() {
+    if (this->retired.empty()) {
+        return 0;
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64 min = UINT64_MAX;
+    for (auto &s : this->slots) {
+        uint64 e = s.epoch.load();
+        if (e != 0 && e < min) {
+            min = e;
+        }
+    }
+
+    // Readers that entered at or before the retire epoch may still hold the memory.
+    uint64 cnt = 0;
+    while (cnt < this->retired.size() && this->retired[cnt].first < min) {
+        this->retired[cnt].second();
+        cnt++;
+    }
+    this->retired.erase(this->retired.begin(), this->retired.begin() + cnt);
+    return cnt;
+}
+
+void epoch_domain::drain() {
+    for (auto &r : this->retired) {
+        r.second();
+    }
+    this->retired.clear();
+}
+
+uint64 epoch_domain::pending() {
+    return this->retired.size();
+}
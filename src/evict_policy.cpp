@@ -0,0 +1,86 @@
+#include <algorithm>
+#include "evict_policy.h"
+
+evict_policy::evict_policy(uint64 slots) : freq(0) {
+    while ((uint64(1) << this->bits) < slots) {
+        this->bits++;
+    }
+    this->freq = std::vector<std::atomic<byte>>(uint64(1) << this->bits);
+}
+
+void evict_policy::evicted(uint, uint64, const evict_usage&) {}
+
+evict_clock::evict_clock(uint64 slots) : evict_policy(slots) {}
+
+uint evict_clock::admit(uint64 hash, const evict_usage&) {
+    this->freq[this->slot(hash)].store(0, std::memory_order_relaxed);
+    return 0;
+}
+
+uint evict_clock::victim_queue(const evict_usage&) {
+    return 0;
+}
+
+uint evict_clock::decide(uint q, uint64 hash) {
+    auto &c = this->freq[this->slot(hash)];
+    if (c.load(std::memory_order_relaxed) > 0) {
+        c.store(0, std::memory_order_relaxed);
+        return q;
+    }
+    return EVICT_VICTIM;
+}
+
+evict_s3fifo::evict_s3fifo(uint64 slots) : evict_policy(slots) {
+    this->ghost.assign(this->freq.size(), 0);
+}
+
+uint evict_s3fifo::admit(uint64 hash, const evict_usage&) {
+    uint64 s = this->slot(hash);
+    this->freq[s].store(0, std::memory_order_relaxed);
+    // Key evicted from the small queue recently returns straight to the main one.
+    if (this->ghost[s] == fingerprint(hash)) {
+        this->ghost[s] = 0;
+        return 1;
+    }
+    return 0;
+}
+
+uint evict_s3fifo::victim_queue(const evict_usage &u) {
+    if (u.cnt[0] > 0 && (u.cnt[1] == 0 || u.bytes[0] >= u.max / 100 * S3FIFO_SMALL_PRCNT)) {
+        return 0;
+    }
+    return 1;
+}
+
+uint evict_s3fifo::decide(uint q, uint64 hash) {
+    auto &c = this->freq[this->slot(hash)];
+    byte v = c.load(std::memory_order_relaxed);
+    if (v == 0) {
+        return EVICT_VICTIM;
+    }
+    if (q == 0) {
+        // Read in the small queue, the main queue keeps it while it's read there.
+        c.store(0, std::memory_order_relaxed);
+        return 1;
+    }
+    c.store(byte(v - 1), std::memory_order_relaxed);
+    return 1;
+}
+
+void evict_s3fifo::evicted(uint q, uint64 hash, const evict_usage&) {
+    if (q == 0) {
+        this->ghost[this->slot(hash)] = fingerprint(hash);
+    }
+}
+
+evict_policy *evict_policy_new(uint policy, uint64 max_size) {
+    uint64 slots = std::max(max_size / EVICT_SLOT_BYTES, EVICT_MIN_SLOTS);
+    switch (policy) {
+        case EVICT_POLICY_CLOCK:
+            return new evict_clock(slots);
+        case EVICT_POLICY_S3FIFO:
+            return new evict_s3fifo(slots);
+        default:
+            return nullptr;
+    }
+}
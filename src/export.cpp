@@ -12,18 +12,60 @@ void cbc_free(CBigCache *ptr) {
     delete cbc;
 }
 
-error cbc_set(CBigCache *cbc_ptr, char *key, byte *data) {
+error cbc_set(CBigCache *cbc_ptr, char *key, uint klen, byte *data, uint64 len) {
     auto *cbc = (BigCache*) cbc_ptr;
-    auto err = cbc->set(key, data);
+    auto err = cbc->set(reinterpret_cast<const byte*>(key), klen, data, len, 0);
     return err;
 }
 
-error cbc_get(CBigCache *cbc_ptr, char *key, byte *buf, uint len) {
+error cbc_set_ttl(CBigCache *cbc_ptr, char *key, uint klen, byte *data, uint64 len, uint64 ttl_ns) {
     auto *cbc = (BigCache*) cbc_ptr;
-    return cbc->get(key, buf, len);
+    return cbc->set(reinterpret_cast<const byte*>(key), klen, data, len, ttl_ns);
 }
 
-error cbc_evict(CBigCache *cbc_ptr, char *key) {
+error cbc_get(CBigCache *cbc_ptr, char *key, uint klen, byte *buf, uint64 len, uint64 *len_f) {
     auto *cbc = (BigCache*) cbc_ptr;
-    return cbc->evict(key);
-}
\ No newline at end of file
+    return cbc->get(reinterpret_cast<const byte*>(key), klen, buf, len, *len_f);
+}
+
+error cbc_len(CBigCache *cbc_ptr, char *key, uint klen, uint64 *len_f) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->len(reinterpret_cast<const byte*>(key), klen, *len_f);
+}
+
+error cbc_get_ref(CBigCache *cbc_ptr, char *key, uint klen, struct shard_lease *lease) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->lease(reinterpret_cast<const byte*>(key), klen, *lease);
+}
+
+error cbc_release(CBigCache *cbc_ptr, struct shard_lease *lease) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->release(*lease);
+}
+
+error cbc_evict(CBigCache *cbc_ptr, char *key, uint klen) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->evict(reinterpret_cast<const byte*>(key), klen);
+}
+
+error cbc_stats(CBigCache *cbc_ptr, struct shard_stats *st) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    cbc->stats(*st);
+    return ERR_OK;
+}
+
+error cbc_shard_stats(CBigCache *cbc_ptr, uint shard_idx, struct shard_stats *st) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->stats(shard_idx, *st);
+}
+
+error cbc_expire(CBigCache *cbc_ptr) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    cbc->expire_now();
+    return ERR_OK;
+}
+
+error cbc_sched_stats(CBigCache *cbc_ptr, uint task, struct sched_stats *st) {
+    auto *cbc = (BigCache*) cbc_ptr;
+    return cbc->sched(task, *st);
+}
@@ -2,9 +2,14 @@
 #include "hash.h"
 
 uint64 fnv64a(const std::string &s) {
+    return fnv64a(reinterpret_cast<const byte*>(s.data()), s.size());
+}
+
+uint64 fnv64a(const byte *s, uint64 len) {
     uint64 ret = HASH_FNV64A_OFFSET
-    for (auto c : s) {
-        ret ^= uint64(c);
+    for (uint64 i = 0; i < len; i++) {
+        // Bytes are sign-extended like chars of the string, so both keys forms give the same hash.
+        ret ^= uint64(char(s[i]));
         ret *= HASH_FNV64A_PRIME
     }
     return ret;
@@ -1,4 +1,5 @@
 #include <chrono>
+#include <cstring>
 #include <exception>
 #include <string>
 #include <sys/sysinfo.h>
@@ -7,6 +8,9 @@
 #include <algorithm>
 #include <iomanip>
 #include "types.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 uint64 byte_len(const byte *data) {
     uint64 i;
@@ -14,6 +18,45 @@ uint64 byte_len(const byte *data) {
     return i;
 }
 
+void mem_copy_nt(byte *dst, const byte *src, uint64 len) {
+#ifdef __SSE2__
+    // Align destination to 16 bytes with regular copy of the head.
+    uint64 head = (16 - (uintptr_t(dst) & 15)) & 15;
+    if (head > len) {
+        head = len;
+    }
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    len -= head;
+
+    // Stream the body by 64 bytes per iteration.
+    auto d = reinterpret_cast<__m128i*>(dst);
+    auto s = reinterpret_cast<const __m128i*>(src);
+    for (; len >= 64; len -= 64, d += 4, s += 4) {
+        __m128i r0 = _mm_loadu_si128(s);
+        __m128i r1 = _mm_loadu_si128(s + 1);
+        __m128i r2 = _mm_loadu_si128(s + 2);
+        __m128i r3 = _mm_loadu_si128(s + 3);
+        _mm_stream_si128(d, r0);
+        _mm_stream_si128(d + 1, r1);
+        _mm_stream_si128(d + 2, r2);
+        _mm_stream_si128(d + 3, r3);
+    }
+
+    // Copy the tail.
+    memcpy(d, s, len);
+#else
+    memcpy(dst, src, len);
+#endif
+}
+
+void mem_fence_nt() {
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
 bool is_pow2(uint n) {
     return (n & (n - 1)) == 0;
 }
@@ -62,6 +105,11 @@ uint64 unix_time_now_ns() {
     return now.count();
 }
 
+uint64 mono_time_now_ns() {
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+    return now.count();
+}
+
 std::string unix_time_now_fmt() {
     const auto now = std::chrono::system_clock::now();
     const auto now_t = std::chrono::system_clock::to_time_t(now);
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include "const.h"
+#include "pacer.h"
+
+pacer::pacer(uint cpu_prcnt, uint64 period_ns, uint64 min_period_ns) {
+    this->cpu_prcnt = std::max(std::min(cpu_prcnt, 100u), 1u);
+    this->period_base = period_ns;
+    this->period_min = std::min(min_period_ns, period_ns);
+    this->period = period_ns;
+    this->st.period_ns = period_ns;
+}
+
+void pacer::plan(const std::vector<shard_load> &loads, uint64 interval_ns, std::vector<uint> &order) {
+    std::lock_guard<std::mutex> lock(this->mux);
+    uint n = uint(loads.size());
+    if (this->prev.size() != n) {
+        this->prev = loads;
+        this->deferred.assign(n, 0);
+    }
+    this->interval = interval_ns;
+
+    // Shards with work, the ones deferred too long go first, then the cold ones, both by reclaimable bytes.
+    struct cand {
+        uint idx;
+        bool starving;
+        bool hot;
+        uint64 reclaimable;
+    };
+    std::vector<cand> cands;
+    uint64 sum_reclaimable = 0, sum_size = 0;
+    for (uint i = 0; i < n; i++) {
+        uint64 ops = loads[i].ops - this->prev[i].ops;
+        uint64 contended = loads[i].contended - this->prev[i].contended;
+        this->st.ops += ops;
+        this->st.contended += contended;
+        sum_size += loads[i].size;
+        if (loads[i].reclaimable == 0) {
+            this->deferred[i] = 0;
+            continue;
+        }
+        sum_reclaimable += loads[i].reclaimable;
+        bool hot = ops > 0 && contended * PACER_HOT_RATIO > ops;
+        cands.push_back(cand{i, this->deferred[i] >= PACER_MAX_DEFER, hot, loads[i].reclaimable});
+    }
+    this->prev = loads;
+    std::sort(cands.begin(), cands.end(), [](const cand &a, const cand &b) {
+        if (a.starving != b.starving) {
+            return a.starving;
+        }
+        if (a.hot != b.hot) {
+            return !a.hot;
+        }
+        if (a.reclaimable != b.reclaimable) {
+            return a.reclaimable > b.reclaimable;
+        }
+        return a.idx < b.idx;
+    });
+
+    // Count of tasks that fit the CPU budget. Unknown cost doesn't limit the first cycle, and at least one task runs
+    // every cycle, so the work never stalls.
+    uint64 quota = cands.size();
+    if (this->cost_ns > 0) {
+        uint64 budget = interval_ns / 100 * this->cpu_prcnt;
+        quota = std::max(std::min(budget / this->cost_ns, quota), uint64(1));
+    }
+
+    order.clear();
+    uint64 hot = 0, throttled = 0;
+    for (auto &c : cands) {
+        if (c.hot && !c.starving) {
+            this->deferred[c.idx]++;
+            hot++;
+        } else if (order.size() < quota) {
+            order.push_back(c.idx);
+            this->deferred[c.idx] = 0;
+        } else {
+            this->deferred[c.idx]++;
+            throttled++;
+        }
+    }
+
+    // Speed up while the budget allows and much memory may be reclaimed, slow down back otherwise.
+    if (throttled == 0 && sum_size > 0 && sum_reclaimable * PACER_ACCEL_RATIO > sum_size) {
+        this->period = std::max(this->period / 2, this->period_min);
+        if (this->period < this->st.period_ns) {
+            this->st.accelerations++;
+        }
+    } else {
+        this->period = std::min(this->period * 2, this->period_base);
+    }
+
+    this->st.cycles++;
+    this->st.shards_planned += order.size();
+    this->st.shards_throttled += throttled;
+    this->st.shards_hot += hot;
+    this->st.quota = quota;
+    this->st.period_ns = this->period;
+    this->st.reclaimable = sum_reclaimable;
+}
+
+void pacer::account(uint64 busy_ns, uint64 cnt) {
+    std::lock_guard<std::mutex> lock(this->mux);
+    if (cnt > 0) {
+        uint64 cost = std::max(busy_ns / cnt, uint64(1));
+        // Exponential moving average, new sample weights 1/4.
+        this->cost_ns = this->cost_ns == 0 ? cost : (this->cost_ns * 3 + cost) / 4;
+    }
+    this->st.busy_ns += busy_ns;
+    this->st.cost_ns = this->cost_ns;
+    this->st.cpu_usage = this->interval > 0 ? float64(busy_ns) / float64(this->interval) : 0;
+}
+
+uint64 pacer::get_period() {
+    std::lock_guard<std::mutex> lock(this->mux);
+    return this->period;
+}
+
+void pacer::get_stats(sched_stats &st) {
+    std::lock_guard<std::mutex> lock(this->mux);
+    st = this->st;
+}
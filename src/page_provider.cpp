@@ -0,0 +1,135 @@
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "const.h"
+#include "page_provider.h"
+
+page_provider::page_provider(uint mode, bool populate, debug *dbg_p) {
+    this->dbg = dbg_p;
+    this->mode = mode;
+    this->mode_map = mode;
+    this->populate = populate;
+}
+
+uint page_provider::get_mode() {
+    return this->mode;
+}
+
+uint64 page_provider::map_len(uint64 size) {
+    if (this->mode_map == PAGE_ALLOC_THP || this->mode_map == PAGE_ALLOC_HUGETLB) {
+        return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+    return size;
+}
+
+byte *page_provider::alloc(uint64 size) {
+    byte *p = nullptr;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (this->populate) {
+        flags |= MAP_POPULATE;
+    }
+
+    switch (this->mode) {
+        case PAGE_ALLOC_HEAP:
+            p = new byte[size];
+            if (this->populate) {
+                memset(p, 0, size);
+            }
+            return p;
+        case PAGE_ALLOC_MMAP: {
+            void *m = mmap(nullptr, this->map_len(size), PROT_READ | PROT_WRITE, flags, -1, 0);
+            p = m == MAP_FAILED ? nullptr : reinterpret_cast<byte*>(m);
+            break;
+        }
+        case PAGE_ALLOC_HUGETLB: {
+            void *m = mmap(nullptr, this->map_len(size), PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+            if (m != MAP_FAILED) {
+                p = reinterpret_cast<byte*>(m);
+                break;
+            }
+            this->dbg->warn("explicit huge pages aren't available, fallback to transparent huge pages");
+            this->mode = PAGE_ALLOC_THP;
+            p = this->map_thp(this->map_len(size));
+            break;
+        }
+        case PAGE_ALLOC_THP:
+        default:
+            p = this->map_thp(this->map_len(size));
+    }
+
+    if (p == nullptr) {
+        std::stringstream ss;
+        ss << "couldn't map " << size << " b for the page: " << strerror(errno);
+        throw std::runtime_error(ss.str());
+    }
+    return p;
+}
+
+byte *page_provider::map_thp(uint64 len) {
+    // Map with a spare huge page to align the start, huge pages can't back unaligned ranges.
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *m = mmap(nullptr, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (m == MAP_FAILED) {
+        return nullptr;
+    }
+    auto raw = reinterpret_cast<uintptr_t>(m);
+    uintptr_t aligned = (raw + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+    if (aligned > raw) {
+        munmap(m, aligned - raw);
+    }
+    munmap(reinterpret_cast<void*>(aligned + len), raw + HUGE_PAGE_SIZE - aligned);
+
+    auto p = reinterpret_cast<byte*>(aligned);
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, len, MADV_HUGEPAGE) != 0) {
+        this->dbg->warn("transparent huge pages aren't available: %s", strerror(errno));
+    }
+#endif
+    if (this->populate) {
+        // MAP_POPULATE on the original mapping would fault regular pages before the advice.
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(p, len, MADV_POPULATE_WRITE) != 0) {
+            memset(p, 0, len);
+        }
+#else
+        memset(p, 0, len);
+#endif
+    }
+    return p;
+}
+
+uint64 page_provider::resident(byte *p, uint64 size) {
+    if (p == nullptr) {
+        return 0;
+    }
+    // Heap memory may start in the middle of the system page.
+    const uint64 sz_sys = uint64(sysconf(_SC_PAGESIZE));
+    auto lo = reinterpret_cast<uintptr_t>(p) & ~uintptr_t(sz_sys - 1);
+    auto hi = reinterpret_cast<uintptr_t>(p) + size;
+    uint64 cnt = (hi - lo + sz_sys - 1) / sz_sys;
+    std::vector<unsigned char> vec(cnt);
+    if (mincore(reinterpret_cast<void*>(lo), hi - lo, vec.data()) != 0) {
+        return size;
+    }
+    uint64 res = 0;
+    for (auto v : vec) {
+        res += v & 1;
+    }
+    return std::min(res * sz_sys, size);
+}
+
+void page_provider::free(byte *p, uint64 size) {
+    if (p == nullptr) {
+        return;
+    }
+    if (this->mode_map == PAGE_ALLOC_HEAP) {
+        delete[] p;
+        return;
+    }
+    munmap(p, this->map_len(size));
+}
@@ -2,14 +2,17 @@
 #include <stdio.h>
 #include <sstream>
 #include <iostream>
-#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <thread>
 #include "const.h"
 #include "debug.h"
 #include "helpers.h"
 #include "shard.h"
 #include "types.h"
 
-Shard::Shard(uint idx, uint64 max_size, uint64 expire_dur_ns, debug *dbg_p) {
+Shard::Shard(uint idx, const shard_config &cfg, debug *dbg_p) {
     this->mux.lock();
 
     if (dbg_p == nullptr) {
@@ -18,172 +21,367 @@ Shard::Shard(uint idx, uint64 max_size, uint64 expire_dur_ns, debug *dbg_p) {
     this->dbg = dbg_p;
 
     this->idx = idx;
-    this->sz_max = max_size;
-    this->sz_max = max_size;
+    this->sz_max = cfg.max_size;
     this->sz_page = uint64(this->sz_max * float(float(DEF_SHARD_PAGE_SIZE_PRCNT) / 100));
     this->sz_used = 0;
     this->sz_alloc = 0;
     this->sz_free = this->sz_max;
-
-    this->idx_used = std::map<uint64, shard_entry_root*>{};
-    this->idx_free = std::list<shard_entry_free*>{1, new shard_entry_free{0, this->sz_max}};
-    this->idx_expire = std::map<uint64, std::map<uint64, bool>>{{}};
+    this->storage = cfg.storage;
+    this->sz_head = Shard::head_size(cfg);
+    this->vacuum_budget_ns = cfg.vacuum_budget_us * 1000;
+    this->expire_budget_ns = cfg.expire_budget_us * 1000;
+    this->expire_batch = cfg.expire_batch > 0 ? cfg.expire_batch : 1;
+    this->provider = new page_provider(cfg.page_alloc, cfg.page_populate, this->dbg);
+    this->page_keep = cfg.page_release_keep;
+    this->read_mode = cfg.read_mode;
+    this->idx_used.set_reclaim(&this->epoch);
+
+    for (auto &head : this->free_cls) {
+        head = nullptr;
+    }
+    if (this->storage == STORAGE_PAGES) {
+        this->free_put(0, this->sz_max);
+    }
+    for (uint l = 0; l < WHEEL_LEVELS; l++) {
+        for (auto &head : this->wheel_heads[l]) {
+            head = ENTRY_ADDR_NIL;
+        }
+        this->wheel_bits[l] = 0;
+    }
+    for (auto &b : this->wheel_bytes) {
+        b = 0;
+    }
+    for (uint q = 0; q < EVICT_QUEUES; q++) {
+        this->evict_heads[q] = ENTRY_ADDR_NIL;
+        this->evict_tails[q] = ENTRY_ADDR_NIL;
+    }
+    this->evict_use.max = this->sz_max;
+    if (this->storage == STORAGE_PAGES) {
+        this->policy = evict_policy_new(cfg.evict_policy, this->sz_max);
+    }
+    if (cfg.admission && this->policy != nullptr) {
+        this->admit = new admit_filter(std::max(this->sz_max / EVICT_SLOT_BYTES, EVICT_MIN_SLOTS));
+    }
+    this->wheel_tick = unix_time_now_ns() / EXPIRE_RESOLUTION_NS;
+    this->wheel_far_turn = this->wheel_tick >> (WHEEL_SLOT_BITS * WHEEL_LEVELS);
 
     uint shard_page_cnt = 100 / DEF_SHARD_PAGE_SIZE_PRCNT + 1;
     for (uint i = 0; i < shard_page_cnt; i++) {
-        auto page_n = new shard_page{nullptr, 0, 0};
+        auto page_n = new shard_page{nullptr, i * this->sz_page, (i + 1) * this->sz_page};
         this->data[i] = page_n;
     }
     this->dbg->l2("shrd #%d: %d pages prepared", this->idx, shard_page_cnt);
-    this->page_reserve();
+    this->page_reserve(0);
 
-    this->expire_ns = expire_dur_ns;
+    this->expire_ns = cfg.expire_ns;
 
     this->mux.unlock();
 }
 
 Shard::~Shard() {
+    // Retired pages belong to the provider, release them first.
+    this->epoch.drain();
     for (auto d : this->data) {
+        this->provider->free(d.second->payload, this->sz_page);
         delete d.second;
     }
+    delete this->provider;
+    delete this->policy;
+    delete this->admit;
     this->data.clear();
     this->idx_used.clear();
+    // Free blocks are released in bulk with the pool.
     this->idx_free.clear();
-    this->idx_expire.clear();
+}
+
+void Shard::write_lock() {
+    if (!this->mux.try_lock()) {
+        this->cnt_contended.fetch_add(1, std::memory_order_relaxed);
+        this->mux.lock();
+    }
+    this->seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Shard::read_lock() {
+    // Counter is touched only on contention, so uncontended readers don't share any cache line for writing.
+    if (!this->mux.try_lock_shared()) {
+        this->cnt_contended.fetch_add(1, std::memory_order_relaxed);
+        this->mux.lock_shared();
+    }
+}
+
+void Shard::write_unlock() {
+    this->seq.fetch_add(1, std::memory_order_release);
+    this->epoch.reclaim();
+    this->mux.unlock();
 }
 
 uint Shard::get_idx() {
     return this->idx;
 }
 
-void Shard::page_reserve() {
-    shard_page *page = this->data[this->page_init_cnt];
-    page->payload = new byte[this->sz_page];
-    page->addr_lo = this->addr_hi;
-    page->addr_hi = this->addr_hi + this->sz_page;
+void Shard::get_stats(shard_stats &st) {
+    this->mux.lock_shared();
+    st.sz_max = this->sz_max;
+    st.sz_used = this->sz_used;
+    st.sz_alloc = this->sz_alloc;
+    st.entries = this->idx_used.size();
+    st.free_blocks = this->idx_free.size();
+    st.free_largest = 0;
+    st.chain_blocks = this->cnt_blocks;
+    st.vacuum_moved = this->cnt_vacuum_moved;
+    st.expired = this->cnt_expired;
+    st.expired_lazy = this->cnt_expired_lazy;
+    for (uint i = 0; i < STATS_HOLD_BUCKETS; i++) {
+        st.expire_hold_hist[i] = this->expire_hold_hist[i];
+    }
+    st.expire_hold_max = this->expire_hold_max;
+    st.evicted = this->cnt_evicted;
+    st.rejected = this->cnt_rejected;
+    st.writes = this->cnt_writes;
+    st.contended = this->cnt_contended.load(std::memory_order_relaxed);
+    st.pages_released = this->cnt_pages_released;
+    this->mux_pins.lock();
+    st.leases = this->pins.size();
+    this->mux_pins.unlock();
+    st.sz_resident = 0;
+    for (auto &p : this->data) {
+        st.sz_resident += this->provider->resident(p.second->payload, this->sz_page);
+    }
+    if (this->storage == STORAGE_RING) {
+        // Records are contiguous, so the whole free space of the ring is available.
+        st.free_largest = this->sz_max - this->sz_used;
+        st.chain_blocks = st.entries;
+    } else {
+        auto largest = this->free_largest();
+        if (largest != nullptr) {
+            st.free_largest = largest->len;
+        }
+    }
+    this->mux.unlock_shared();
 
+    stats_calc(st);
+}
+
+void Shard::page_reserve(uint idx_page) {
+    shard_page *page = this->data[idx_page];
+    __atomic_store_n(&page->payload, this->provider->alloc(this->sz_page), __ATOMIC_RELEASE);
     this->sz_alloc += this->sz_page;
-    this->addr_hi += this->sz_page;
 
     this->dbg->l1("shrd #%d: page #%d (lo: %ld, hi: %ld) reserved",
-            this->idx, this->page_init_cnt, page->addr_lo, page->addr_hi);
+            this->idx, idx_page, page->addr_lo, page->addr_hi);
+}
+
+uint64 Shard::page_release() {
+    // Pages are released only from the pages storage, the ring reuses its whole memory cyclically.
+    if (this->storage != STORAGE_PAGES) {
+        return 0;
+    }
 
-    this->page_init_cnt++;
+    // Collect reserved pages fully covered by free blocks.
+    std::vector<uint> cands;
+    for (auto &it : this->idx_free) {
+        uint64 lo = (it.first + this->sz_page - 1) / this->sz_page;
+        uint64 hi = (it.first + it.second->len) / this->sz_page;
+        for (uint64 i = lo; i < hi && i < this->data.size(); i++) {
+            if (this->data[uint(i)]->payload != nullptr) {
+                cands.push_back(uint(i));
+            }
+        }
+    }
+
+    // Keep page_keep empty pages to absorb new writes without reserve/release thrashing. The lowest ones are kept,
+    // since allocator and vacuum fill the shard from the beginning.
+    uint64 cnt = 0;
+    while (cands.size() > this->page_keep) {
+        uint i = cands.back();
+        cands.pop_back();
+        auto page = this->data[i];
+        // Optimistic readers may still copy from the page, so it returns to the system after they leave.
+        auto provider = this->provider;
+        auto payload = page->payload;
+        uint64 sz_page = this->sz_page;
+        this->epoch.retire([provider, payload, sz_page]() {
+            provider->free(payload, sz_page);
+        });
+        __atomic_store_n(&page->payload, static_cast<byte*>(nullptr), __ATOMIC_RELEASE);
+        this->sz_alloc -= this->sz_page;
+        this->cnt_pages_released++;
+        cnt++;
+        this->dbg->l1("shrd #%d: page #%d (lo: %ld, hi: %ld) released", this->idx, i, page->addr_lo, page->addr_hi);
+    }
+    return cnt;
+}
+
+uint64 Shard::head_size(const shard_config &cfg) {
+    if (cfg.storage == STORAGE_RING) {
+        return sizeof(shard_ring_hdr);
+    }
+    // Queue links are needed only if the policy links entries to its queues.
+    bool evicts = cfg.evict_policy == EVICT_POLICY_CLOCK || cfg.evict_policy == EVICT_POLICY_S3FIFO;
+    return evicts ? sizeof(shard_entry_hdr) : ENTRY_HDR_HEAD_SIZE;
+}
+
+void Shard::get_load(uint task, shard_load &ld) {
+    bool due = task == SCHED_TASK_EXPIRE && this->expire_next() <= unix_time_now_ns();
+    bool releasable = this->page_releasable();
+    this->mux.lock_shared();
+    ld.ops = this->cnt_writes;
+    ld.contended = this->cnt_contended.load(std::memory_order_relaxed);
+    ld.reclaimable = 0;
+    if (task == SCHED_TASK_EXPIRE) {
+        // Due entries and pages over the kept ones are what the expiration reclaims.
+        ld.size = this->sz_used;
+        if (due) {
+            try {
+                uint64 now = unix_time_now_ns();
+                ld.reclaimable = this->storage == STORAGE_RING ? this->ring_due(now) : this->wheel_due(now);
+            } catch (std::exception &e) {
+                this->dbg->excp(e.what());
+            }
+        }
+        if (releasable) {
+            ld.reclaimable += this->sz_alloc - std::min(this->sz_used + this->page_keep * this->sz_page, this->sz_alloc);
+        }
+        // The shard that has work is never skipped, even if its due entries are already gone.
+        if (due || releasable) {
+            ld.reclaimable = std::max(ld.reclaimable, uint64(1));
+        }
+    } else {
+        // Vacuum gathers free space scattered over the pages and returns emptied pages.
+        ld.size = this->sz_alloc;
+        bool frag = this->idx_free.size() > 1 || this->cnt_blocks != this->idx_used.size();
+        if (this->storage == STORAGE_PAGES && (frag || releasable)) {
+            ld.reclaimable = std::max(this->sz_alloc - std::min(this->sz_used, this->sz_alloc), uint64(1));
+        }
+    }
+    this->mux.unlock_shared();
+}
+
+bool Shard::page_releasable() {
+    if (this->storage != STORAGE_PAGES) {
+        return false;
+    }
+    this->mux.lock_shared();
+    bool r = this->sz_alloc - std::min(this->sz_used, this->sz_alloc) >= (this->page_keep + 1) * this->sz_page;
+    this->mux.unlock_shared();
+    return r;
+}
+
+error Shard::fset(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 ttl_ns) {
+    this->write_lock();
+    this->cnt_writes++;
+    auto err = this->__set(hash, key, klen, bytes, len, ttl_ns, true);
+    this->write_unlock();
+    return err;
+}
+
+error Shard::fset(uint64 key, const byte *bytes, uint64 len) {
+    return this->fset(key, nullptr, 0, bytes, len);
 }
 
 error Shard::fset(uint64 key, const byte *bytes) {
-    this->mux.lock();
-    auto err = this->__set(key, bytes, true);
-    this->mux.unlock();
+    return this->fset(key, bytes, byte_len(bytes));
+}
+
+error Shard::set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 ttl_ns) {
+    this->write_lock();
+    this->cnt_writes++;
+    auto err = this->__set(hash, key, klen, bytes, len, ttl_ns, false);
+    this->write_unlock();
     return err;
 }
 
+error Shard::set(uint64 key, const byte *bytes, uint64 len) {
+    return this->set(key, nullptr, 0, bytes, len);
+}
+
 error Shard::set(uint64 key, const byte *bytes) {
-    this->mux.lock();
-    auto err = this->__set(key, bytes, false);
-    this->mux.unlock();
-    return err;
+    return this->set(key, bytes, byte_len(bytes));
 }
 
-error Shard::__set(uint64 key, const byte *bytes, bool force) {
+error Shard::__set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 sz_b, uint64 ttl_ns,
+                   bool force) {
     error err = ERR_OK;
 
     try {
-        uint64 sz_b = byte_len(bytes);
-
         if (sz_b == 0) {
-            this->dbg->warn("shrd #%d: key %ld no data", this->idx, key);
+            this->dbg->warn("shrd #%d: key %ld no data", this->idx, hash);
             return ERR_BUF_LEN_LOW;
         }
+        if (klen > MAX_KEY_LEN) {
+            this->dbg->warn("shrd #%d: key %ld is %d b long, max %d b allowed", this->idx, hash, klen, MAX_KEY_LEN);
+            return ERR_KEY_TOO_LONG;
+        }
+
+        // Zero lifetime means the shard's default, too long one saturates to the entry that never expires.
+        if (ttl_ns == 0) {
+            ttl_ns = this->expire_ns;
+        }
+        uint64 now = unix_time_now_ns();
+        uint64 expire = ttl_ns > UINT64_MAX - now ? UINT64_MAX : now + ttl_ns;
+
+        if (this->storage == STORAGE_RING) {
+            return this->ring_set(hash, key, klen, bytes, sz_b, expire, force);
+        }
 
-        if (this->idx_used.count(key) > 0) {
-            if (!force) {
-                this->dbg->err("shrd #%d: key %ld already exists in shard #%d", this->idx, key);
+        // Overwrite of the live key keeps its place in the shard, so it bypasses admission. Otherwise the old value
+        // would be gone while the new one is rejected.
+        uint64 addr;
+        bool resident = false;
+        if (this->entry_find(hash, key, klen, addr)) {
+            // Expired entry doesn't prevent the write.
+            bool expired = this->entry_hdr(addr).expire < now;
+            resident = !expired;
+            if (!force && !expired) {
+                this->dbg->err("shrd #%d: key %ld already exists in shard #%d", this->idx, hash);
                 return ERR_KEY_EXISTS;
             }
-
-            if (this->__evict(key, true) == ERR_INTERNAL) {
-                return ERR_INTERNAL;
+            this->entry_evict(hash, addr, false);
+            if (expired) {
+                this->cnt_expired++;
+                this->cnt_expired_lazy++;
             }
         }
 
-        if (this->sz_alloc - this->sz_used < sz_b) {
-            this->dbg->l1("shrd #%d: hasn't enough free allocated space %ld b of %ld b to save %ld b. try to reserve new page",
-                     this->idx, this->sz_alloc - this->sz_used, this->sz_alloc, sz_b);
-            if (this->sz_used + sz_b > this->sz_max) {
-                this->dbg->warn("shrd #%d: can't reserve new page, shard max size limit %ld b will exceeded",
-                        this->idx, this->sz_max);
-                return ERR_NO_SPACE;
-            }
-            this->page_reserve();
-        }
-
-        uint64 expire = unix_time_now_ns() + this->expire_ns;
-
-        // Make the root for used entries queue.
-        auto root = new shard_entry_root;
-        root->expire = expire;
-        root->total_len = 0;
-        root->root = new shard_entry_used;
-        auto cur = root->root;
-        this->idx_used[key] = root;
-        this->reg_expire(expire, key);
-
-        uint64 remained = sz_b;
-        while (remained > 0) {
-            auto free = this->idx_free.front();
-            if (free == nullptr) {
-                std::stringstream ss;
-                ss << "shrd #" << this->idx << ": couldn't find free block in shard #";
-                throw std::runtime_error(ss.str());
+        // Full shard evicts entries chosen by the policy, if any. Chained entry takes more than one header, so
+        // the write may still fail and need more space.
+        uint64 sz_e = this->sz_head + klen + sz_b;
+        if (sz_e > this->sz_max) {
+            this->dbg->warn("shrd #%d: can't save %ld b, it exceeds shard max size %ld b", this->idx, sz_b, this->sz_max);
+            return ERR_NO_SPACE;
+        }
+        // The write is a request of the key too, so the filter knows keys that miss repeatedly.
+        if (this->admit != nullptr) {
+            this->admit->record(hash);
+            this->admit->age();
+        }
+        while (this->sz_used + sz_e > this->sz_max) {
+            err = this->evict_one(hash, resident);
+            if (err == ERR_NO_SPACE) {
+                this->dbg->warn("shrd #%d: can't save %ld b, shard max size limit %ld b will exceeded",
+                        this->idx, sz_b, this->sz_max);
             }
-            this->dbg->l2("shrd #%d: found free block with len %ld at offset %ld", this->idx, free->len, free->offset);
-            // Check how many bytes we can push into free block.
-            // case 1: remained > block len - only a part.
-            // case 2: remained <= block len - all bytes.
-            uint64 len = remained > free->len ? free->len : remained;
-
-            // Prepare current block.
-            cur->offset = free->offset;
-            cur->len = len;
-            cur->next = nullptr;
-            root->total_len += len;
-
-            // Push bytes.
-            for (ulong i = free->offset; i < free->offset + len; i++) {
-                this->set_byte(i, bytes[i - cur->offset]);
-                remained--;
+            if (err != ERR_OK) {
+                return err;
             }
-            this->dbg->l3("shrd #%d: %ld bytes of %ld has been saved", this->idx, cur->len, sz_b);
-
-            // Bad case: we fill the whole free block but still have bytes to push.
-            if (remained > 0) {
-                this->dbg->l3("shrd #%d: %ld bytes remained to save. increase used queue with new block",
-                         this->idx, remained);
-                auto cur_n = new shard_entry_used;
-                cur->next = cur_n;
-                cur = cur_n;
+        }
+        while (!this->entry_write(hash, key, klen, expire, bytes, sz_b, nullptr, addr)) {
+            err = this->evict_one(hash, resident);
+            if (err == ERR_NO_SPACE) {
+                this->dbg->warn("shrd #%d: can't save %ld b, free space is too fragmented", this->idx, sz_b);
             }
-
-            // Remove old free block
-            this->idx_free.pop_front();
-
-            // Free block was largest that bytes to push. We have some rest of space.
-            if (free->len > len) {
-                this->dbg->l3("shrd #%d: space left (%ld b) in free block. register it as a smaller free block and write at the end of free index",
-                         this->idx, free->len - len);
-                // Make new free block from the rest.
-                auto free_n = new shard_entry_free;
-                free_n->offset = free->offset + len;
-                free_n->len = free->len - len;
-                // Push it at the end of free index.
-                this->idx_free.push_back(free_n);
+            if (err != ERR_OK) {
+                return err;
             }
         }
-
-        // Update used/free metrics.
-        this->sz_free -= sz_b;
-        this->sz_used += sz_b;
+        this->idx_used.insert(hash, addr);
+        this->wheel_insert(addr, expire);
+        if (this->policy != nullptr) {
+            uint q = this->policy->admit(hash, this->evict_use);
+            this->evict_link(addr, q, this->evict_tails[q]);
+        }
 
         this->dbg->l2("shrd #%d: now used %ld b, has free %ld b", this->idx, this->sz_used, this->sz_free);
 
@@ -195,54 +393,230 @@ error Shard::__set(uint64 key, const byte *bytes, bool force) {
     return err;
 }
 
+error Shard::get(uint64 hash, const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f) {
+    error err;
+    if (this->read_mode != READ_MODE_OPTIMISTIC ||
+        !this->read_optimistic(hash, key, klen, buf, len, len_f, err, false)) {
+        this->read_lock();
+        err = this->__get(hash, key, klen, buf, len, len_f);
+        this->mux.unlock_shared();
+    }
+    if (err == ERR_OK && this->policy != nullptr) {
+        this->policy->touch(hash);
+        if (this->admit != nullptr) {
+            this->admit->record(hash);
+        }
+    }
+    if (err == ERR_KEY_EXPIRED) {
+        this->expire_lazy(hash, key, klen);
+    }
+    return err;
+}
+
+error Shard::get(uint64 key, byte* (&buf), uint64 len, uint64 &len_f) {
+    return this->get(key, nullptr, 0, buf, len, len_f);
+}
+
 error Shard::get(uint64 key, byte* (&buf), uint len) {
-    this->mux.lock();
-    auto err = this->__get(key, buf, len);
-    this->mux.unlock();
+    if (len == 0) {
+        return ERR_BUF_LEN_LOW;
+    }
+    // Keep the last byte for the terminating zero.
+    uint64 len_f = 0;
+    auto err = this->get(key, buf, len - 1, len_f);
+    if (err == ERR_OK) {
+        buf[len_f] = '\000';
+    }
     return err;
 }
 
-error Shard::__get(uint64 key, byte* (&buf), uint len) {
+error Shard::len(uint64 hash, const byte *key, uint klen, uint64 &len_f) {
+    error err;
+    if (this->read_mode != READ_MODE_OPTIMISTIC ||
+        !this->read_optimistic(hash, key, klen, nullptr, 0, len_f, err, true)) {
+        this->read_lock();
+        try {
+            uint64 addr;
+            err = this->__len(hash, key, klen, addr, len_f);
+        } catch (std::exception &e) {
+            this->dbg->excp(e.what());
+            err = ERR_INTERNAL;
+        }
+        this->mux.unlock_shared();
+    }
+    if (err == ERR_KEY_EXPIRED) {
+        this->expire_lazy(hash, key, klen);
+    }
+    return err;
+}
+
+error Shard::len(uint64 key, uint64 &len_f) {
+    return this->len(key, nullptr, 0, len_f);
+}
+
+error Shard::lease(uint64 hash, const byte *key, uint klen, shard_lease &l) {
     error err = ERR_OK;
+    l = shard_lease{nullptr, 0, 0, nullptr, ENTRY_ADDR_NIL};
+    this->read_lock();
     try {
-        // check entry exists in shard
-        if (this->idx_used.count(key) == 0) {
-            this->dbg->warn("shrd #%d: key %ld not found", this->idx, key);
-            return ERR_KEY_NOT_FOUND;
+        uint64 addr, len_f;
+        err = this->__len(hash, key, klen, addr, len_f);
+        if (err == ERR_OK) {
+            // Split every block by pages, the key in the first block is skipped.
+            std::vector<shard_segment> segs;
+            for (uint64 a = addr; a != ENTRY_ADDR_NIL;) {
+                auto hdr = this->entry_hdr(a);
+                uint64 pos = a + this->hdr_size(hdr) + hdr.klen;
+                uint64 rest = hdr.len - hdr.klen;
+                while (rest > 0) {
+                    uint idx_page = pos / this->sz_page;
+                    uint64 off = pos - uint64(idx_page) * this->sz_page;
+                    uint64 run = std::min(rest, this->sz_page - off);
+                    segs.push_back(shard_segment{this->data[idx_page]->payload + off, run});
+                    pos += run;
+                    rest -= run;
+                }
+                a = hdr.next;
+            }
+
+            l.segs = new shard_segment[segs.size()];
+            std::copy(segs.begin(), segs.end(), l.segs);
+            l.segs_cnt = segs.size();
+            l.len = len_f;
+            l.shard = this;
+            l.addr = addr;
+
+            // Shared lock keeps writers away till the pin is registered.
+            this->mux_pins.lock();
+            this->pins[addr].cnt++;
+            this->mux_pins.unlock();
         }
-        auto root = this->idx_used[key];
-        if (root->total_len == 0) {
-            this->dbg->warn("shrd #%d: entry on key %ld is empty", this->idx, key);
-            return ERR_KEY_NOT_FOUND;
+    } catch (std::exception &e) {
+        this->dbg->excp(e.what());
+        err = ERR_INTERNAL;
+    }
+    this->mux.unlock_shared();
+    if (err == ERR_OK && this->policy != nullptr) {
+        this->policy->touch(hash);
+        if (this->admit != nullptr) {
+            this->admit->record(hash);
+        }
+    }
+    if (err == ERR_KEY_EXPIRED) {
+        this->expire_lazy(hash, key, klen);
+    }
+    return err;
+}
+
+void Shard::expire_lazy(uint64 hash, const byte *key, uint klen) {
+    // The entry may be overwritten or evicted since the read, so check it again.
+    this->write_lock();
+    try {
+        uint64 addr;
+        if (this->entry_find(hash, key, klen, addr) && this->entry_hdr(addr).expire < unix_time_now_ns()) {
+            this->entry_evict(hash, addr, false);
+            this->cnt_expired++;
+            this->cnt_expired_lazy++;
+            this->dbg->l3("shrd #%d: key %ld expired on access", this->idx, hash);
+        }
+    } catch (std::exception &e) {
+        this->dbg->excp(e.what());
+    }
+    this->write_unlock();
+}
+
+void Shard::release(shard_lease &l) {
+    if (l.addr == ENTRY_ADDR_NIL) {
+        return;
+    }
+    uint64 addr = l.addr;
+    delete[] l.segs;
+    l = shard_lease{nullptr, 0, 0, nullptr, ENTRY_ADDR_NIL};
+
+    this->mux_pins.lock();
+    auto it = this->pins.find(addr);
+    if (it == this->pins.end()) {
+        this->mux_pins.unlock();
+        this->dbg->err("shrd #%d: release of not pinned entry at offset %ld", this->idx, addr);
+        return;
+    }
+    bool dead = --it->second.cnt == 0 && it->second.dead;
+    if (it->second.cnt == 0 && !dead) {
+        this->pins.erase(it);
+    }
+    this->mux_pins.unlock();
+    if (!dead) {
+        return;
+    }
+
+    // The last lease of the evicted entry frees its blocks, that needs the exclusive lock. Respect the lock order
+    // and check the pin again, nobody may pin dead entry, but it may be released concurrently.
+    this->write_lock();
+    try {
+        this->mux_pins.lock();
+        it = this->pins.find(addr);
+        dead = it != this->pins.end() && it->second.cnt == 0 && it->second.dead;
+        if (dead) {
+            this->pins.erase(it);
+        }
+        this->mux_pins.unlock();
+        if (dead) {
+            this->entry_free(addr);
+            this->dbg->l3("shrd #%d: leased entry at offset %ld freed", this->idx, addr);
         }
+    } catch (std::exception &e) {
+        this->dbg->excp(e.what());
+    }
+    this->write_unlock();
+}
 
-        // check if entry already expired
-        if (root->expire < unix_time_now_ns()) {
-            this->dbg->warn("shrd #%d: key %ld found, but it's expired", this->idx, key);
-            return ERR_KEY_EXPIRED;
+error Shard::__len(uint64 hash, const byte *key, uint klen, uint64 &addr, uint64 &len_f) {
+    // check entry exists in shard
+    if (!this->entry_find(hash, key, klen, addr)) {
+        this->dbg->warn("shrd #%d: key %ld not found", this->idx, hash);
+        return ERR_KEY_NOT_FOUND;
+    }
+    auto hdr = this->entry_hdr(addr);
+
+    // check if entry already expired
+    if (hdr.expire < unix_time_now_ns()) {
+        this->dbg->warn("shrd #%d: key %ld found, but it's expired", this->idx, hash);
+        return ERR_KEY_EXPIRED;
+    }
+
+    // Length of the chained entry is a sum of its blocks without the key.
+    len_f = hdr.len - hdr.klen;
+    while (hdr.next != ENTRY_ADDR_NIL) {
+        hdr = this->entry_hdr(hdr.next);
+        len_f += hdr.len;
+    }
+    return ERR_OK;
+}
+
+error Shard::__get(uint64 hash, const byte *key, uint klen, byte* (&buf), uint64 len, uint64 &len_f) {
+    error err = ERR_OK;
+    try {
+        uint64 addr;
+        err = this->__len(hash, key, klen, addr, len_f);
+        if (err != ERR_OK) {
+            return err;
         }
 
-        if (root->total_len > len) {
+        if (len_f > len) {
             this->dbg->warn("shrd #%d: supposed buffer length %d b for key %ld is too small. actual len is %d",
-                    this->idx, len, key, root->total_len);
+                    this->idx, len, hash, len_f);
             return ERR_BUF_LEN_LOW;
         }
-        auto used = root->root;
-        uint c = 0;
-        // Walk over the used blocks linked list and read corresponding bytes.
-        while (used) {
-            uint64 addr_hi_b = used->offset + used->len;
-            // Fill output buffer with the data of current used block.
-            for (uint64 i = used->offset; i < addr_hi_b; i++) {
-                buf[c] = this->get_byte(i);
-                c++;
-            }
 
-            // Shift to the next block in linked list.
-            used = used->next;
+        // Walk over the blocks chain and read corresponding bytes, the key in the first block is skipped.
+        uint64 c = 0;
+        while (addr != ENTRY_ADDR_NIL) {
+            auto hdr = this->entry_hdr(addr);
+            this->read_span(addr + this->hdr_size(hdr) + hdr.klen, buf + c, hdr.len - hdr.klen);
+            c += hdr.len - hdr.klen;
+            addr = hdr.next;
         }
-        this->dbg->l3("shrd #%d: %ld bytes of %ld has been read", this->idx, c, root->total_len);
-        buf[c] = '\000';
+        this->dbg->l3("shrd #%d: %ld bytes of %ld has been read", this->idx, c, len_f);
 
     } catch (std::exception &e) {
         this->dbg->excp(e.what());
@@ -252,132 +626,792 @@ error Shard::__get(uint64 key, byte* (&buf), uint len) {
     return err;
 }
 
-void Shard::reg_expire(uint64 expire, uint64 key) {
-    this->idx_expire[uint64(ceil(expire/1e9)*1e9)][key] = true;
-    this->dbg->l3("shrd #%d: register expire moment %ld ns for %ld", this->idx, expire, key);
+bool Shard::read_optimistic(uint64 hash, const byte *key, uint klen, byte *buf, uint64 len, uint64 &len_f,
+                            error &err, bool len_only) {
+    uint slot = this->epoch.enter();
+    if (slot == EPOCH_NO_SLOT) {
+        return false;
+    }
+    bool ok = false;
+    for (uint i = 0; i < READ_OPTIMISTIC_RETRIES; i++) {
+        if (this->read_attempt(hash, key, klen, buf, len, len_f, err, len_only)) {
+            ok = true;
+            break;
+        }
+        std::this_thread::yield();
+    }
+    this->epoch.exit(slot);
+
+    if (ok && err != ERR_OK) {
+        this->dbg->warn("shrd #%d: optimistic read of key %ld failed with code %d", this->idx, hash, err);
+    }
+    return ok;
+}
+
+bool Shard::read_attempt(uint64 hash, const byte *key, uint klen, byte *buf, uint64 len, uint64 &len_f,
+                         error &err, bool len_only) {
+    // Any chain is shorter than that, garbage headers may form a loop.
+    const uint64 max_hops = this->sz_max / ENTRY_HDR_CONT_SIZE + 1;
+
+    uint64 seq = this->seq.load(std::memory_order_acquire);
+    if ((seq & 1) != 0) {
+        return false;
+    }
+
+    // Tables of the index must be consistent before the probe, torn size may lead it out of the table.
+    auto view = this->idx_used.view();
+    if (!this->read_validate(seq)) {
+        return false;
+    }
+    uint64 addr;
+    auto match = [this, hash, key, klen](uint64 a) {
+        return this->entry_match(a, hash, key, klen, true);
+    };
+    if (!shard_index::view_find(view, hash, match, addr)) {
+        err = ERR_KEY_NOT_FOUND;
+        return this->read_validate(seq);
+    }
+
+    // Both storages keep the first header at the address from the index, ring records are single blocks.
+    shard_entry_hdr hdr{};
+    if (!this->entry_peek(addr, hdr) || hdr.klen > hdr.len) {
+        return false;
+    }
+    if (hdr.expire < unix_time_now_ns()) {
+        err = ERR_KEY_EXPIRED;
+        return this->read_validate(seq);
+    }
+    len_f = hdr.len - hdr.klen;
+    uint64 hops = 0;
+    while (hdr.next != ENTRY_ADDR_NIL) {
+        if (++hops > max_hops || !this->entry_peek(hdr.next, hdr)) {
+            return false;
+        }
+        len_f += hdr.len;
+    }
+
+    if (len_only) {
+        err = ERR_OK;
+        return this->read_validate(seq);
+    }
+    // Too small buffer fails the same way as the locked read does, whether it's given or not.
+    if (len_f > len) {
+        err = ERR_BUF_LEN_LOW;
+        return this->read_validate(seq);
+    }
+
+    uint64 c = 0;
+    hops = 0;
+    for (uint64 a = addr; a != ENTRY_ADDR_NIL; a = hdr.next) {
+        if (++hops > max_hops || !this->entry_peek(a, hdr)) {
+            return false;
+        }
+        if (hdr.klen > hdr.len || hdr.len - hdr.klen > len_f - c ||
+            !this->peek_span(a + this->hdr_size(hdr) + hdr.klen, buf + c, hdr.len - hdr.klen)) {
+            return false;
+        }
+        c += hdr.len - hdr.klen;
+    }
+    if (c != len_f) {
+        return false;
+    }
+
+    err = ERR_OK;
+    return this->read_validate(seq);
+}
+
+bool Shard::read_validate(uint64 seq) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return this->seq.load(std::memory_order_relaxed) == seq;
 }
 
 error Shard::bulk_expire() {
     error err = ERR_OK;
 
+    auto now = unix_time_now_ns();
+    if (this->expire_next() > now && !this->page_releasable()) {
+        this->dbg->l3("shrd #%d: bulk expire skipped, nothing is due", this->idx);
+        return err;
+    }
+
     this->dbg->l3("shrd #%d: bulk expire start", this->idx);
 
-    try {
-        auto now = unix_time_now_ns();
+    // Expired entries are evicted by batches limited by expire_batch operations and expire_budget_ns time, the lock
+    // is released between them to let foreground operations go.
+    uint64 cnt = 0;
+    bool done = false;
+    while (!done) {
+        this->write_lock();
+        auto time_s = mono_time_now_ns();
+        try {
+            if (this->storage == STORAGE_RING) {
+                // Records are ordered by expire moment, so just move the tail over expired and dead ones.
+                uint64 ops = 0;
+                do {
+                    done = !this->ring_pop(true);
+                    ops++;
+                } while (!done && ops < this->expire_batch && mono_time_now_ns() - time_s < this->expire_budget_ns);
+                cnt += done ? ops - 1 : ops;
+            } else {
+                uint64 n = 0;
+                done = this->wheel_expire(now, time_s + this->expire_budget_ns, n);
+                this->cnt_expired += n;
+                cnt += n;
+                if (done) {
+                    this->page_release();
+                }
+            }
+        } catch (std::exception &e) {
+            this->dbg->excp(e.what());
+            err = ERR_INTERNAL;
+            done = true;
+        }
+        this->expire_hold(mono_time_now_ns() - time_s);
+        this->write_unlock();
+        if (!done) {
+            std::this_thread::yield();
+        }
+    }
 
-        std::map<uint64, std::map<uint64, bool>>::reverse_iterator it;
-        for (it = this->idx_expire.rbegin(); it != this->idx_expire.rend(); ++it) {
-            if (it->first + this->expire_ns <= now) {
-                this->mux.lock();
+    this->dbg->l3("shrd #%d: bulk expire finish, %ld entries (records for ring) reclaimed", this->idx, cnt);
 
-                if (it->second.empty() || it->first == 0) {
-                    if (it->first != 0) {
-                        this->idx_expire.erase(it->first);
+    return err;
+}
+
+void Shard::expire_hold(uint64 ns) {
+    uint64 us = ns / 1000;
+    uint b = us == 0 ? 0 : uint(64 - __builtin_clzll(us));
+    this->expire_hold_hist[std::min(b, uint(STATS_HOLD_BUCKETS - 1))]++;
+    this->expire_hold_max = std::max(this->expire_hold_max, ns);
+}
+
+uint64 Shard::expire_next() {
+    const uint64 sz_hdr = this->sz_head;
+    uint64 next = UINT64_MAX;
+    this->mux.lock_shared();
+    try {
+        if (this->storage == STORAGE_RING) {
+            // Only the tail record may be reclaimed, dead records and padding are reclaimed at once.
+            if (this->sz_used > 0) {
+                next = 0;
+                if (this->sz_max - this->ring_tail >= sz_hdr) {
+                    auto hdr = this->entry_hdr(this->ring_tail);
+                    if ((hdr.flags & ENTRY_FLAG_PAD) == 0 && this->idx_used.contains(hdr.hash, this->ring_tail)) {
+                        next = hdr.expire;
                     }
-                    continue;
                 }
+            }
+        } else {
+            uint64 tick = this->wheel_next();
+            if (tick != UINT64_MAX) {
+                next = tick > UINT64_MAX / EXPIRE_RESOLUTION_NS ? UINT64_MAX : tick * EXPIRE_RESOLUTION_NS;
+            }
+        }
+    } catch (std::exception &e) {
+        this->dbg->excp(e.what());
+        next = 0;
+    }
+    this->mux.unlock_shared();
+    return next;
+}
 
-                for (auto hkey : it->second) {
-                    this->__evict(hkey.first, true, true);
-                }
-                this->idx_expire.erase(it->first);
+error Shard::bulk_vacuum() {
+    error err = ERR_OK;
 
-                this->mux.unlock();
-            }
+    // Log is compact by design, dead records reclaims by the tail.
+    if (this->storage == STORAGE_RING) {
+        return err;
+    }
+
+    this->dbg->l3("shrd #%d: bulk vacuum start", this->idx);
+
+    try {
+        // Nothing to do if free space is contiguous and all entries are single blocks.
+        this->write_lock();
+        bool skip = this->idx_free.size() <= 1 && this->cnt_blocks == this->idx_used.size();
+        if (skip) {
+            this->page_release();
+        }
+        this->write_unlock();
+        if (skip) {
+            this->dbg->l3("shrd #%d: bulk vacuum skipped", this->idx);
+            return err;
         }
 
-        this->mux.unlock();
+        // Collect first block offsets of all entries. Index is scanned by chunks, releasing the lock
+        // when budget is over. Entries added in between will be processed in the next cycle.
+        std::vector<uint64> cands;
+        uint64 pos = 0;
+        bool done = false;
+        while (!done) {
+            // Scan doesn't modify the shard, so readers may go meanwhile.
+            this->mux.lock_shared();
+            auto time_s = mono_time_now_ns();
+            do {
+                pos = this->idx_used.scan(pos, VACUUM_SCAN_STEP, [&cands](uint64 val) {
+                    cands.push_back(val);
+                });
+                done = pos >= this->idx_used.capacity();
+            } while (!done && mono_time_now_ns() - time_s < this->vacuum_budget_ns);
+            this->mux.unlock_shared();
+            std::this_thread::yield();
+        }
+
+        // Relocate entries from the lowest addresses, so free gaps slide up and merge, and the data packs to the
+        // beginning page by page.
+        std::sort(cands.begin(), cands.end());
+        std::vector<byte> buf;
+        uint64 moved = 0;
+        size_t i = 0;
+        while (i < cands.size()) {
+            this->write_lock();
+            auto time_s = mono_time_now_ns();
+            do {
+                if (this->vacuum_entry(cands[i], buf)) {
+                    moved++;
+                }
+                i++;
+            } while (i < cands.size() && mono_time_now_ns() - time_s < this->vacuum_budget_ns);
+            this->write_unlock();
+            std::this_thread::yield();
+        }
+
+        this->dbg->l2("shrd #%d: bulk vacuum moved %ld entries of %ld", this->idx, moved, cands.size());
+
+        // Compaction frees the upper pages.
+        this->write_lock();
+        this->page_release();
+        this->write_unlock();
     } catch (std::exception &e) {
         this->dbg->excp(e.what());
         err = ERR_INTERNAL;
     }
 
-    this->dbg->l3("shrd #%d: bulk expire finish", this->idx);
+    this->dbg->l3("shrd #%d: bulk vacuum finish", this->idx);
 
     return err;
 }
 
-error Shard::evict(uint64 key) {
-    this->mux.lock();
-    error err = this->__evict(key);
-    this->mux.unlock();
+bool Shard::vacuum_entry(uint64 addr, std::vector<byte> &buf) {
+    const uint64 sz_hdr = this->sz_head;
+    // Entry may be evicted or moved since the scan, then its address isn't in the index anymore.
+    auto hdr = this->entry_hdr(addr);
+    if ((hdr.flags & ENTRY_FLAG_CONT) != 0 || !this->idx_used.contains(hdr.hash, addr)) {
+        return false;
+    }
+    // Leased entry can't move, the lease points to its memory.
+    if (this->entry_pinned(addr, false)) {
+        return false;
+    }
+    uint64 hash = hdr.hash;
+    uint64 expire = hdr.expire;
+    uint klen = hdr.klen;
+
+    // Single block entry moves only if there is a free block right before it or any lower free block fits it.
+    if (hdr.next == ENTRY_ADDR_NIL) {
+        bool movable = false;
+        for (auto &it : this->idx_free) {
+            if (it.first >= addr) {
+                break;
+            }
+            if (it.second->len >= sz_hdr + hdr.len || it.first + it.second->len == addr) {
+                movable = true;
+                break;
+            }
+        }
+        if (!movable) {
+            return false;
+        }
+    }
+
+    // Read the key and the data of all blocks.
+    buf.clear();
+    for (uint64 a = addr; a != ENTRY_ADDR_NIL; a = hdr.next) {
+        hdr = this->entry_hdr(a);
+        buf.resize(buf.size() + hdr.len);
+        this->read_span(a + this->hdr_size(hdr), buf.data() + buf.size() - hdr.len, hdr.len);
+    }
+
+    // Release old blocks, they merge with adjacent free space. The entry will return to the same place of its eviction
+    // queue.
+    this->wheel_remove(addr);
+    uint q = 0;
+    uint64 evict_prev = ENTRY_ADDR_NIL;
+    if (this->policy != nullptr) {
+        q = this->evict_unlink(addr, evict_prev);
+    }
+    this->entry_free(addr);
+
+    // Place the data to the lowest free block that fits it whole. Such block exists at least for single block
+    // entries, since their own space merged with the lower free block.
+    shard_entry_free *target = nullptr;
+    for (auto &it : this->idx_free) {
+        if (it.second->len >= sz_hdr + buf.size()) {
+            target = it.second;
+            break;
+        }
+    }
+
+    // Fragmented shard: no single block fits the chained entry, so chain it again over the largest blocks. Freed
+    // blocks are at least as large as the old ones, so it always succeeds.
+    uint64 addr_n;
+    if (!this->entry_write(hash, buf.data(), klen, expire, buf.data() + klen, buf.size() - klen, target, addr_n)) {
+        std::stringstream ss;
+        ss << "shrd #" << this->idx << ": couldn't relocate entry " << hash;
+        throw std::runtime_error(ss.str());
+    }
+    this->idx_used.update(hash, addr, addr_n);
+    this->wheel_insert(addr_n, expire);
+    if (this->policy != nullptr) {
+        this->evict_link(addr_n, q, evict_prev);
+    }
+    this->cnt_vacuum_moved++;
+
+    this->dbg->l3("shrd #%d: key %ld moved from offset %ld to %ld", this->idx, hash, addr, addr_n);
+
+    return true;
+}
+
+error Shard::evict(uint64 hash, const byte *key, uint klen) {
+    this->write_lock();
+    this->cnt_writes++;
+    error err = this->__evict(hash, key, klen);
+    this->write_unlock();
     return err;
 }
 
-error Shard::__evict(uint64 key, bool skip_check, bool skip_idx_clear) {
+error Shard::evict(uint64 key) {
+    return this->evict(key, nullptr, 0);
+}
+
+error Shard::__evict(uint64 hash, const byte *key, uint klen, bool skip_check) {
     error err = ERR_OK;
 
     try {
         // check entry exists in shard
-        if (!skip_check) {
-            if (this->idx_used.count(key) == 0) {
-                this->dbg->warn("shrd #%d: key %ld not found", this->idx, key);
-                return ERR_KEY_NOT_FOUND;
+        uint64 addr;
+        if (!this->entry_find(hash, key, klen, addr)) {
+            if (!skip_check) {
+                this->dbg->warn("shrd #%d: key %ld not found", this->idx, hash);
             }
+            return ERR_KEY_NOT_FOUND;
         }
+        this->entry_evict(hash, addr, false);
+    } catch (std::exception &e) {
+        this->dbg->excp(e.what());
+        err = ERR_INTERNAL;
+    }
 
-        auto root = this->idx_used[key];
-        if (root == nullptr) {
-            return ERR_KEY_NOT_FOUND;
+    return err;
+}
+
+void Shard::entry_evict(uint64 hash, uint64 addr, bool skip_idx_clear) {
+    // Completely remove the entry from used index.
+    this->idx_used.erase(hash, addr);
+
+    // Dead ring record reclaims by the tail.
+    if (this->storage == STORAGE_RING) {
+        return;
+    }
+
+    if (!skip_idx_clear) {
+        this->wheel_remove(addr);
+    }
+    if (this->policy != nullptr) {
+        uint64 prev;
+        this->evict_unlink(addr, prev);
+    }
+
+    // Leased blocks stay intact till the last release.
+    if (this->entry_pinned(addr, true)) {
+        this->dbg->l3("shrd #%d: key %ld evicted, but leased", this->idx, hash);
+        return;
+    }
+
+    // Return blocks to the free index, they will merge with adjacent free blocks.
+    // Note that the real data still remains in the shard, but turned into a garbage and will overwrite in the
+    // future.
+    this->entry_free(addr);
+}
+
+bool Shard::entry_pinned(uint64 addr, bool kill) {
+    std::lock_guard<std::mutex> lock(this->mux_pins);
+    auto it = this->pins.find(addr);
+    if (it == this->pins.end()) {
+        return false;
+    }
+    if (kill) {
+        it->second.dead = true;
+    }
+    return true;
+}
+
+bool Shard::entry_find(uint64 hash, const byte *key, uint klen, uint64 &addr) {
+    return this->idx_used.find(hash, [this, hash, key, klen](uint64 a) {
+        return this->entry_match(a, hash, key, klen, false);
+    }, addr);
+}
+
+bool Shard::entry_match(uint64 addr, uint64 hash, const byte *key, uint klen, bool peek) {
+    const uint64 sz_hdr = this->sz_head;
+    shard_entry_hdr hdr{};
+    if (peek) {
+        if (!this->entry_peek(addr, hdr)) {
+            return false;
         }
-        // Sync balance.
-        this->sz_used -= root->total_len;
-        this->sz_free += root->total_len;
+    } else {
+        hdr = this->entry_hdr(addr);
+    }
+    if (hdr.hash != hash || hdr.klen != klen || (hdr.flags & (ENTRY_FLAG_PAD | ENTRY_FLAG_CONT)) != 0) {
+        return false;
+    }
 
-        // Try to remove key from the expire index.
-        if (!skip_idx_clear) {
-            this->idx_expire[root->expire].erase(key);
+    // Compare the key by chunks, it always lies in the first block.
+    byte chunk[256];
+    for (uint off = 0; off < klen; off += sizeof(chunk)) {
+        uint n = std::min(klen - off, uint(sizeof(chunk)));
+        if (peek) {
+            if (!this->peek_span(addr + sz_hdr + off, chunk, n)) {
+                return false;
+            }
+        } else {
+            this->read_span(addr + sz_hdr + off, chunk, n);
         }
+        if (memcmp(chunk, key + off, n) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Empty header: fields absent in the short headers read as nil links and zeroes.
+ */
+static const shard_entry_hdr ENTRY_HDR_EMPTY{0, 0, 0, ENTRY_ADDR_NIL, 0, 0, ENTRY_ADDR_NIL, ENTRY_ADDR_NIL,
+                                             ENTRY_ADDR_NIL, ENTRY_ADDR_NIL};
+
+/**
+ * Unpack the ring record header to the full one.
+ */
+static inline shard_entry_hdr ring_hdr_unpack(const shard_ring_hdr &rec) {
+    shard_entry_hdr hdr = ENTRY_HDR_EMPTY;
+    hdr.len = rec.len;
+    hdr.flags = rec.flags;
+    hdr.klen = rec.klen;
+    hdr.hash = rec.hash;
+    hdr.expire = rec.expire;
+    return hdr;
+}
 
+shard_entry_hdr Shard::entry_hdr(uint64 addr) {
+    if (this->storage == STORAGE_RING) {
+        shard_ring_hdr rec{};
+        this->read_span(addr, reinterpret_cast<byte*>(&rec), sizeof(rec));
+        return ring_hdr_unpack(rec);
+    }
+    // Rest of the header follows only in the first block, the continuation one may end right after its short header.
+    shard_entry_hdr hdr = ENTRY_HDR_EMPTY;
+    this->read_span(addr, reinterpret_cast<byte*>(&hdr), ENTRY_HDR_CONT_SIZE);
+    if ((hdr.flags & ENTRY_FLAG_CONT) == 0) {
+        this->read_span(addr + ENTRY_HDR_CONT_SIZE, reinterpret_cast<byte*>(&hdr) + ENTRY_HDR_CONT_SIZE,
+                        this->sz_head - ENTRY_HDR_CONT_SIZE);
+    }
+    return hdr;
+}
 
-        auto used = root->root;
-        auto used_o = used;
-        while (used) {
-            // Make new free block on the base of used block.
-            auto free_n = new shard_entry_free;
-            free_n->offset = used->offset;
-            free_n->len = used->len;
-            // Push it at the end of free index.
-            this->idx_free.push_back(free_n);
+bool Shard::entry_peek(uint64 addr, shard_entry_hdr &hdr) {
+    if (this->storage == STORAGE_RING) {
+        shard_ring_hdr rec{};
+        if (!this->peek_span(addr, reinterpret_cast<byte*>(&rec), sizeof(rec))) {
+            return false;
+        }
+        hdr = ring_hdr_unpack(rec);
+        return true;
+    }
+    hdr = ENTRY_HDR_EMPTY;
+    if (!this->peek_span(addr, reinterpret_cast<byte*>(&hdr), ENTRY_HDR_CONT_SIZE)) {
+        return false;
+    }
+    return (hdr.flags & ENTRY_FLAG_CONT) != 0 ||
+           this->peek_span(addr + ENTRY_HDR_CONT_SIZE, reinterpret_cast<byte*>(&hdr) + ENTRY_HDR_CONT_SIZE,
+                           this->sz_head - ENTRY_HDR_CONT_SIZE);
+}
 
-            this->dbg->l3("shrd #%d: mark mem free, offset %ld len %ld", this->idx, free_n->offset, free_n->len);
+bool Shard::entry_write(uint64 hash, const byte *key, uint klen, uint64 expire, const byte *bytes, uint64 len,
+                        shard_entry_free *first, uint64 &addr) {
+    addr = ENTRY_ADDR_NIL;
+    uint64 prev = ENTRY_ADDR_NIL;
+    // Key and value are written as a single stream, the key goes first.
+    uint64 total = klen + len;
+    uint64 remained = total;
+    while (remained > 0) {
+        // Prefer single block that fits the rest of the data, otherwise take the largest one to keep the chain
+        // as short as possible.
+        // Only the first block takes the whole header, continuation ones take the short one.
+        const uint64 sz_hdr = prev == ENTRY_ADDR_NIL ? this->sz_head : ENTRY_HDR_CONT_SIZE;
+        auto free = first;
+        first = nullptr;
+        if (free == nullptr) {
+            free = this->free_find(sz_hdr + remained);
+        }
+        if (free == nullptr) {
+            free = this->free_largest();
+        }
+        // The first block must keep the whole key.
+        uint64 min_len = sz_hdr + (prev == ENTRY_ADDR_NIL ? klen : 0);
+        if (free == nullptr || free->len <= min_len) {
+            // Rollback the part that is already written.
+            if (addr != ENTRY_ADDR_NIL) {
+                this->entry_free(addr);
+                addr = ENTRY_ADDR_NIL;
+            }
+            return false;
+        }
+        this->dbg->l2("shrd #%d: found free block with len %ld at offset %ld", this->idx, free->len, free->offset);
+
+        // Check how many bytes we can push into free block.
+        uint64 run = std::min(remained, free->len - sz_hdr);
+        uint64 blk = free->offset;
+        this->free_take(free, sz_hdr + run);
+
+        shard_entry_hdr hdr{uint(run), 0, 0, ENTRY_ADDR_NIL, hash, expire, ENTRY_ADDR_NIL, ENTRY_ADDR_NIL,
+                            ENTRY_ADDR_NIL, ENTRY_ADDR_NIL};
+        uint64 pos = total - remained;
+        if (prev == ENTRY_ADDR_NIL) {
+            hdr.klen = uint16(klen);
+            this->write_span(blk, reinterpret_cast<byte*>(&hdr), sz_hdr);
+            this->write_span(blk + sz_hdr, key, klen);
+            this->write_span(blk + sz_hdr + klen, bytes, run - klen);
+        } else {
+            hdr.flags = ENTRY_FLAG_CONT;
+            this->write_span(blk, reinterpret_cast<byte*>(&hdr), sz_hdr);
+            this->write_span(blk + sz_hdr, bytes + (pos - klen), run);
+        }
 
-            // Shift to the next used block.
-            used = used->next;
-            // Free used block.
-            // Note that the real data still remains in the shard, but turned into a garbage and will overwrite in the
-            // future.
-            delete used_o;
-            // Save pointer for further free.
-            used_o = used;
+        // Link the block to the chain.
+        if (prev == ENTRY_ADDR_NIL) {
+            addr = blk;
+        } else {
+            this->write_span(prev + offsetof(shard_entry_hdr, next), reinterpret_cast<byte*>(&blk), sizeof(blk));
         }
+        prev = blk;
 
-        // Completely remove the entry from used index.
-        this->idx_used.erase(key);
-    } catch (std::exception &e) {
-        this->dbg->excp(e.what());
-        err = ERR_INTERNAL;
+        remained -= run;
+        this->cnt_blocks++;
+        this->sz_used += sz_hdr + run;
+        this->sz_free = this->sz_max - this->sz_used;
+        this->dbg->l3("shrd #%d: %ld bytes of %ld has been saved", this->idx, run, total);
     }
 
-    return err;
+    return true;
+}
+
+void Shard::entry_free(uint64 addr) {
+    while (addr != ENTRY_ADDR_NIL) {
+        auto hdr = this->entry_hdr(addr);
+        uint64 sz_hdr = this->hdr_size(hdr);
+        this->free_put(addr, sz_hdr + hdr.len);
+        this->cnt_blocks--;
+        this->sz_used -= sz_hdr + hdr.len;
+        this->sz_free = this->sz_max - this->sz_used;
+        this->dbg->l3("shrd #%d: mark mem free, offset %ld len %ld", this->idx, addr, sz_hdr + hdr.len);
+        addr = hdr.next;
+    }
+}
+
+/**
+ * Get size class of the free block.
+ * Class <code>c</code> contains blocks with length in range [2^c, 2^(c+1)).
+ */
+static inline uint free_cls_of(uint64 len) {
+    return 63 - __builtin_clzll(len);
+}
+
+void Shard::free_link(shard_entry_free *f) {
+    uint c = free_cls_of(f->len);
+    f->prev = nullptr;
+    f->next = this->free_cls[c];
+    if (f->next != nullptr) {
+        f->next->prev = f;
+    }
+    this->free_cls[c] = f;
+}
+
+void Shard::free_unlink(shard_entry_free *f) {
+    if (f->prev != nullptr) {
+        f->prev->next = f->next;
+    } else {
+        this->free_cls[free_cls_of(f->len)] = f->next;
+    }
+    if (f->next != nullptr) {
+        f->next->prev = f->prev;
+    }
+    f->prev = nullptr;
+    f->next = nullptr;
 }
 
-void Shard::set_byte(uint64 addr, byte b) {
-    int idx_page = addr / this->sz_page;
-    if (uint(idx_page) >= this->page_init_cnt) {
-        this->dbg->err("shrd #%d: try to write to an unreserved page %d, available space: %ld b, free space: %ld b",
-                this->idx, idx_page, this->sz_alloc - this->sz_used, this->sz_free);
+shard_entry_free *Shard::free_find(uint64 len) {
+    uint c = free_cls_of(len);
+    // Class of the length may contain both shorter and longer blocks, so check them.
+    for (auto f = this->free_cls[c]; f != nullptr; f = f->next) {
+        if (f->len >= len) {
+            return f;
+        }
+    }
+    // Any block of the upper classes fits.
+    for (c++; c < FREE_CLS_CNT; c++) {
+        if (this->free_cls[c] != nullptr) {
+            return this->free_cls[c];
+        }
+    }
+    return nullptr;
+}
+
+shard_entry_free *Shard::free_largest() {
+    for (int c = FREE_CLS_CNT - 1; c >= 0; c--) {
+        shard_entry_free *largest = nullptr;
+        for (auto f = this->free_cls[c]; f != nullptr; f = f->next) {
+            if (largest == nullptr || f->len > largest->len) {
+                largest = f;
+            }
+        }
+        if (largest != nullptr) {
+            return largest;
+        }
+    }
+    return nullptr;
+}
+
+void Shard::free_take(shard_entry_free *f, uint64 len) {
+    this->free_unlink(f);
+    this->idx_free.erase(f->offset);
+    if (f->len == len) {
+        this->pool_free.free(f);
         return;
     }
-    this->data[idx_page]->payload[addr % this->sz_page] = b;
+    // Register the rest as a smaller free block.
+    f->offset += len;
+    f->len -= len;
+    this->idx_free[f->offset] = f;
+    this->free_link(f);
 }
 
-byte Shard::get_byte(uint64 addr) {
-    int idx_page = addr / this->sz_page;
-    if (uint(idx_page) >= this->page_init_cnt) {
-        this->dbg->err("shrd #%d: try to read from an unreserved page %d, addr %ld",
-                this->idx, idx_page, addr);
-        return 0;
+void Shard::free_put(uint64 offset, uint64 len) {
+    auto next = this->idx_free.lower_bound(offset);
+
+    // Merge with the previous adjacent block.
+    if (next != this->idx_free.begin()) {
+        auto prev = std::prev(next)->second;
+        if (prev->offset + prev->len == offset) {
+            this->free_unlink(prev);
+            prev->len += len;
+            // Merge with the next adjacent block as well.
+            if (next != this->idx_free.end() && offset + len == next->second->offset) {
+                auto f = next->second;
+                this->free_unlink(f);
+                this->idx_free.erase(next);
+                prev->len += f->len;
+                this->pool_free.free(f);
+            }
+            this->free_link(prev);
+            return;
+        }
+    }
+
+    // Merge with the next adjacent block.
+    if (next != this->idx_free.end() && offset + len == next->second->offset) {
+        auto f = next->second;
+        this->free_unlink(f);
+        this->idx_free.erase(next);
+        f->offset = offset;
+        f->len += len;
+        this->idx_free[offset] = f;
+        this->free_link(f);
+        return;
+    }
+
+    auto f = this->pool_free.alloc(offset, len, nullptr, nullptr);
+    this->idx_free[offset] = f;
+    this->free_link(f);
+}
+
+void Shard::write_span(uint64 addr, const byte *src, uint64 len) {
+    // Large values go through non-temporal stores to avoid evicting hot data from the cache.
+    bool nt = len >= NT_COPY_MIN_LEN;
+    while (len > 0) {
+        uint idx_page = addr / this->sz_page;
+        uint64 off = addr - uint64(idx_page) * this->sz_page;
+        uint64 run = std::min(len, this->sz_page - off);
+
+        // Pages are reserved on the first write, and again after release.
+        if (idx_page >= this->data.size()) {
+            std::stringstream ss;
+            ss << "shrd #" << this->idx << ": try to write to an address " << addr << " out of shard";
+            throw std::runtime_error(ss.str());
+        }
+        if (this->data[idx_page]->payload == nullptr) {
+            this->page_reserve(idx_page);
+        }
+
+        byte *dst = this->data[idx_page]->payload + off;
+        if (nt) {
+            mem_copy_nt(dst, src, run);
+        } else {
+            memcpy(dst, src, run);
+        }
+
+        addr += run;
+        src += run;
+        len -= run;
+    }
+    if (nt) {
+        mem_fence_nt();
+    }
+}
+
+void Shard::read_span(uint64 addr, byte *dst, uint64 len) {
+    while (len > 0) {
+        uint idx_page = addr / this->sz_page;
+        uint64 off = addr - uint64(idx_page) * this->sz_page;
+        uint64 run = std::min(len, this->sz_page - off);
+
+        if (idx_page >= this->data.size() || this->data[idx_page]->payload == nullptr) {
+            std::stringstream ss;
+            ss << "shrd #" << this->idx << ": try to read from an unreserved page " << idx_page << ", addr " << addr;
+            throw std::runtime_error(ss.str());
+        }
+
+        memcpy(dst, this->data[idx_page]->payload + off, run);
+
+        addr += run;
+        dst += run;
+        len -= run;
+    }
+}
+
+bool Shard::peek_span(uint64 addr, byte *dst, uint64 len) {
+    if (addr > this->sz_max || len > this->sz_max - addr) {
+        return false;
+    }
+    while (len > 0) {
+        uint idx_page = addr / this->sz_page;
+        uint64 off = addr - uint64(idx_page) * this->sz_page;
+        uint64 run = std::min(len, this->sz_page - off);
+
+        // Pages map isn't modified after construction, only payloads are.
+        auto it = this->data.find(idx_page);
+        if (it == this->data.end()) {
+            return false;
+        }
+        byte *payload = __atomic_load_n(&it->second->payload, __ATOMIC_ACQUIRE);
+        if (payload == nullptr) {
+            return false;
+        }
+        memcpy(dst, payload + off, run);
+
+        addr += run;
+        dst += run;
+        len -= run;
     }
-    return this->data[idx_page]->payload[addr % this->sz_page];
+    return true;
 }
@@ -0,0 +1,129 @@
+#include <cstddef>
+#include "const.h"
+#include "helpers.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Eviction queues of the shard.
+ *
+ * Entries of the paged storage are linked to EVICT_QUEUES FIFO queues through their headers, the policy decides which
+ * queue the entry goes to and which one gives the eviction candidate. Vacuum relinks moved entries at the same
+ * positions, so relocation doesn't change the eviction order.
+ */
+
+error Shard::evict_one(uint64 hash, bool resident) {
+    if (this->policy == nullptr) {
+        return ERR_NO_SPACE;
+    }
+
+    // Every pass over the queues may only decrement the access counters, so the limit is reached only if all entries
+    // are leased or readers keep touching them meanwhile. Then the candidate is evicted regardless of its counter.
+    uint64 limit = (this->evict_use.cnt[0] + this->evict_use.cnt[1]) * (EVICT_FREQ_MAX + 1) + 1;
+    uint64 now = unix_time_now_ns();
+    for (uint64 i = 0; i <= limit; i++) {
+        uint q = this->policy->victim_queue(this->evict_use);
+        if (this->evict_heads[q] == ENTRY_ADDR_NIL) {
+            q = EVICT_QUEUES - 1 - q;
+        }
+        uint64 addr = this->evict_heads[q];
+        if (addr == ENTRY_ADDR_NIL) {
+            return ERR_NO_SPACE;
+        }
+        auto hdr = this->entry_hdr(addr);
+        uint64 prev;
+
+        // Leased entry keeps its blocks till the release.
+        if (this->entry_pinned(addr, false)) {
+            this->evict_unlink(addr, prev);
+            this->evict_link(addr, q, this->evict_tails[q]);
+            continue;
+        }
+
+        if (hdr.expire < now) {
+            this->entry_evict(hdr.hash, addr, false);
+            this->cnt_expired++;
+            this->dbg->l3("shrd #%d: key %ld expired on eviction", this->idx, hdr.hash);
+            return ERR_OK;
+        }
+
+        uint d = i < limit ? this->policy->decide(q, hdr.hash) : EVICT_VICTIM;
+        if (d != EVICT_VICTIM) {
+            this->evict_unlink(addr, prev);
+            this->evict_link(addr, d, this->evict_tails[d]);
+            continue;
+        }
+
+        // Victim that is requested more often than the new key stays, the write is rejected instead.
+        if (this->admit != nullptr && !resident && !this->admit->admit(hash, hdr.hash)) {
+            this->cnt_rejected++;
+            this->dbg->l3("shrd #%d: key %ld not admitted, victim %ld is more popular", this->idx, hash, hdr.hash);
+            return ERR_NOT_ADMITTED;
+        }
+
+        this->policy->evicted(q, hdr.hash, this->evict_use);
+        this->entry_evict(hdr.hash, addr, false);
+        this->cnt_evicted++;
+        this->dbg->l3("shrd #%d: key %ld evicted by policy", this->idx, hdr.hash);
+        return ERR_OK;
+    }
+    return ERR_NO_SPACE;
+}
+
+void Shard::evict_link(uint64 addr, uint q, uint64 after) {
+    auto hdr = this->entry_hdr(addr);
+    uint64 next = after != ENTRY_ADDR_NIL ? this->entry_hdr(after).evict_next : this->evict_heads[q];
+    uint64 links[2] = {after, next};
+    static_assert(offsetof(shard_entry_hdr, evict_next) == offsetof(shard_entry_hdr, evict_prev) + sizeof(uint64),
+                  "eviction links must be adjacent");
+    this->write_span(addr + offsetof(shard_entry_hdr, evict_prev), reinterpret_cast<byte*>(links), sizeof(links));
+    hdr.flags = uint16(q != 0 ? hdr.flags | ENTRY_FLAG_QUEUE : hdr.flags & ~ENTRY_FLAG_QUEUE);
+    this->write_span(addr + offsetof(shard_entry_hdr, flags), reinterpret_cast<byte*>(&hdr.flags), sizeof(hdr.flags));
+
+    if (after != ENTRY_ADDR_NIL) {
+        this->write_span(after + offsetof(shard_entry_hdr, evict_next), reinterpret_cast<byte*>(&addr), sizeof(addr));
+    } else {
+        this->evict_heads[q] = addr;
+    }
+    if (next != ENTRY_ADDR_NIL) {
+        this->write_span(next + offsetof(shard_entry_hdr, evict_prev), reinterpret_cast<byte*>(&addr), sizeof(addr));
+    } else {
+        this->evict_tails[q] = addr;
+    }
+
+    this->evict_use.bytes[q] += this->entry_size(addr);
+    this->evict_use.cnt[q]++;
+}
+
+uint Shard::evict_unlink(uint64 addr, uint64 &prev) {
+    auto hdr = this->entry_hdr(addr);
+    uint q = (hdr.flags & ENTRY_FLAG_QUEUE) != 0 ? 1 : 0;
+    prev = hdr.evict_prev;
+
+    if (hdr.evict_prev != ENTRY_ADDR_NIL) {
+        this->write_span(hdr.evict_prev + offsetof(shard_entry_hdr, evict_next),
+                         reinterpret_cast<byte*>(&hdr.evict_next), sizeof(hdr.evict_next));
+    } else {
+        this->evict_heads[q] = hdr.evict_next;
+    }
+    if (hdr.evict_next != ENTRY_ADDR_NIL) {
+        this->write_span(hdr.evict_next + offsetof(shard_entry_hdr, evict_prev),
+                         reinterpret_cast<byte*>(&hdr.evict_prev), sizeof(hdr.evict_prev));
+    } else {
+        this->evict_tails[q] = hdr.evict_prev;
+    }
+
+    this->evict_use.bytes[q] -= this->entry_size(addr);
+    this->evict_use.cnt[q]--;
+    return q;
+}
+
+uint64 Shard::entry_size(uint64 addr) {
+    uint64 sz = 0;
+    while (addr != ENTRY_ADDR_NIL) {
+        auto hdr = this->entry_hdr(addr);
+        sz += this->hdr_size(hdr) + hdr.len;
+        addr = hdr.next;
+    }
+    return sz;
+}
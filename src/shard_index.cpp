@@ -0,0 +1,191 @@
+#include <cstring>
+#include "shard_index.h"
+
+shard_index::shard_index() {
+    this->tbl = table_alloc(INDEX_INIT_GROUPS);
+    this->tbl_old = shard_index_table{nullptr, 0, 0, 0};
+}
+
+shard_index::~shard_index() {
+    this->table_free(this->tbl, false);
+    this->table_free(this->tbl_old, false);
+}
+
+shard_index_table shard_index::table_alloc(uint64 groups) {
+    shard_index_table t{new shard_index_group[groups], groups - 1, 0, 0};
+    for (uint64 g = 0; g < groups; g++) {
+        memset(t.groups[g].ctrl, INDEX_CTRL_EMPTY, INDEX_GROUP_SIZE);
+    }
+    return t;
+}
+
+void shard_index::table_free(shard_index_table &t, bool defer) {
+    auto groups = t.groups;
+    t = shard_index_table{nullptr, 0, 0, 0};
+    if (groups == nullptr) {
+        return;
+    }
+    if (defer && this->reclaim != nullptr) {
+        this->reclaim->retire([groups]() { delete[] groups; });
+    } else {
+        delete[] groups;
+    }
+}
+
+void shard_index::table_put(shard_index_table &t, byte tag, uint64 slot) {
+    uint64 g = index_h1(slot_frag(slot), t.mask);
+    for (uint64 i = 1; i <= t.mask + 1; i++) {
+        auto grp = &t.groups[g];
+        uint m = group_match_free(grp->ctrl);
+        if (m != 0) {
+            uint s = __builtin_ctz(m);
+            if (grp->ctrl[s] == INDEX_CTRL_DELETED) {
+                t.deleted--;
+            }
+            grp->ctrl[s] = tag;
+            grp->slots[s] = slot;
+            t.used++;
+            return;
+        }
+        g = (g + i) & t.mask;
+    }
+}
+
+void shard_index::table_del(shard_index_table &t, uint64 g, uint s) {
+    auto grp = &t.groups[g];
+    // Slot may become empty again only if the group was never full, otherwise some probe may pass through it.
+    if (group_match(grp->ctrl, INDEX_CTRL_EMPTY) != 0) {
+        grp->ctrl[s] = INDEX_CTRL_EMPTY;
+    } else {
+        grp->ctrl[s] = INDEX_CTRL_DELETED;
+        t.deleted++;
+    }
+    t.used--;
+}
+
+bool shard_index::contains(uint64 key, uint64 val) {
+    uint64 v;
+    return this->find(key, [val](uint64 c) { return c == val; }, v);
+}
+
+void shard_index::insert(uint64 key, uint64 val) {
+    this->grow();
+    table_put(this->tbl, index_h2(key), (key_frag(key) << INDEX_VAL_BITS) | (val & INDEX_VAL_MAX));
+    if (this->tbl_old.groups != nullptr) {
+        this->migrate(INDEX_MIGRATE_STEP);
+    }
+}
+
+bool shard_index::update(uint64 key, uint64 val, uint64 val_n) {
+    auto match = [val](uint64 c) { return c == val; };
+    uint64 g;
+    uint s;
+    if (table_find(this->tbl, key, match, g, s)) {
+        this->tbl.groups[g].slots[s] = (key_frag(key) << INDEX_VAL_BITS) | (val_n & INDEX_VAL_MAX);
+        return true;
+    }
+    if (this->tbl_old.groups != nullptr && table_find(this->tbl_old, key, match, g, s)) {
+        this->tbl_old.groups[g].slots[s] = (key_frag(key) << INDEX_VAL_BITS) | (val_n & INDEX_VAL_MAX);
+        return true;
+    }
+    return false;
+}
+
+bool shard_index::erase(uint64 key, uint64 val) {
+    auto match = [val](uint64 c) { return c == val; };
+    uint64 g;
+    uint s;
+    bool found = false;
+    if (table_find(this->tbl, key, match, g, s)) {
+        table_del(this->tbl, g, s);
+        found = true;
+    } else if (this->tbl_old.groups != nullptr && table_find(this->tbl_old, key, match, g, s)) {
+        table_del(this->tbl_old, g, s);
+        found = true;
+    }
+    if (this->tbl_old.groups != nullptr) {
+        this->migrate(INDEX_MIGRATE_STEP);
+    }
+    return found;
+}
+
+void shard_index::clear() {
+    this->table_free(this->tbl, true);
+    this->table_free(this->tbl_old, true);
+    this->tbl = table_alloc(INDEX_INIT_GROUPS);
+    this->migrate_pos = 0;
+}
+
+uint64 shard_index::size() {
+    return this->tbl.used + this->tbl_old.used;
+}
+
+uint64 shard_index::capacity() {
+    uint64 c = (this->tbl.mask + 1) * INDEX_GROUP_SIZE;
+    if (this->tbl_old.groups != nullptr) {
+        c += (this->tbl_old.mask + 1) * INDEX_GROUP_SIZE;
+    }
+    return c;
+}
+
+void shard_index::grow() {
+    uint64 cap = (this->tbl.mask + 1) * INDEX_GROUP_SIZE;
+    // Max load factor is 7/8.
+    if ((this->tbl.used + this->tbl.deleted + 1) * 8 <= cap * 7) {
+        return;
+    }
+
+    // Previous resize isn't finished yet, complete it at once. Shouldn't happen since every write moves groups
+    // faster than the new table fills.
+    if (this->tbl_old.groups != nullptr) {
+        this->migrate(this->tbl_old.mask + 1);
+    }
+
+    // Table is mostly filled with tombstones - rebuild it with the same size, otherwise double it.
+    uint64 groups = this->tbl.mask + 1;
+    if (this->tbl.used * 2 >= cap) {
+        groups *= 2;
+    }
+    this->tbl_old = this->tbl;
+    this->tbl = table_alloc(groups);
+    this->migrate_pos = 0;
+}
+
+void shard_index::migrate(uint64 steps) {
+    for (uint64 i = 0; i < steps && this->migrate_pos <= this->tbl_old.mask; i++, this->migrate_pos++) {
+        auto grp = &this->tbl_old.groups[this->migrate_pos];
+        for (uint s = 0; s < INDEX_GROUP_SIZE; s++) {
+            if ((grp->ctrl[s] & INDEX_CTRL_EMPTY) == 0) {
+                // Control byte is the tag of the key, so the slot moves without the full key.
+                table_put(this->tbl, grp->ctrl[s], grp->slots[s]);
+                // Keep probe chains of the old table unbroken for the keys that aren't migrated yet.
+                grp->ctrl[s] = INDEX_CTRL_DELETED;
+                this->tbl_old.used--;
+                this->tbl_old.deleted++;
+            }
+        }
+    }
+    if (this->migrate_pos > this->tbl_old.mask) {
+        this->table_free(this->tbl_old, true);
+        this->migrate_pos = 0;
+    }
+}
+
+void shard_index::set_reclaim(epoch_domain *e) {
+    this->reclaim = e;
+}
+
+/**
+ * Read descriptor of the table that may be modified concurrently.
+ */
+static inline shard_index_table table_load(const shard_index_table &t) {
+    return shard_index_table{
+        __atomic_load_n(&t.groups, __ATOMIC_RELAXED),
+        __atomic_load_n(&t.mask, __ATOMIC_RELAXED),
+        0, 0,
+    };
+}
+
+shard_index_view shard_index::view() {
+    return shard_index_view{table_load(this->tbl), table_load(this->tbl_old)};
+}
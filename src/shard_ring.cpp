@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <exception>
+#include "const.h"
+#include "debug.h"
+#include "helpers.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Ring storage engine of the shard.
+ *
+ * The shard's memory is treated as a circular log of records <code>[shard_ring_hdr|key|data]</code>. New records always
+ * append to the head, and the oldest ones are evicted from the tail when the head reaches them. If the record doesn't
+ * fit till the end of the ring, the rest is filled with padding record and the head wraps to the beginning. Padding
+ * shorter than a header isn't marked at all, since no record may start there.
+ */
+
+error Shard::ring_set(uint64 hash, const byte *key, uint klen, const byte *bytes, uint64 len, uint64 expire,
+                      bool force) {
+    const uint64 sz_hdr = sizeof(shard_ring_hdr);
+    uint64 rec = sz_hdr + klen + len;
+    if (rec > this->sz_max) {
+        this->dbg->warn("shrd #%d: record %ld b is greater than ring size %ld b", this->idx, rec, this->sz_max);
+        return ERR_NO_SPACE;
+    }
+
+    uint64 addr;
+    if (this->entry_find(hash, key, klen, addr)) {
+        // Expired record doesn't prevent the write.
+        bool expired = this->entry_hdr(addr).expire < unix_time_now_ns();
+        if (!force && !expired) {
+            this->dbg->err("shrd #%d: key %ld already exists", this->idx, hash);
+            return ERR_KEY_EXISTS;
+        }
+        // Previous record becomes dead and will reclaim by the tail.
+        this->entry_evict(hash, addr, true);
+        if (expired) {
+            this->cnt_expired++;
+            this->cnt_expired_lazy++;
+        }
+    }
+
+    if (this->sz_used == 0) {
+        this->ring_head = 0;
+        this->ring_tail = 0;
+    }
+
+    // Calculate contiguous free space after the head.
+    auto contig_free = [this]() -> uint64 {
+        if (this->ring_tail > this->ring_head) {
+            return this->ring_tail - this->ring_head;
+        }
+        if (this->ring_tail == this->ring_head && this->sz_used > 0) {
+            return 0;
+        }
+        return this->sz_max - this->ring_head;
+    };
+
+    if (this->sz_max - this->ring_head < rec) {
+        // Record doesn't fit till the end of the ring, pad the rest and wrap.
+        uint64 pad = this->sz_max - this->ring_head;
+        while (contig_free() < pad) {
+            if (!this->ring_pop(false)) {
+                this->dbg->warn("shrd #%d: can't save %ld b, the tail is leased", this->idx, len);
+                return ERR_NO_SPACE;
+            }
+        }
+        if (pad >= sz_hdr) {
+            shard_ring_hdr hdr{uint(pad - sz_hdr), ENTRY_FLAG_PAD, 0, 0, 0};
+            this->write_span(this->ring_head, reinterpret_cast<byte*>(&hdr), sz_hdr);
+        }
+        this->sz_used += pad;
+        this->ring_head = 0;
+        this->dbg->l3("shrd #%d: ring wrapped, %ld b padded", this->idx, pad);
+    }
+
+    while (contig_free() < rec) {
+        if (!this->ring_pop(false)) {
+            this->dbg->warn("shrd #%d: can't save %ld b, the tail is leased", this->idx, len);
+            return ERR_NO_SPACE;
+        }
+    }
+
+    shard_ring_hdr hdr{uint(klen + len), 0, uint16(klen), hash, expire};
+    this->write_span(this->ring_head, reinterpret_cast<byte*>(&hdr), sz_hdr);
+    this->write_span(this->ring_head + sz_hdr, key, klen);
+    this->write_span(this->ring_head + sz_hdr + klen, bytes, len);
+    this->idx_used.insert(hash, this->ring_head);
+
+    this->ring_head += rec;
+    if (this->ring_head == this->sz_max) {
+        this->ring_head = 0;
+    }
+    this->sz_used += rec;
+    this->sz_free = this->sz_max - this->sz_used;
+
+    this->dbg->l2("shrd #%d: now used %ld b, has free %ld b", this->idx, this->sz_used, this->sz_free);
+
+    return ERR_OK;
+}
+
+bool Shard::ring_pop(bool expired_only) {
+    const uint64 sz_hdr = sizeof(shard_ring_hdr);
+    if (this->sz_used == 0) {
+        return false;
+    }
+
+    // Unmarked padding at the end of the ring.
+    if (this->sz_max - this->ring_tail < sz_hdr) {
+        this->sz_used -= this->sz_max - this->ring_tail;
+        this->ring_tail = 0;
+        return true;
+    }
+
+    shard_ring_hdr hdr{};
+    this->read_span(this->ring_tail, reinterpret_cast<byte*>(&hdr), sz_hdr);
+    if ((hdr.flags & ENTRY_FLAG_PAD) == 0) {
+        // Leased record, alive or not, blocks the tail till the release.
+        if (this->entry_pinned(this->ring_tail, false)) {
+            return false;
+        }
+        // Record is live only if the index still points to it.
+        if (this->idx_used.contains(hdr.hash, this->ring_tail)) {
+            if (expired_only && hdr.expire >= unix_time_now_ns()) {
+                return false;
+            }
+            this->idx_used.erase(hdr.hash, this->ring_tail);
+            if (expired_only || hdr.expire < unix_time_now_ns()) {
+                this->cnt_expired++;
+            } else {
+                this->cnt_evicted++;
+            }
+            this->dbg->l3("shrd #%d: key %ld evicted from the tail", this->idx, hdr.hash);
+        }
+    }
+
+    uint64 rec = sz_hdr + hdr.len;
+    this->ring_tail += rec;
+    if (this->ring_tail == this->sz_max) {
+        this->ring_tail = 0;
+    }
+    this->sz_used -= rec;
+    this->sz_free = this->sz_max - this->sz_used;
+
+    return true;
+}
+
+uint64 Shard::ring_due(uint64 now) {
+    const uint64 sz_hdr = sizeof(shard_ring_hdr);
+    uint64 due = 0;
+    uint64 tail = this->ring_tail;
+    uint64 used = this->sz_used;
+    for (uint64 i = 0; i < this->expire_batch && used > 0; i++) {
+        // Padding and dead records go together with the expired ones.
+        uint64 rec = this->sz_max - tail;
+        if (rec >= sz_hdr) {
+            shard_ring_hdr hdr{};
+            this->read_span(tail, reinterpret_cast<byte*>(&hdr), sz_hdr);
+            if ((hdr.flags & ENTRY_FLAG_PAD) == 0) {
+                if (this->entry_pinned(tail, false) ||
+                    (this->idx_used.contains(hdr.hash, tail) && hdr.expire >= now)) {
+                    break;
+                }
+            }
+            rec = sz_hdr + hdr.len;
+        }
+        due += rec;
+        used -= std::min(rec, used);
+        tail += rec;
+        if (tail == this->sz_max) {
+            tail = 0;
+        }
+    }
+    return due;
+}
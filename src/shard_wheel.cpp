@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include "const.h"
+#include "helpers.h"
+#include "shard.h"
+#include "types.h"
+
+/**
+ * @file Expiration timing wheel of the shard.
+ *
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots. The entry is placed to the lowest level where its expire
+ * tick shares the span of the upper level with the current tick, so the slot of level <code>l</code> is chosen by
+ * tick bits at position <code>l * WHEEL_SLOT_BITS</code>. When the current tick reaches the beginning of the slot of
+ * the upper level, its entries cascade down, and the slot of the first level contains only entries that expire at the
+ * current tick. Lists of the slots are linked through the entries' headers, so the wheel needs no heap memory per
+ * entry.
+ */
+
+/**
+ * Get the tick of the expire moment, rounded up so the entry never expires earlier.
+ */
+static inline uint64 wheel_tick_of(uint64 expire) {
+    return expire / EXPIRE_RESOLUTION_NS + (expire % EXPIRE_RESOLUTION_NS != 0 ? 1 : 0);
+}
+
+void Shard::wheel_insert(uint64 addr, uint64 expire) {
+    this->wheel_link(addr, wheel_tick_of(expire));
+}
+
+void Shard::wheel_remove(uint64 addr) {
+    auto hdr = this->entry_hdr(addr);
+    uint slot = hdr.flags >> ENTRY_WHEEL_SHIFT;
+    if (slot > WHEEL_LEVELS * WHEEL_SLOTS) {
+        std::stringstream ss;
+        ss << "shrd #" << this->idx << ": entry at offset " << addr << " has invalid wheel slot " << slot;
+        throw std::runtime_error(ss.str());
+    }
+    uint lvl = slot / WHEEL_SLOTS, pos = slot % WHEEL_SLOTS;
+    if (hdr.wheel_prev != ENTRY_ADDR_NIL) {
+        this->write_span(hdr.wheel_prev + offsetof(shard_entry_hdr, wheel_next),
+                         reinterpret_cast<byte*>(&hdr.wheel_next), sizeof(hdr.wheel_next));
+    } else {
+        uint64 *head = lvl < WHEEL_LEVELS ? &this->wheel_heads[lvl][pos] : &this->wheel_far;
+        if (*head != addr) {
+            std::stringstream ss;
+            ss << "shrd #" << this->idx << ": entry at offset " << addr << " not found in the expiration wheel";
+            throw std::runtime_error(ss.str());
+        }
+        *head = hdr.wheel_next;
+        if (*head == ENTRY_ADDR_NIL && lvl < WHEEL_LEVELS) {
+            this->wheel_bits[lvl] &= ~(uint64(1) << pos);
+        }
+    }
+    if (hdr.wheel_next != ENTRY_ADDR_NIL) {
+        this->write_span(hdr.wheel_next + offsetof(shard_entry_hdr, wheel_prev),
+                         reinterpret_cast<byte*>(&hdr.wheel_prev), sizeof(hdr.wheel_prev));
+    }
+    this->wheel_bytes[slot] -= this->entry_size(addr);
+    this->wheel_set_links(addr, ENTRY_ADDR_NIL, ENTRY_ADDR_NIL);
+}
+
+bool Shard::wheel_expire(uint64 now, uint64 deadline, uint64 &cnt) {
+    const uint64 mask = WHEEL_SLOTS - 1;
+    uint64 target = now / EXPIRE_RESOLUTION_NS;
+    uint64 ops = 0;
+    auto spent = [this, deadline, &ops]() {
+        return ops >= this->expire_batch || mono_time_now_ns() >= deadline;
+    };
+
+    while (this->wheel_tick <= target) {
+        uint64 t = this->wheel_tick;
+
+        // Overflow list comes closer on every turn of the top level. It's placed again at once, since its entries
+        // may return to the list.
+        uint64 turn = t >> (WHEEL_SLOT_BITS * WHEEL_LEVELS);
+        if (turn != this->wheel_far_turn) {
+            this->wheel_far_turn = turn;
+            uint64 a = this->wheel_far;
+            this->wheel_far = ENTRY_ADDR_NIL;
+            this->wheel_bytes[WHEEL_LEVELS * WHEEL_SLOTS] = 0;
+            while (a != ENTRY_ADDR_NIL) {
+                auto hdr = this->entry_hdr(a);
+                this->wheel_link(a, wheel_tick_of(hdr.expire));
+                a = hdr.wheel_next;
+            }
+        }
+        // Cascade slots of the upper levels that start at this tick. Go top-down, so the entry may fall through
+        // several levels at once. Moved entries never return to the same slot, so the interrupted cascade just
+        // continues on the next call.
+        for (uint lvl = WHEEL_LEVELS - 1; lvl > 0; lvl--) {
+            uint sh = WHEEL_SLOT_BITS * lvl;
+            if ((t & ((uint64(1) << sh) - 1)) != 0) {
+                continue;
+            }
+            uint pos = uint(t >> sh) & mask;
+            while (this->wheel_heads[lvl][pos] != ENTRY_ADDR_NIL) {
+                if (spent()) {
+                    return false;
+                }
+                uint64 a = this->wheel_pop(lvl, pos);
+                this->wheel_link(a, wheel_tick_of(this->entry_hdr(a).expire));
+                ops++;
+            }
+        }
+        // All entries of the first level slot expire at this tick.
+        uint pos = uint(t & mask);
+        while (this->wheel_heads[0][pos] != ENTRY_ADDR_NIL) {
+            if (spent()) {
+                return false;
+            }
+            uint64 a = this->wheel_pop(0, pos);
+            this->entry_evict(this->entry_hdr(a).hash, a, true);
+            cnt++;
+            ops++;
+        }
+
+        // Skip the ticks while the lower levels are empty: nothing expires or cascades till the beginning of the
+        // next slot of the first non-empty level.
+        uint lvl = 0;
+        while (lvl < WHEEL_LEVELS && this->wheel_bits[lvl] == 0) {
+            lvl++;
+        }
+        uint64 next = t + 1;
+        if (lvl == WHEEL_LEVELS && this->wheel_far == ENTRY_ADDR_NIL) {
+            next = target + 1;
+        } else if (lvl > 0) {
+            next = (t | ((uint64(1) << (WHEEL_SLOT_BITS * lvl)) - 1)) + 1;
+        }
+        this->wheel_tick = std::min(next, target + 1);
+    }
+    return true;
+}
+
+uint64 Shard::wheel_next() {
+    uint lvl = 0;
+    while (lvl < WHEEL_LEVELS && this->wheel_bits[lvl] == 0) {
+        lvl++;
+    }
+    if (lvl == WHEEL_LEVELS) {
+        if (this->wheel_far == ENTRY_ADDR_NIL) {
+            return UINT64_MAX;
+        }
+        // Overflow list is checked on the next turn of the top level.
+        uint64 span = uint64(1) << (WHEEL_SLOT_BITS * WHEEL_LEVELS);
+        return (this->wheel_tick | (span - 1)) + 1;
+    }
+    // Work of the lower level always comes earlier. Non-empty slots of the level lie ahead of the current tick within
+    // the span of the upper level, so the lowest one is the earliest.
+    uint sh = WHEEL_SLOT_BITS * lvl;
+    uint64 base = this->wheel_tick >> (sh + WHEEL_SLOT_BITS) << (sh + WHEEL_SLOT_BITS);
+    return std::max(base | (uint64(__builtin_ctzll(this->wheel_bits[lvl])) << sh), this->wheel_tick);
+}
+
+uint64 Shard::wheel_due(uint64 now) {
+    uint64 target = now / EXPIRE_RESOLUTION_NS;
+    if (target < this->wheel_tick) {
+        return 0;
+    }
+    uint64 due = 0;
+    for (uint lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+        uint sh = WHEEL_SLOT_BITS * lvl;
+        uint64 base = this->wheel_tick >> (sh + WHEEL_SLOT_BITS) << (sh + WHEEL_SLOT_BITS);
+        for (uint64 bits = this->wheel_bits[lvl]; bits != 0; bits &= bits - 1) {
+            uint pos = uint(__builtin_ctzll(bits));
+            // Ticks before the current one are processed already, expired entries wait in the current tick's slot.
+            uint64 lo = std::max(base | (uint64(pos) << sh), this->wheel_tick);
+            uint64 hi = (base | (uint64(pos) << sh)) + (uint64(1) << sh);
+            if (lo > target) {
+                continue;
+            }
+            uint64 b = this->wheel_bytes[lvl * WHEEL_SLOTS + pos];
+            due += hi <= target + 1 ? b : b / (hi - lo) * (target + 1 - lo);
+        }
+    }
+    // Overflow list is placed again on the next turn of the top level, its entries expire beyond it.
+    uint64 span = uint64(1) << (WHEEL_SLOT_BITS * WHEEL_LEVELS);
+    if ((this->wheel_tick | (span - 1)) + 1 <= target) {
+        due += this->wheel_bytes[WHEEL_LEVELS * WHEEL_SLOTS];
+    }
+    return due;
+}
+
+uint64 *Shard::wheel_slot(uint64 tick, uint &lvl, uint &pos) {
+    // Expired entries go to the current tick.
+    tick = std::max(tick, this->wheel_tick);
+    for (lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+        uint sh = WHEEL_SLOT_BITS * (lvl + 1);
+        if ((tick >> sh) == (this->wheel_tick >> sh)) {
+            pos = uint(tick >> (sh - WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+            return &this->wheel_heads[lvl][pos];
+        }
+    }
+    pos = 0;
+    return &this->wheel_far;
+}
+
+void Shard::wheel_link(uint64 addr, uint64 tick) {
+    uint lvl, pos;
+    uint64 *head = this->wheel_slot(tick, lvl, pos);
+    // Slot is kept in the header, so the entry is removed from the middle of the list without search.
+    uint slot = lvl * WHEEL_SLOTS + pos;
+    uint16 flags = this->entry_hdr(addr).flags;
+    flags = uint16((flags & ((1u << ENTRY_WHEEL_SHIFT) - 1)) | (slot << ENTRY_WHEEL_SHIFT));
+    this->write_span(addr + offsetof(shard_entry_hdr, flags), reinterpret_cast<byte*>(&flags), sizeof(flags));
+    this->wheel_bytes[slot] += this->entry_size(addr);
+    this->wheel_set_links(addr, ENTRY_ADDR_NIL, *head);
+    if (*head != ENTRY_ADDR_NIL) {
+        this->write_span(*head + offsetof(shard_entry_hdr, wheel_prev), reinterpret_cast<byte*>(&addr),
+                         sizeof(addr));
+    }
+    *head = addr;
+    if (lvl < WHEEL_LEVELS) {
+        this->wheel_bits[lvl] |= uint64(1) << pos;
+    }
+}
+
+uint64 Shard::wheel_pop(uint lvl, uint pos) {
+    uint64 head = this->wheel_heads[lvl][pos];
+    uint64 next = this->entry_hdr(head).wheel_next;
+    this->wheel_heads[lvl][pos] = next;
+    if (next != ENTRY_ADDR_NIL) {
+        uint64 nil = ENTRY_ADDR_NIL;
+        this->write_span(next + offsetof(shard_entry_hdr, wheel_prev), reinterpret_cast<byte*>(&nil), sizeof(nil));
+    } else {
+        this->wheel_bits[lvl] &= ~(uint64(1) << pos);
+    }
+    this->wheel_bytes[lvl * WHEEL_SLOTS + pos] -= this->entry_size(head);
+    this->wheel_set_links(head, ENTRY_ADDR_NIL, ENTRY_ADDR_NIL);
+    return head;
+}
+
+void Shard::wheel_set_links(uint64 addr, uint64 prev, uint64 next) {
+    uint64 links[2] = {prev, next};
+    static_assert(offsetof(shard_entry_hdr, wheel_next) == offsetof(shard_entry_hdr, wheel_prev) + sizeof(uint64),
+                  "wheel links must be adjacent");
+    this->write_span(addr + offsetof(shard_entry_hdr, wheel_prev), reinterpret_cast<byte*>(links), sizeof(links));
+}
@@ -0,0 +1,36 @@
+#include "stats.h"
+
+void stats_calc(shard_stats &st) {
+    uint64 sz_free = st.sz_max > st.sz_used ? st.sz_max - st.sz_used : 0;
+    st.frag_ratio = sz_free > 0 ? 1 - float64(st.free_largest) / float64(sz_free) : 0;
+    if (st.frag_ratio < 0) {
+        st.frag_ratio = 0;
+    }
+    st.chain_avg = st.entries > 0 ? float64(st.chain_blocks) / float64(st.entries) : 0;
+}
+
+void stats_add(shard_stats &dst, const shard_stats &src) {
+    dst.sz_max += src.sz_max;
+    dst.sz_used += src.sz_used;
+    dst.sz_alloc += src.sz_alloc;
+    dst.sz_resident += src.sz_resident;
+    dst.pages_released += src.pages_released;
+    dst.entries += src.entries;
+    dst.free_blocks += src.free_blocks;
+    dst.free_largest += src.free_largest;
+    dst.chain_blocks += src.chain_blocks;
+    dst.vacuum_moved += src.vacuum_moved;
+    dst.leases += src.leases;
+    dst.expired += src.expired;
+    dst.expired_lazy += src.expired_lazy;
+    for (uint i = 0; i < STATS_HOLD_BUCKETS; i++) {
+        dst.expire_hold_hist[i] += src.expire_hold_hist[i];
+    }
+    dst.evicted += src.evicted;
+    dst.rejected += src.rejected;
+    dst.writes += src.writes;
+    dst.contended += src.contended;
+    if (src.expire_hold_max > dst.expire_hold_max) {
+        dst.expire_hold_max = src.expire_hold_max;
+    }
+}
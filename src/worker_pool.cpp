@@ -0,0 +1,138 @@
+#include <chrono>
+#include <exception>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "worker_pool.h"
+
+worker_pool::worker_pool(uint size, bool affinity, debug *dbg) {
+    this->dbg = dbg;
+    uint ncpu = std::thread::hardware_concurrency();
+    if (ncpu == 0) {
+        ncpu = 1;
+    }
+    if (size == 0) {
+        size = ncpu;
+    }
+
+    for (uint w = 0; w < size; w++) {
+        this->queues.push_back(new queue());
+    }
+    for (uint w = 0; w < size; w++) {
+        this->threads.emplace_back(&worker_pool::work, this, w);
+        if (affinity) {
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(w % ncpu, &set);
+            if (pthread_setaffinity_np(this->threads[w].native_handle(), sizeof(set), &set) != 0) {
+                this->dbg->warn("thr_w #%d: couldn't bind to CPU %d", w, w % ncpu);
+            }
+#else
+            this->dbg->warn("thr_w #%d: CPU affinity isn't supported", w);
+#endif
+        }
+    }
+    this->dbg->l2("worker pool inited with %d workers (affinity %d)", size, affinity);
+}
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mux);
+        this->stop = true;
+    }
+    this->cv_task.notify_all();
+    for (auto &thr : this->threads) {
+        thr.join();
+    }
+    for (auto q : this->queues) {
+        delete q;
+    }
+}
+
+void worker_pool::run(uint64 n, const std::function<void(uint64)> &fn) {
+    if (n == 0) {
+        return;
+    }
+    batch b{&fn, n};
+    {
+        std::lock_guard<std::mutex> lock(this->mux);
+        this->pending += n;
+    }
+    // Neighbour tasks go to the same worker, stealers take them from the other end.
+    uint64 k = this->queues.size();
+    for (uint64 w = 0; w < k; w++) {
+        auto q = this->queues[w];
+        std::lock_guard<std::mutex> lock(q->mux);
+        for (uint64 i = w * n / k; i < (w + 1) * n / k; i++) {
+            q->tasks.push_back(task{&b, i});
+        }
+    }
+    this->cv_task.notify_all();
+
+    std::unique_lock<std::mutex> lock(this->mux);
+    while (b.left > 0) {
+        this->cv_done.wait_for(lock, std::chrono::nanoseconds(WORKER_WAIT_NS));
+    }
+}
+
+uint worker_pool::size() {
+    return uint(this->threads.size());
+}
+
+uint64 worker_pool::get_steals() {
+    return this->steals.load();
+}
+
+void worker_pool::work(uint w) {
+    while (true) {
+        task t{};
+        if (this->take(w, t)) {
+            try {
+                (*t.b->fn)(t.i);
+            } catch (std::exception &e) {
+                this->dbg->excp(e.what());
+            }
+            std::lock_guard<std::mutex> lock(this->mux);
+            if (--t.b->left == 0) {
+                this->cv_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->mux);
+        while (!this->stop && this->pending == 0) {
+            this->cv_task.wait_for(lock, std::chrono::nanoseconds(WORKER_WAIT_NS));
+        }
+        if (this->stop && this->pending == 0) {
+            return;
+        }
+    }
+}
+
+bool worker_pool::take(uint w, task &t) {
+    uint k = uint(this->queues.size());
+    bool found = false;
+    for (uint i = 0; i < k && !found; i++) {
+        auto q = this->queues[(w + i) % k];
+        std::lock_guard<std::mutex> lock(q->mux);
+        if (q->tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            t = q->tasks.front();
+            q->tasks.pop_front();
+        } else {
+            t = q->tasks.back();
+            q->tasks.pop_back();
+            this->steals++;
+        }
+        found = true;
+    }
+    if (found) {
+        std::lock_guard<std::mutex> lock(this->mux);
+        this->pending--;
+    }
+    return found;
+}
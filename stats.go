@@ -0,0 +1,173 @@
+package cbigcache
+
+/*
+#include <sys/types.h>
+#include "include/export.h"
+*/
+import "C"
+import (
+	"time"
+	"unsafe"
+)
+
+// Stats is a snapshot of cache (or single shard) metrics.
+type Stats struct {
+	// Max size of the payload.
+	MaxSize MemorySize
+	// Usage size.
+	Used MemorySize
+	// Allocated size of the pages.
+	Alloc MemorySize
+	// Size of the pages memory that is resident in RAM.
+	Resident MemorySize
+	// Count of empty pages released to the system.
+	PagesReleased uint64
+	// Count of entries.
+	Entries uint64
+	// Count of free blocks.
+	FreeBlocks uint64
+	// Length of the largest free block.
+	FreeLargest MemorySize
+	// Count of used blocks of all entries.
+	ChainBlocks uint64
+	// External fragmentation of free space: 1 - largest free block / total free space.
+	FragRatio float64
+	// Average count of blocks per entry.
+	ChainAvg float64
+	// Count of entries relocated by vacuum.
+	VacuumMoved uint64
+	// Count of entries pinned by views.
+	Leases uint64
+	// Count of entries evicted due to expiration.
+	Expired uint64
+	// Count of expired entries evicted on access, included to Expired.
+	ExpiredLazy uint64
+	// Histogram of shard lock hold times by expiration: bucket i counts holds from 2^(i-1) to 2^i microseconds, the
+	// first bucket counts holds shorter than 1us and the last one all longer holds.
+	ExpireHoldHist [C.STATS_HOLD_BUCKETS]uint64
+	// Longest shard lock hold by expiration.
+	ExpireHoldMax time.Duration
+	// Count of entries evicted to free space for new ones.
+	Evicted uint64
+	// Count of writes rejected by the admission filter.
+	Rejected uint64
+	// Count of foreground write operations.
+	Writes uint64
+	// Count of shard lock acquisitions that had to wait.
+	Contended uint64
+}
+
+// SchedStats is a snapshot of decisions of the background task scheduler.
+type SchedStats struct {
+	// Count of cycles.
+	Cycles uint64
+	// Count of shard tasks run.
+	ShardsPlanned uint64
+	// Count of shard tasks deferred, since they didn't fit the CPU budget.
+	ShardsThrottled uint64
+	// Count of shard tasks deferred due to lock contention on the shard.
+	ShardsHot uint64
+	// Count of period cuts due to much reclaimable memory.
+	Accelerations uint64
+	// Count of shard tasks allowed by the last cycle.
+	Quota uint64
+	// Current period of the task.
+	Period time.Duration
+	// Memory that was reclaimable at the last cycle.
+	Reclaimable MemorySize
+	// Count of foreground write operations seen.
+	Ops uint64
+	// Count of contended shard lock acquisitions seen.
+	Contended uint64
+	// Total run time of the shard tasks.
+	Busy time.Duration
+	// Smoothed cost of the single shard task.
+	Cost time.Duration
+	// CPU usage of the last cycle, ratio of the busy time to the interval between cycles.
+	CPUUsage float64
+}
+
+// Get metrics of the whole cache.
+func (c *CBigCache) Stats() (*Stats, error) {
+	if !c.alive {
+		return nil, ErrorCacheIsDead
+	}
+	var st C.struct_shard_stats
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
+	errCode := ErrorCode(C.cbc_stats(ptrCbc, &st))
+	if errCode != ErrorCodeOk {
+		return nil, errorRegistry[errCode]
+	}
+	return statsFromC(&st), nil
+}
+
+// Get metrics of the shard with index idx.
+func (c *CBigCache) ShardStats(idx uint) (*Stats, error) {
+	if !c.alive {
+		return nil, ErrorCacheIsDead
+	}
+	var st C.struct_shard_stats
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
+	errCode := ErrorCode(C.cbc_shard_stats(ptrCbc, C.uint(idx), &st))
+	if errCode != ErrorCodeOk {
+		return nil, errorRegistry[errCode]
+	}
+	return statsFromC(&st), nil
+}
+
+// Get decisions metrics of the scheduler of the background task.
+func (c *CBigCache) SchedStats(task SchedTask) (*SchedStats, error) {
+	if !c.alive {
+		return nil, ErrorCacheIsDead
+	}
+	var st C.struct_sched_stats
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
+	errCode := ErrorCode(C.cbc_sched_stats(ptrCbc, C.uint(task), &st))
+	if errCode != ErrorCodeOk {
+		return nil, errorRegistry[errCode]
+	}
+	return &SchedStats{
+		Cycles:          uint64(st.cycles),
+		ShardsPlanned:   uint64(st.shards_planned),
+		ShardsThrottled: uint64(st.shards_throttled),
+		ShardsHot:       uint64(st.shards_hot),
+		Accelerations:   uint64(st.accelerations),
+		Quota:           uint64(st.quota),
+		Period:          time.Duration(st.period_ns),
+		Reclaimable:     MemorySize(st.reclaimable),
+		Ops:             uint64(st.ops),
+		Contended:       uint64(st.contended),
+		Busy:            time.Duration(st.busy_ns),
+		Cost:            time.Duration(st.cost_ns),
+		CPUUsage:        float64(st.cpu_usage),
+	}, nil
+}
+
+func statsFromC(st *C.struct_shard_stats) *Stats {
+	r := &Stats{
+		MaxSize:       MemorySize(st.sz_max),
+		Used:          MemorySize(st.sz_used),
+		Alloc:         MemorySize(st.sz_alloc),
+		Resident:      MemorySize(st.sz_resident),
+		PagesReleased: uint64(st.pages_released),
+		Entries:       uint64(st.entries),
+		FreeBlocks:    uint64(st.free_blocks),
+		FreeLargest:   MemorySize(st.free_largest),
+		ChainBlocks:   uint64(st.chain_blocks),
+		FragRatio:     float64(st.frag_ratio),
+		ChainAvg:      float64(st.chain_avg),
+		VacuumMoved:   uint64(st.vacuum_moved),
+		Leases:        uint64(st.leases),
+		Expired:       uint64(st.expired),
+		ExpiredLazy:   uint64(st.expired_lazy),
+		ExpireHoldMax: time.Duration(st.expire_hold_max),
+		Evicted:       uint64(st.evicted),
+		Rejected:      uint64(st.rejected),
+		Writes:        uint64(st.writes),
+		Contended:     uint64(st.contended),
+	}
+	for i := range r.ExpireHoldHist {
+		r.ExpireHoldHist[i] = uint64(st.expire_hold_hist[i])
+	}
+	return r
+}
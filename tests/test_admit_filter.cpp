@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "admit_filter.h"
+#include "const.h"
+#include "hash.h"
+
+class test_admit_filter : public ::testing::Test {};
+
+TEST_F(test_admit_filter, admit_filter_estimate) {
+    auto f = new admit_filter(1024);
+    uint64 hot = fnv64a("hot"), cold = fnv64a("cold"), unknown = fnv64a("unknown");
+
+    // The first request only goes to the doorkeeper.
+    ASSERT_EQ(f->estimate(hot), 0u);
+    f->record(hot);
+    ASSERT_EQ(f->estimate(hot), 1u);
+    for (uint i = 0; i < 5; i++) {
+        f->record(hot);
+    }
+    ASSERT_EQ(f->estimate(hot), 6u);
+
+    // Counters saturate.
+    for (uint i = 0; i < 100; i++) {
+        f->record(hot);
+    }
+    ASSERT_EQ(f->estimate(hot), ADMIT_FREQ_MAX + 1);
+
+    f->record(cold);
+    ASSERT_EQ(f->estimate(cold), 1u);
+    ASSERT_EQ(f->estimate(unknown), 0u);
+
+    // Only the key requested more often replaces the victim.
+    ASSERT_TRUE(f->admit(hot, cold));
+    ASSERT_FALSE(f->admit(cold, hot));
+    ASSERT_FALSE(f->admit(cold, cold));
+    ASSERT_TRUE(f->admit(cold, unknown));
+
+    delete f;
+}
+
+TEST_F(test_admit_filter, admit_filter_age) {
+    // 16 counters per row, aging after 160 increments.
+    auto f = new admit_filter(1);
+    uint64 hot = fnv64a("hot");
+
+    for (uint i = 0; i < 9; i++) {
+        f->record(hot);
+    }
+    ASSERT_EQ(f->estimate(hot), 9u);
+    ASSERT_FALSE(f->age());
+
+    for (uint64 k = 0; k < 1000 && !f->age(); k++) {
+        auto h = fnv64a("key_" + std::to_string(k));
+        f->record(h);
+        f->record(h);
+    }
+
+    // Counters halve and the doorkeeper forgets everything.
+    ASSERT_LE(f->estimate(hot), 8u);
+    ASSERT_GE(f->estimate(hot), 4u);
+    ASSERT_FALSE(f->age());
+
+    delete f;
+}
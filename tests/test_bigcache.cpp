@@ -76,4 +76,40 @@ TEST_F(test_bigcache, gigcache_parallel) {
     std::this_thread::sleep_for(std::chrono::seconds(15));
 
     delete bc;
-}
\ No newline at end of file
+}
+
+TEST_F(test_bigcache, bigcache_expire_now) {
+    auto bc = new BigCache(R"({"shards_cnt":4,"max_size":4194304,"expire_ns":600000000000})");
+    std::string data_s = this->data_pool[4];
+    const byte *data_b = reinterpret_cast<const byte*>(data_s.c_str());
+
+    ASSERT_EQ(bc->set("short_key", data_b, data_s.size(), 10000000), ERR_OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // Supervisor sleeps for the whole expire period, but the kick wakes it up.
+    bc->expire_now();
+    shard_stats st{};
+    for (uint i = 0; i < 100; i++) {
+        bc->stats(st);
+        if (st.expired > 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(st.expired, 1u);
+    ASSERT_EQ(st.expired_lazy, 0u);
+
+    // Only the shard with due entries was planned.
+    sched_stats sst{};
+    ASSERT_EQ(bc->sched(SCHED_TASK_EXPIRE, sst), ERR_OK);
+    ASSERT_GE(sst.cycles, 1u);
+    ASSERT_EQ(sst.shards_planned, 1u);
+    ASSERT_EQ(bc->sched(SCHED_TASK_VACUUM, sst), ERR_OK);
+    ASSERT_EQ(sst.cycles, 0u);
+    ASSERT_NE(bc->sched(2, sst), ERR_OK);
+
+    // Supervisors wake up on destruction, so it doesn't wait for the vacuum period.
+    auto time_s = std::chrono::steady_clock::now();
+    delete bc;
+    ASSERT_LT(std::chrono::steady_clock::now() - time_s, std::chrono::seconds(1));
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "epoch.h"
+
+class test_epoch : public ::testing::Test {};
+
+TEST_F(test_epoch, epoch_reclaim) {
+    auto e = new epoch_domain();
+    uint64 freed = 0;
+
+    // No readers - memory is released at once.
+    e->retire([&freed]() { freed++; });
+    ASSERT_EQ(e->reclaim(), 1u);
+    ASSERT_EQ(freed, 1u);
+
+    // Reader entered before retire holds the memory.
+    uint slot = e->enter();
+    ASSERT_NE(slot, EPOCH_NO_SLOT);
+    e->retire([&freed]() { freed++; });
+    ASSERT_EQ(e->reclaim(), 0u);
+    ASSERT_EQ(e->pending(), 1u);
+
+    // Reader entered after retire doesn't.
+    e->exit(slot);
+    slot = e->enter();
+    ASSERT_EQ(e->reclaim(), 1u);
+    ASSERT_EQ(freed, 2u);
+    e->exit(slot);
+
+    // Destructor releases the rest.
+    slot = e->enter();
+    e->retire([&freed]() { freed++; });
+    e->exit(slot);
+    delete e;
+    ASSERT_EQ(freed, 3u);
+}
+
+TEST_F(test_epoch, epoch_slots) {
+    auto e = new epoch_domain();
+    std::vector<uint> slots;
+    for (uint i = 0; i < EPOCH_SLOTS; i++) {
+        slots.push_back(e->enter());
+        ASSERT_NE(slots.back(), EPOCH_NO_SLOT);
+    }
+    ASSERT_EQ(e->enter(), EPOCH_NO_SLOT);
+    for (auto s : slots) {
+        e->exit(s);
+    }
+    delete e;
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include <set>
+#include "object_pool.h"
+#include "shard_entry.h"
+
+class test_object_pool : public ::testing::Test {};
+
+TEST_F(test_object_pool, object_pool_recycle) {
+    auto pool = new object_pool<shard_entry_free>();
+    std::vector<shard_entry_free*> objs;
+
+    for (uint64 i = 0; i < POOL_CHUNK_SIZE * 2 + 1; i++) {
+        objs.push_back(pool->alloc(i, i * 2, nullptr, nullptr));
+    }
+    ASSERT_EQ(pool->size(), POOL_CHUNK_SIZE * 2 + 1);
+    ASSERT_EQ(pool->capacity(), POOL_CHUNK_SIZE * 3);
+    for (uint64 i = 0; i < objs.size(); i++) {
+        ASSERT_EQ(objs[i]->offset, i);
+        ASSERT_EQ(objs[i]->len, i * 2);
+    }
+
+    // Released objects are reused, pool doesn't grow.
+    std::set<shard_entry_free*> released;
+    for (uint64 i = 0; i < objs.size(); i += 2) {
+        released.insert(objs[i]);
+        pool->free(objs[i]);
+    }
+    for (uint64 i = 0; i < released.size(); i++) {
+        auto f = pool->alloc(uint64(1), uint64(1), nullptr, nullptr);
+        ASSERT_EQ(released.count(f), 1u);
+    }
+    ASSERT_EQ(pool->capacity(), POOL_CHUNK_SIZE * 3);
+
+    delete pool;
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "const.h"
+#include "pacer.h"
+
+class test_pacer : public ::testing::Test {};
+
+TEST_F(test_pacer, pacer_quota) {
+    // 10% of 1s interval is 100ms, tasks cost 30ms each.
+    auto p = new pacer(10, 1000, 100);
+    std::vector<shard_load> loads(8, shard_load{0, 0, 10, 1000});
+    std::vector<uint> order;
+
+    // Cost is unknown yet, so the first cycle runs everything.
+    p->plan(loads, 1000000000, order);
+    ASSERT_EQ(order.size(), 8u);
+    p->account(8 * 30000000, order.size());
+
+    p->plan(loads, 1000000000, order);
+    ASSERT_EQ(order.size(), 3u);
+    p->account(3 * 30000000, order.size());
+
+    sched_stats st{};
+    p->get_stats(st);
+    ASSERT_EQ(st.cycles, 2u);
+    ASSERT_EQ(st.shards_planned, 11u);
+    ASSERT_EQ(st.shards_throttled, 5u);
+    ASSERT_EQ(st.quota, 3u);
+    ASSERT_EQ(st.cost_ns, 30000000u);
+    ASSERT_EQ(st.busy_ns, 11u * 30000000);
+    ASSERT_DOUBLE_EQ(st.cpu_usage, 0.09);
+
+    // Throttled shards go before the ones that were just run, at least one task runs even if nothing fits.
+    p->plan(loads, 1000000, order);
+    ASSERT_EQ(order.size(), 1u);
+
+    delete p;
+}
+
+TEST_F(test_pacer, pacer_order) {
+    auto p = new pacer(100, 1000, 100);
+    std::vector<shard_load> loads{
+        {0, 0, 10, 1000},
+        {0, 0, 0, 1000},
+        {0, 0, 30, 1000},
+        {0, 0, 20, 1000},
+    };
+    std::vector<uint> order;
+
+    // Idle shards are skipped, the rest go by reclaimable bytes.
+    p->plan(loads, 1000000000, order);
+    ASSERT_EQ(order, std::vector<uint>({2, 3, 0}));
+
+    sched_stats st{};
+    p->get_stats(st);
+    ASSERT_EQ(st.reclaimable, 60u);
+
+    delete p;
+}
+
+TEST_F(test_pacer, pacer_hot) {
+    auto p = new pacer(100, 1000, 100);
+    std::vector<shard_load> loads(2, shard_load{0, 0, 10, 1000});
+    std::vector<uint> order;
+    p->plan(loads, 1000000000, order);
+
+    // Shard 0 is hot: half of its writes waited for the lock.
+    uint defers = 0;
+    for (uint c = 0; c < PACER_MAX_DEFER + 1; c++) {
+        loads[0].ops += 100;
+        loads[0].contended += 50;
+        loads[1].ops += 100;
+        p->plan(loads, 1000000000, order);
+        if (order == std::vector<uint>({1})) {
+            defers++;
+        } else {
+            // Deferred too long, so it runs first despite the contention.
+            ASSERT_EQ(order, std::vector<uint>({0, 1}));
+        }
+    }
+    ASSERT_EQ(defers, PACER_MAX_DEFER);
+
+    sched_stats st{};
+    p->get_stats(st);
+    ASSERT_EQ(st.shards_hot, uint64(PACER_MAX_DEFER));
+    ASSERT_EQ(st.ops, 200u * (PACER_MAX_DEFER + 1));
+    ASSERT_EQ(st.contended, 50u * (PACER_MAX_DEFER + 1));
+
+    delete p;
+}
+
+TEST_F(test_pacer, pacer_period) {
+    auto p = new pacer(100, 1000, 100);
+    std::vector<shard_load> loads(2, shard_load{0, 0, 0, 1000});
+    std::vector<uint> order;
+    ASSERT_EQ(p->get_period(), 1000u);
+
+    // Half of memory is reclaimable, so the period shrinks down to the min.
+    loads[0].reclaimable = 1000;
+    for (uint c = 0; c < 5; c++) {
+        p->plan(loads, 1000000000, order);
+    }
+    ASSERT_EQ(p->get_period(), 100u);
+    sched_stats st{};
+    p->get_stats(st);
+    ASSERT_EQ(st.accelerations, 4u);
+    ASSERT_EQ(st.period_ns, 100u);
+
+    // Little reclaimable memory, the period goes back.
+    loads[0].reclaimable = 10;
+    for (uint c = 0; c < 5; c++) {
+        p->plan(loads, 1000000000, order);
+    }
+    ASSERT_EQ(p->get_period(), 1000u);
+
+    delete p;
+}
@@ -0,0 +1,950 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "helpers.h"
+#include "shard.h"
+
+class test_shard : public ::testing::Test {
+
+public:
+    debug *dbg = new debug(VERBOSE_LVL_NONE);
+
+    shard_config make_cfg(uint64 max_size, uint64 expire_ns, uint storage) {
+        shard_config cfg;
+        cfg.max_size = max_size;
+        cfg.expire_ns = expire_ns;
+        cfg.storage = storage;
+        return cfg;
+    }
+
+    std::string lease_str(const shard_lease &l) {
+        std::string s;
+        for (uint64 i = 0; i < l.segs_cnt; i++) {
+            s.append(reinterpret_cast<const char*>(l.segs[i].ptr), l.segs[i].len);
+        }
+        return s;
+    }
+
+    std::string make_val(uint len, char base) {
+        std::string s;
+        for (uint i = 0; i < len; i++) {
+            s += char(base + i % 26);
+        }
+        return s;
+    }
+};
+
+TEST_F(test_shard, shard_span_cross_page) {
+    // Page size is 10% of the shard, i.e. 100 bytes.
+    auto shrd = new Shard(0, this->make_cfg(1000, 60000000000, STORAGE_PAGES), this->dbg);
+
+    auto val = this->make_val(350, 'a');
+    ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+
+    byte *buf = new byte[512];
+    ASSERT_EQ(shrd->get(1, buf, 512), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_span_large) {
+    auto shrd = new Shard(0, this->make_cfg(4194304, 60000000000, STORAGE_PAGES), this->dbg);
+
+    // Long enough to take non-temporal path.
+    auto val = this->make_val(NT_COPY_MIN_LEN * 2 + 7, 'A');
+    ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+
+    byte *buf = new byte[val.size() + 1];
+    ASSERT_EQ(shrd->get(1, buf, uint(val.size() + 1)), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_binary_safe) {
+    // Payload with zero bytes inside and at the end.
+    std::string val("\000ab\000\000cd\000", 8);
+    for (uint storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto shrd = new Shard(0, this->make_cfg(1000, 60000000000, storage), this->dbg);
+        ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+
+        byte *buf = new byte[64];
+        uint64 len_f = 0;
+        ASSERT_EQ(shrd->get(1, buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), val);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_get_len) {
+    for (uint storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto shrd = new Shard(0, this->make_cfg(1000, 60000000000, storage), this->dbg);
+        auto val = this->make_val(150, 'a');
+        ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+
+        uint64 len_f = 0;
+        ASSERT_EQ(shrd->len(1, len_f), ERR_OK);
+        ASSERT_EQ(len_f, val.size());
+        ASSERT_EQ(shrd->len(2, len_f), ERR_KEY_NOT_FOUND);
+
+        // Small buffer reports the required length.
+        byte *buf = new byte[val.size()];
+        len_f = 0;
+        ASSERT_EQ(shrd->get(1, buf, 10, len_f), ERR_BUF_LEN_LOW);
+        ASSERT_EQ(len_f, val.size());
+
+        // Buffer of exact size is enough, no room for terminator needed.
+        len_f = 0;
+        ASSERT_EQ(shrd->get(1, buf, val.size(), len_f), ERR_OK);
+        ASSERT_EQ(len_f, val.size());
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), val);
+
+        // Null-terminated getter needs one more byte.
+        ASSERT_EQ(shrd->get(1, buf, uint(val.size())), ERR_BUF_LEN_LOW);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_key_collision) {
+    std::string k0("key_0"), k1("key_1"), v0("value of the first key"), v1("value of the second key");
+    auto kb0 = reinterpret_cast<const byte*>(k0.data());
+    auto kb1 = reinterpret_cast<const byte*>(k1.data());
+    for (uint mode : {READ_MODE_LOCKED, READ_MODE_OPTIMISTIC})
+    for (uint storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto cfg = this->make_cfg(10000, 60000000000, storage);
+        cfg.read_mode = mode;
+        auto shrd = new Shard(0, cfg, this->dbg);
+
+        // Both keys have the same hash, but they are different entries.
+        ASSERT_EQ(shrd->set(7, kb0, k0.size(), reinterpret_cast<const byte*>(v0.data()), v0.size()), ERR_OK);
+        ASSERT_EQ(shrd->set(7, kb1, k1.size(), reinterpret_cast<const byte*>(v1.data()), v1.size()), ERR_OK);
+        ASSERT_EQ(shrd->set(7, kb1, k1.size(), reinterpret_cast<const byte*>(v1.data()), v1.size()), ERR_KEY_EXISTS);
+
+        byte *buf = new byte[64];
+        uint64 len_f = 0;
+        ASSERT_EQ(shrd->get(7, kb0, k0.size(), buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), v0);
+        ASSERT_EQ(shrd->get(7, kb1, k1.size(), buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), v1);
+        ASSERT_EQ(shrd->len(7, kb1, k1.size(), len_f), ERR_OK);
+        ASSERT_EQ(len_f, v1.size());
+        ASSERT_EQ(shrd->get(7, buf, 64, len_f), ERR_KEY_NOT_FOUND);
+
+        // Overwrite of one key keeps the other.
+        ASSERT_EQ(shrd->fset(7, kb0, k0.size(), reinterpret_cast<const byte*>(v1.data()), v1.size()), ERR_OK);
+        ASSERT_EQ(shrd->get(7, kb1, k1.size(), buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), v1);
+        ASSERT_EQ(shrd->evict(7, kb1, k1.size()), ERR_OK);
+        ASSERT_EQ(shrd->get(7, kb1, k1.size(), buf, 64, len_f), ERR_KEY_NOT_FOUND);
+        ASSERT_EQ(shrd->get(7, kb0, k0.size(), buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), v1);
+
+        // Relocated entry keeps its key.
+        ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+        ASSERT_EQ(shrd->get(7, kb0, k0.size(), buf, 64, len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), v1);
+
+        std::string k_long(MAX_KEY_LEN + 1, 'k');
+        ASSERT_EQ(shrd->set(8, reinterpret_cast<const byte*>(k_long.data()), k_long.size(),
+                            reinterpret_cast<const byte*>(v0.data()), v0.size()), ERR_KEY_TOO_LONG);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_get_null_buf) {
+    for (uint mode : {READ_MODE_LOCKED, READ_MODE_OPTIMISTIC})
+    for (uint storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto cfg = this->make_cfg(10000, 60000000000, storage);
+        cfg.read_mode = mode;
+        auto shrd = new Shard(0, cfg, this->dbg);
+        auto val = this->make_val(100, 'a');
+        ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+
+        // Null buffer isn't a length probe, both read modes report it as too small.
+        byte *buf = nullptr;
+        uint64 len_f = 0;
+        ASSERT_EQ(shrd->get(1, buf, 0, len_f), ERR_BUF_LEN_LOW);
+        ASSERT_EQ(len_f, val.size());
+        ASSERT_EQ(shrd->len(1, len_f), ERR_OK);
+        ASSERT_EQ(len_f, val.size());
+
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_concurrent_read) {
+    for (uint mode : {READ_MODE_LOCKED, READ_MODE_OPTIMISTIC})
+    for (uint storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto cfg = this->make_cfg(1000000, 60000000000, storage);
+        cfg.read_mode = mode;
+        auto shrd = new Shard(0, cfg, this->dbg);
+        for (uint64 k = 0; k < 256; k++) {
+            auto val = this->make_val(200, 'a');
+            ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+        }
+
+        // Readers run concurrently with the writer and must never see torn values.
+        std::vector<std::thread> readers;
+        std::vector<uint> torn(4, 0);
+        for (uint t = 0; t < torn.size(); t++) {
+            readers.emplace_back([this, shrd, t, &torn]() {
+                byte buf[256];
+                byte *buf_p = buf;
+                uint64 len_f = 0;
+                for (uint i = 0; i < 20000; i++) {
+                    if (shrd->get(i % 256, buf_p, sizeof(buf), len_f) != ERR_OK) {
+                        continue;
+                    }
+                    auto val = std::string(reinterpret_cast<char*>(buf), len_f);
+                    if (len_f != 200 || val != this->make_val(200, char(buf[0]))) {
+                        torn[t]++;
+                    }
+                }
+            });
+        }
+        for (uint i = 0; i < 20000; i++) {
+            auto val = this->make_val(200, char('a' + i % 26));
+            ASSERT_EQ(shrd->fset(i % 256, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+            // Move entries and release pages under the readers as well.
+            if (i % 5000 == 4999) {
+                for (uint64 k = 0; k < 256; k += 2) {
+                    shrd->evict(k);
+                }
+                ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+            }
+        }
+        for (auto &r : readers) {
+            r.join();
+        }
+        for (auto c : torn) {
+            ASSERT_EQ(c, 0);
+        }
+
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_lease) {
+    // Page size is 100 bytes, so the value spans several segments.
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    auto shrd = new Shard(0, cfg, this->dbg);
+    std::string key = "lease_key";
+    auto k = reinterpret_cast<const byte*>(key.data());
+    auto val = this->make_val(250, 'a');
+    auto val_n = this->make_val(100, 'A');
+    shard_stats st{};
+    shard_lease l{};
+
+    ASSERT_EQ(shrd->lease(1, k, uint(key.size()), l), ERR_KEY_NOT_FOUND);
+    ASSERT_EQ(shrd->set(1, k, uint(key.size()), reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+    ASSERT_EQ(shrd->lease(1, k, uint(key.size()), l), ERR_OK);
+    ASSERT_EQ(l.len, val.size());
+    ASSERT_GE(l.segs_cnt, 3);
+    ASSERT_EQ(this->lease_str(l), val);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.leases, 1);
+
+    // Overwritten and evicted entry keeps its bytes and space till the release.
+    ASSERT_EQ(shrd->fset(1, k, uint(key.size()), reinterpret_cast<const byte*>(val_n.data()), val_n.size()), ERR_OK);
+    byte *buf = new byte[512];
+    uint64 len_f = 0;
+    ASSERT_EQ(shrd->get(1, k, uint(key.size()), buf, 512, len_f), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), val_n);
+    ASSERT_EQ(shrd->evict(1, k, uint(key.size())), ERR_OK);
+    ASSERT_EQ(this->lease_str(l), val);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.entries, 0);
+    ASSERT_EQ(st.sz_used, Shard::head_size(cfg) + key.size() + val.size());
+
+    shrd->release(l);
+    ASSERT_EQ(l.segs, nullptr);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.leases, 0);
+    ASSERT_EQ(st.sz_used, 0);
+    ASSERT_EQ(st.free_blocks, 1);
+
+    // Vacuum doesn't move leased entry.
+    ASSERT_EQ(shrd->set(2, reinterpret_cast<const byte*>(val_n.data()), val_n.size()), ERR_OK);
+    ASSERT_EQ(shrd->set(3, reinterpret_cast<const byte*>(val_n.data()), val_n.size()), ERR_OK);
+    ASSERT_EQ(shrd->lease(3, nullptr, 0, l), ERR_OK);
+    ASSERT_EQ(shrd->evict(2), ERR_OK);
+    ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.vacuum_moved, 0);
+    ASSERT_EQ(this->lease_str(l), val_n);
+    shrd->release(l);
+    ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.vacuum_moved, 1);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_lease_ring) {
+    // Room for 10 records of 100 bytes (header included).
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_RING);
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto len = 100 - Shard::head_size(cfg);
+    auto val = this->make_val(uint(len), 'a');
+    shard_lease l{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.data()), len), ERR_OK);
+    }
+
+    // Leased record blocks the tail.
+    ASSERT_EQ(shrd->lease(1, nullptr, 0, l), ERR_OK);
+    ASSERT_EQ(l.segs_cnt, 1);
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val.data()), len), ERR_NO_SPACE);
+    ASSERT_EQ(shrd->evict(1), ERR_OK);
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val.data()), len), ERR_NO_SPACE);
+    ASSERT_EQ(this->lease_str(l), val);
+
+    shrd->release(l);
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val.data()), len), ERR_OK);
+
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_page_alloc) {
+    auto val = this->make_val(3000000, 'a');
+    for (uint mode : {PAGE_ALLOC_HEAP, PAGE_ALLOC_MMAP, PAGE_ALLOC_THP, PAGE_ALLOC_HUGETLB}) {
+        auto cfg = this->make_cfg(8 * HUGE_PAGE_SIZE, 60000000000, STORAGE_PAGES);
+        cfg.page_alloc = mode;
+        cfg.page_populate = true;
+        auto shrd = new Shard(0, cfg, this->dbg);
+        ASSERT_EQ(shrd->set(1, reinterpret_cast<const byte*>(val.data()), val.size()), ERR_OK);
+
+        std::vector<byte> buf(val.size());
+        byte *buf_p = buf.data();
+        uint64 len_f = 0;
+        ASSERT_EQ(shrd->get(1, buf_p, buf.size(), len_f), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf_p), len_f), val);
+
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_page_release) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.page_release_keep = 1;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    byte *buf = new byte[128];
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    }
+    shrd->get_stats(st);
+    ASSERT_EQ(st.sz_alloc, 1000u);
+
+    // All pages became empty, only one of them stays allocated.
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->evict(k), ERR_OK);
+    }
+    ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.sz_alloc, 100u);
+    ASSERT_EQ(st.pages_released, 9u);
+    ASSERT_LE(st.sz_resident, st.sz_alloc);
+
+    // Released pages are reserved again on write.
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    }
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 128), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+    }
+    shrd->get_stats(st);
+    ASSERT_EQ(st.sz_alloc, 1000u);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_ring_wrap) {
+    // Room for 10 records of 100 bytes (header included).
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_RING);
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto len = 100 - Shard::head_size(cfg);
+
+    byte *buf = new byte[128];
+    for (uint64 k = 1; k <= 25; k++) {
+        auto val = this->make_val(uint(len), char('a' + k % 26));
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+        // The newest record is always available.
+        ASSERT_EQ(shrd->get(k, buf, 128), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+    }
+
+    // Oldest records are evicted FIFO.
+    for (uint64 k = 1; k <= 15; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 128), ERR_KEY_NOT_FOUND);
+    }
+    for (uint64 k = 16; k <= 25; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 128), ERR_OK);
+    }
+
+    // Records of other length force padding at the end of the ring.
+    auto val = this->make_val(uint(len + 30), 'z');
+    ASSERT_EQ(shrd->fset(25, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    ASSERT_EQ(shrd->get(25, buf, 128), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+    ASSERT_EQ(shrd->set(25, reinterpret_cast<const byte*>(val.c_str())), ERR_KEY_EXISTS);
+
+    ASSERT_EQ(shrd->evict(24), ERR_OK);
+    ASSERT_EQ(shrd->get(24, buf, 128), ERR_KEY_NOT_FOUND);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_ring_expire) {
+    auto shrd = new Shard(0, this->make_cfg(1000, 1, STORAGE_RING), this->dbg);
+
+    auto val = this->make_val(50, 'a');
+    byte *buf = new byte[128];
+    for (uint64 k = 1; k <= 5; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    }
+    ASSERT_EQ(shrd->get(1, buf, 128), ERR_KEY_EXPIRED);
+
+    ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+    for (uint64 k = 1; k <= 5; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 128), ERR_KEY_NOT_FOUND);
+    }
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_ttl) {
+    for (auto storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto shrd = new Shard(0, this->make_cfg(1000, 60000000000, storage), this->dbg);
+        auto val = this->make_val(50, 'a');
+        auto v = reinterpret_cast<const byte*>(val.data());
+        byte *buf = new byte[128];
+        uint64 len_f = 0;
+
+        // Short-lived entry goes first, so the ring tail may reclaim it.
+        ASSERT_EQ(shrd->set(1, nullptr, 0, v, val.size(), 20000000), ERR_OK);
+        ASSERT_EQ(shrd->set(2, nullptr, 0, v, val.size()), ERR_OK);
+        ASSERT_EQ(shrd->fset(3, nullptr, 0, v, val.size(), UINT64_MAX), ERR_OK);
+        ASSERT_EQ(shrd->get(1, buf, 128, len_f), ERR_OK);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        ASSERT_EQ(shrd->get(1, buf, 128, len_f), ERR_KEY_EXPIRED);
+        ASSERT_EQ(shrd->get(2, buf, 128, len_f), ERR_OK);
+        ASSERT_EQ(shrd->get(3, buf, 128, len_f), ERR_OK);
+
+        ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+        ASSERT_EQ(shrd->get(1, buf, 128, len_f), ERR_KEY_NOT_FOUND);
+        ASSERT_EQ(shrd->get(2, buf, 128, len_f), ERR_OK);
+        ASSERT_EQ(shrd->get(3, buf, 128, len_f), ERR_OK);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_expire_wheel) {
+    auto shrd = new Shard(0, this->make_cfg(100000, 60000000000, STORAGE_PAGES), this->dbg);
+    auto val = this->make_val(100, 'a');
+    auto v = reinterpret_cast<const byte*>(val.data());
+    byte *buf = new byte[128];
+    uint64 len_f = 0;
+    shard_stats st{};
+
+    // Lifetimes hit the first and the second levels of the wheel, the third one and the overflow list.
+    const uint64 ttls[] = {5000000, 80000000, 10000000000, 6ull * 3600 * 1000000000};
+    for (uint64 k = 1; k <= 80; k++) {
+        ASSERT_EQ(shrd->set(k, nullptr, 0, v, val.size(), ttls[k % 4]), ERR_OK);
+    }
+    // Overwrite moves the entry in the wheel.
+    ASSERT_EQ(shrd->fset(4, nullptr, 0, v, val.size(), ttls[2]), ERR_OK);
+    ASSERT_EQ(shrd->fset(2, nullptr, 0, v, val.size(), ttls[0]), ERR_OK);
+    // Evicted entries leave the wheel, relocated ones keep their place.
+    for (uint64 k = 1; k <= 80; k += 5) {
+        ASSERT_EQ(shrd->evict(k), ERR_OK);
+    }
+    ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_GT(st.vacuum_moved, 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+    uint64 alive = 0;
+    for (uint64 k = 1; k <= 80; k++) {
+        auto err = shrd->get(k, buf, 128, len_f);
+        bool expired = (k % 4 < 2 && k != 4) || k == 2;
+        if (k % 5 == 1 || expired) {
+            ASSERT_EQ(err, ERR_KEY_NOT_FOUND) << "key " << k;
+        } else {
+            ASSERT_EQ(err, ERR_OK) << "key " << k;
+            alive++;
+        }
+    }
+    shrd->get_stats(st);
+    ASSERT_EQ(st.entries, alive);
+
+    // Nothing else expires.
+    ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.entries, alive);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_expire_lazy) {
+    for (auto storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto shrd = new Shard(0, this->make_cfg(1000, 60000000000, storage), this->dbg);
+        auto val = this->make_val(50, 'a');
+        auto v = reinterpret_cast<const byte*>(val.data());
+        byte *buf = new byte[128];
+        uint64 len_f = 0;
+        shard_stats st{};
+
+        ASSERT_EQ(shrd->expire_next(), UINT64_MAX);
+        auto now = unix_time_now_ns();
+        ASSERT_EQ(shrd->set(1, nullptr, 0, v, val.size(), 20000000), ERR_OK);
+        ASSERT_EQ(shrd->set(2, nullptr, 0, v, val.size(), 20000000), ERR_OK);
+        ASSERT_EQ(shrd->set(3, nullptr, 0, v, val.size(), 20000000), ERR_OK);
+        ASSERT_EQ(shrd->set(4, nullptr, 0, v, val.size()), ERR_OK);
+        // Wheel reports the beginning of the slot, it never comes later than the expiration.
+        auto next = shrd->expire_next();
+        ASSERT_GT(next, now);
+        ASSERT_LE(next, unix_time_now_ns() + 20000000 + EXPIRE_RESOLUTION_NS);
+
+        // Nothing is due yet.
+        ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+        shrd->get_stats(st);
+        ASSERT_EQ(st.entries, 4);
+        ASSERT_EQ(st.expired, 0);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        ASSERT_LE(shrd->expire_next(), unix_time_now_ns());
+
+        // Reads evict the expired entry at once, write replaces it even without force.
+        ASSERT_EQ(shrd->get(1, buf, 128, len_f), ERR_KEY_EXPIRED);
+        ASSERT_EQ(shrd->get(1, buf, 128, len_f), ERR_KEY_NOT_FOUND);
+        ASSERT_EQ(shrd->len(2, len_f), ERR_KEY_EXPIRED);
+        ASSERT_EQ(shrd->len(2, len_f), ERR_KEY_NOT_FOUND);
+        ASSERT_EQ(shrd->set(3, nullptr, 0, v, val.size()), ERR_OK);
+        ASSERT_EQ(shrd->get(3, buf, 128, len_f), ERR_OK);
+        shrd->get_stats(st);
+        ASSERT_EQ(st.entries, 2);
+        ASSERT_EQ(st.expired, 3);
+        ASSERT_EQ(st.expired_lazy, 3);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_expire_batch) {
+    for (auto storage : {STORAGE_PAGES, STORAGE_RING}) {
+        auto cfg = this->make_cfg(1000000, 60000000000, storage);
+        cfg.expire_batch = 16;
+        cfg.expire_budget_us = 1000000;
+        auto shrd = new Shard(0, cfg, this->dbg);
+        auto val = this->make_val(50, 'a');
+        auto v = reinterpret_cast<const byte*>(val.data());
+        byte *buf = new byte[128];
+        uint64 len_f = 0;
+        shard_stats st{};
+
+        // Expiring entries share the same tick, so the single slot is drained by many batches.
+        for (uint64 k = 1; k <= 1000; k++) {
+            ASSERT_EQ(shrd->set(k, nullptr, 0, v, val.size(), k <= 800 ? 5000000 : 0), ERR_OK);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ASSERT_EQ(shrd->bulk_expire(), ERR_OK);
+        for (uint64 k = 1; k <= 1000; k++) {
+            ASSERT_EQ(shrd->get(k, buf, 128, len_f), k <= 800 ? ERR_KEY_NOT_FOUND : ERR_OK) << "key " << k;
+        }
+
+        shrd->get_stats(st);
+        ASSERT_EQ(st.entries, 200u);
+        ASSERT_EQ(st.expired, 800u);
+        uint64 holds = 0;
+        for (auto h : st.expire_hold_hist) {
+            holds += h;
+        }
+        ASSERT_GE(holds, 800u / 16);
+        ASSERT_GT(st.expire_hold_max, 0u);
+
+        delete[] buf;
+        delete shrd;
+    }
+}
+
+TEST_F(test_shard, shard_alloc_coalesce) {
+    // Full shard rejects writes without eviction.
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_NONE;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    // Every entry takes exactly 100 bytes, header included.
+    auto len = 100 - Shard::head_size(cfg);
+    auto val = this->make_val(uint(len), 'a');
+    auto val_l = this->make_val(uint(len * 3 - 10), 'A');
+    byte *buf = new byte[512];
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    }
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val.c_str())), ERR_NO_SPACE);
+
+    // Make five holes of 100 bytes.
+    for (uint64 k = 1; k <= 10; k += 2) {
+        ASSERT_EQ(shrd->evict(k), ERR_OK);
+    }
+    shrd->get_stats(st);
+    ASSERT_EQ(st.free_blocks, 5u);
+    ASSERT_EQ(st.free_largest, 100u);
+    ASSERT_DOUBLE_EQ(st.frag_ratio, 0.8);
+
+    // Large value has to be chained over three holes.
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val_l.c_str())), ERR_OK);
+    ASSERT_EQ(shrd->get(11, buf, 512), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val_l);
+    // Only the first block takes the whole header, continuation ones take the short one.
+    shrd->get_stats(st);
+    ASSERT_EQ(st.chain_blocks, 8u);
+    ASSERT_EQ(st.sz_used, 500 + Shard::head_size(cfg) + 2 * ENTRY_HDR_CONT_SIZE + val_l.size());
+    ASSERT_EQ(Shard::head_size(cfg), ENTRY_HDR_HEAD_SIZE);
+    ASSERT_EQ(Shard::head_size(this->make_cfg(1000, 0, STORAGE_RING)), sizeof(shard_ring_hdr));
+
+    // Evict the neighbours: holes merge into the large blocks.
+    for (uint64 k = 2; k <= 10; k += 2) {
+        ASSERT_EQ(shrd->evict(k), ERR_OK);
+    }
+    ASSERT_EQ(shrd->evict(11), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.free_blocks, 1u);
+    ASSERT_EQ(st.free_largest, 1000u);
+    ASSERT_DOUBLE_EQ(st.frag_ratio, 0);
+    ASSERT_EQ(st.entries, 0u);
+
+    // Whole space is available for the single block again.
+    auto val_x = this->make_val(900, 'a');
+    ASSERT_EQ(shrd->set(12, reinterpret_cast<const byte*>(val_x.c_str())), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.chain_blocks, 1u);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_vacuum) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto len = 100 - Shard::head_size(cfg);
+    auto val = this->make_val(uint(len), 'a');
+    auto val_l = this->make_val(uint(len * 3 - 10), 'A');
+    byte *buf = new byte[512];
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+    }
+    for (uint64 k = 1; k <= 10; k += 2) {
+        ASSERT_EQ(shrd->evict(k), ERR_OK);
+    }
+    ASSERT_EQ(shrd->set(11, reinterpret_cast<const byte*>(val_l.c_str())), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_GT(st.chain_avg, 1);
+    ASSERT_GT(st.frag_ratio, 0);
+
+    for (uint i = 0; i < 3; i++) {
+        ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+    }
+
+    // Entries packed to the beginning and became single blocks, free space is contiguous.
+    shrd->get_stats(st);
+    ASSERT_EQ(st.free_blocks, 1u);
+    ASSERT_EQ(st.free_largest, 1000 - 500 - Shard::head_size(cfg) - val_l.size());
+    ASSERT_DOUBLE_EQ(st.frag_ratio, 0);
+    ASSERT_DOUBLE_EQ(st.chain_avg, 1);
+    ASSERT_GT(st.vacuum_moved, 0u);
+
+    for (uint64 k = 2; k <= 10; k += 2) {
+        ASSERT_EQ(shrd->get(k, buf, 512), ERR_OK);
+        ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val);
+    }
+    ASSERT_EQ(shrd->get(11, buf, 512), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf)), val_l);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_evict_clock) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_CLOCK;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    // Room for 10 entries of 100 bytes (header included).
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    const byte *val_b = reinterpret_cast<const byte*>(val.c_str());
+    byte *buf = new byte[512];
+    shard_lease l{};
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_OK);
+    }
+
+    // Read entry gets the second chance, the next one is evicted.
+    ASSERT_EQ(shrd->get(1, buf, 512), ERR_OK);
+    ASSERT_EQ(shrd->set(11, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(2, buf, 512), ERR_KEY_NOT_FOUND);
+    ASSERT_EQ(shrd->get(1, buf, 512), ERR_OK);
+
+    // Leased entry can't free space, so it's skipped.
+    ASSERT_EQ(shrd->lease(3, nullptr, 0, l), ERR_OK);
+    ASSERT_EQ(shrd->set(12, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(4, buf, 512), ERR_KEY_NOT_FOUND);
+    ASSERT_EQ(this->lease_str(l), val);
+    shrd->release(l);
+    ASSERT_EQ(shrd->get(3, buf, 512), ERR_OK);
+
+    shrd->get_stats(st);
+    ASSERT_EQ(st.evicted, 2u);
+    ASSERT_EQ(st.entries, 10u);
+    ASSERT_EQ(st.sz_used, 1000u);
+
+    // Entry larger than the shard is rejected anyway.
+    auto val_l = this->make_val(1000, 'A');
+    ASSERT_EQ(shrd->set(13, reinterpret_cast<const byte*>(val_l.c_str())), ERR_NO_SPACE);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_evict_s3fifo) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_S3FIFO;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    // Room for 10 entries, the small queue takes one of them.
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    const byte *val_b = reinterpret_cast<const byte*>(val.c_str());
+    byte *buf = new byte[512];
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_OK);
+    }
+
+    // Entry that wasn't read leaves the small queue to the ghost, the read one moves to the main queue.
+    ASSERT_EQ(shrd->set(11, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(1, buf, 512), ERR_KEY_NOT_FOUND);
+    ASSERT_EQ(shrd->get(2, buf, 512), ERR_OK);
+    ASSERT_EQ(shrd->set(12, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(2, buf, 512), ERR_OK);
+    ASSERT_EQ(shrd->get(3, buf, 512), ERR_KEY_NOT_FOUND);
+
+    // Key from the ghost returns straight to the main queue.
+    ASSERT_EQ(shrd->set(1, val_b), ERR_OK);
+
+    // Scan of new keys churns through the small queue and doesn't touch the main one.
+    for (uint64 k = 100; k < 130; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_OK);
+    }
+    ASSERT_EQ(shrd->get(1, buf, 512), ERR_OK);
+    ASSERT_EQ(shrd->get(2, buf, 512), ERR_OK);
+    ASSERT_EQ(shrd->get(4, buf, 512), ERR_KEY_NOT_FOUND);
+
+    shrd->get_stats(st);
+    ASSERT_EQ(st.evicted, 33u);
+    ASSERT_EQ(st.entries, 10u);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_evict_vacuum) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_CLOCK;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    const byte *val_b = reinterpret_cast<const byte*>(val.c_str());
+    byte *buf = new byte[512];
+    shard_stats st{};
+
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_OK);
+    }
+    ASSERT_EQ(shrd->evict(1), ERR_OK);
+    ASSERT_EQ(shrd->evict(3), ERR_OK);
+    ASSERT_EQ(shrd->bulk_vacuum(), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_GT(st.vacuum_moved, 0u);
+
+    // Moved entries keep their places in the queue, so the oldest ones are evicted first.
+    ASSERT_EQ(shrd->set(11, val_b), ERR_OK);
+    ASSERT_EQ(shrd->set(12, val_b), ERR_OK);
+    ASSERT_EQ(shrd->set(13, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(2, buf, 512), ERR_KEY_NOT_FOUND);
+    ASSERT_EQ(shrd->set(14, val_b), ERR_OK);
+    ASSERT_EQ(shrd->get(4, buf, 512), ERR_KEY_NOT_FOUND);
+    for (uint64 k = 5; k <= 14; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 512), ERR_OK);
+    }
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_admission) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_CLOCK;
+    cfg.admission = true;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    const byte *val_b = reinterpret_cast<const byte*>(val.c_str());
+    byte *buf = new byte[512];
+    shard_stats st{};
+
+    // Space is free, so everything is admitted.
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_OK);
+        for (uint i = 0; i < 3; i++) {
+            ASSERT_EQ(shrd->get(k, buf, 512), ERR_OK);
+        }
+    }
+
+    // One-hit keys of the scan don't replace the popular ones.
+    for (uint64 k = 100; k < 130; k++) {
+        ASSERT_EQ(shrd->set(k, val_b), ERR_NOT_ADMITTED);
+    }
+    for (uint64 k = 1; k <= 10; k++) {
+        ASSERT_EQ(shrd->get(k, buf, 512), ERR_OK);
+    }
+    shrd->get_stats(st);
+    ASSERT_EQ(st.rejected, 30u);
+    ASSERT_EQ(st.evicted, 0u);
+    ASSERT_EQ(st.entries, 10u);
+
+    // Key that keeps missing becomes popular enough.
+    error err = ERR_NOT_ADMITTED;
+    uint tries = 0;
+    while (err == ERR_NOT_ADMITTED && tries < 20) {
+        err = shrd->set(200, val_b);
+        tries++;
+    }
+    ASSERT_EQ(err, ERR_OK);
+    ASSERT_GT(tries, 1u);
+    ASSERT_EQ(shrd->get(200, buf, 512), ERR_OK);
+    shrd->get_stats(st);
+    ASSERT_EQ(st.evicted, 1u);
+    ASSERT_EQ(st.entries, 10u);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_admission_overwrite) {
+    auto cfg = this->make_cfg(1000, 60000000000, STORAGE_PAGES);
+    cfg.evict_policy = EVICT_POLICY_CLOCK;
+    cfg.admission = true;
+    auto shrd = new Shard(0, cfg, this->dbg);
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    byte *buf = new byte[512];
+    uint64 len_f = 0;
+    shard_stats st{};
+
+    // Popular keys and the single cold one fill the shard.
+    for (uint64 k = 1; k <= 9; k++) {
+        ASSERT_EQ(shrd->set(k, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+        for (uint i = 0; i < 3; i++) {
+            ASSERT_EQ(shrd->get(k, buf, 512), ERR_OK);
+        }
+    }
+    ASSERT_EQ(shrd->set(10, reinterpret_cast<const byte*>(val.c_str())), ERR_OK);
+
+    // Larger value of the cold key needs space of the popular one, but the resident key isn't subject to admission.
+    auto val_l = this->make_val(uint(150 - Shard::head_size(cfg)), 'b');
+    ASSERT_EQ(shrd->fset(10, reinterpret_cast<const byte*>(val_l.c_str()), val_l.size()), ERR_OK);
+    ASSERT_EQ(shrd->get(10, buf, 512, len_f), ERR_OK);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), len_f), val_l);
+
+    shrd->get_stats(st);
+    // Chained value takes one more header, so it may take more than one victim.
+    ASSERT_EQ(st.rejected, 0u);
+    ASSERT_GT(st.evicted, 0u);
+
+    delete[] buf;
+    delete shrd;
+}
+
+TEST_F(test_shard, shard_load_reclaimable) {
+    auto cfg = this->make_cfg(10000, 60000000000, STORAGE_PAGES);
+    auto small = new Shard(0, cfg, this->dbg);
+    cfg.max_size = 1000000;
+    auto large = new Shard(1, cfg, this->dbg);
+    // Every entry takes exactly 100 bytes, header included.
+    auto val = this->make_val(uint(100 - Shard::head_size(cfg)), 'a');
+    const byte *val_b = reinterpret_cast<const byte*>(val.c_str());
+    auto val_l = this->make_val(uint(1000 - Shard::head_size(cfg)), 'b');
+    const byte *val_lb = reinterpret_cast<const byte*>(val_l.c_str());
+
+    // Small shard is mostly due, the large one has a single due entry among the live ones.
+    for (uint64 k = 0; k < 50; k++) {
+        ASSERT_EQ(small->set(k, nullptr, 0, val_b, val.size(), 1000000), ERR_OK);
+    }
+    for (uint64 k = 0; k < 500; k++) {
+        ASSERT_EQ(large->set(k, val_lb, val_l.size()), ERR_OK);
+    }
+    ASSERT_EQ(large->set(1000, nullptr, 0, val_b, val.size(), 1000000), ERR_OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+    std::vector<shard_load> loads(2);
+    small->get_load(SCHED_TASK_EXPIRE, loads[0]);
+    large->get_load(SCHED_TASK_EXPIRE, loads[1]);
+    ASSERT_EQ(loads[0].reclaimable, 5000u);
+    ASSERT_EQ(loads[0].size, 5000u);
+    ASSERT_EQ(loads[1].reclaimable, 100u);
+    ASSERT_EQ(loads[1].size, 500100u);
+
+    // The pacer runs the shard with more reclaimable bytes first, though it's much smaller.
+    auto p = new pacer(100, 1000000000, 100000000);
+    std::vector<uint> order;
+    p->plan(loads, 1000000000, order);
+    ASSERT_EQ(order, std::vector<uint>({0, 1}));
+
+    // Expired entries are gone, so nothing is due anymore.
+    ASSERT_EQ(small->bulk_expire(), ERR_OK);
+    small->get_load(SCHED_TASK_EXPIRE, loads[0]);
+    ASSERT_EQ(loads[0].reclaimable, 0u);
+
+    // Ring reclaims the expired records from the tail only, the live one stops it.
+    auto ring_cfg = this->make_cfg(10000, 60000000000, STORAGE_RING);
+    auto ring = new Shard(2, ring_cfg, this->dbg);
+    for (uint64 k = 0; k < 10; k++) {
+        ASSERT_EQ(ring->set(k, nullptr, 0, val_b, val.size(), 1000000), ERR_OK);
+    }
+    ASSERT_EQ(ring->set(10, val_b, val.size()), ERR_OK);
+    ASSERT_EQ(ring->set(11, nullptr, 0, val_b, val.size(), 1000000), ERR_OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ring->get_load(SCHED_TASK_EXPIRE, loads[0]);
+    ASSERT_EQ(loads[0].reclaimable, 10 * (Shard::head_size(ring_cfg) + val.size()));
+
+    delete ring;
+    delete p;
+    delete large;
+    delete small;
+}
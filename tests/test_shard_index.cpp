@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include "shard_index.h"
+
+class test_shard_index : public ::testing::Test {
+
+public:
+    /**
+     * Make a key that falls into the same shard as all other keys, like BigCache::get_shard() does.
+     */
+    uint64 make_key(uint64 i) {
+        return ((i * 0x9E3779B97F4A7C15ULL) << INDEX_HASH_SHIFT) | 0x5;
+    }
+
+    /**
+     * Find any value of the key.
+     */
+    bool find_any(shard_index *idx, uint64 key, uint64 &val) {
+        return idx->find(key, [](uint64) { return true; }, val);
+    }
+};
+
+TEST_F(test_shard_index, shard_index_io) {
+    auto idx = new shard_index();
+    const uint64 n = 100000;
+
+    for (uint64 i = 0; i < n; i++) {
+        idx->insert(this->make_key(i), i);
+    }
+    ASSERT_EQ(idx->size(), n);
+    ASSERT_TRUE(idx->update(this->make_key(7), 7, 700));
+    ASSERT_FALSE(idx->update(this->make_key(7), 7, 701));
+    uint64 v;
+    ASSERT_TRUE(this->find_any(idx, this->make_key(7), v));
+    ASSERT_EQ(v, 700u);
+
+    for (uint64 i = 0; i < n; i += 2) {
+        ASSERT_TRUE(idx->erase(this->make_key(i), i));
+    }
+    ASSERT_FALSE(idx->erase(this->make_key(0), 0));
+    ASSERT_EQ(idx->size(), n / 2);
+
+    for (uint64 i = 0; i < n; i++) {
+        if (i % 2 == 0) {
+            ASSERT_FALSE(this->find_any(idx, this->make_key(i), v));
+        } else {
+            ASSERT_TRUE(this->find_any(idx, this->make_key(i), v));
+            ASSERT_EQ(v, i == 7 ? 700u : i);
+        }
+    }
+
+    uint64 cnt = 0;
+    idx->each([&cnt](uint64) { cnt++; });
+    ASSERT_EQ(cnt, n / 2);
+
+    delete idx;
+}
+
+TEST_F(test_shard_index, shard_index_collision) {
+    auto idx = new shard_index();
+
+    // Several values under the same key, the callback picks the required one.
+    uint64 key = this->make_key(42);
+    for (uint64 i = 1; i <= 5; i++) {
+        idx->insert(key, i * 100);
+    }
+    ASSERT_EQ(idx->size(), 5u);
+    uint64 v;
+    ASSERT_TRUE(idx->find(key, [](uint64 c) { return c == 300; }, v));
+    ASSERT_EQ(v, 300u);
+    ASSERT_FALSE(idx->find(key, [](uint64 c) { return c == 600; }, v));
+    ASSERT_TRUE(idx->contains(key, 500));
+
+    ASSERT_TRUE(idx->erase(key, 300));
+    ASSERT_FALSE(idx->contains(key, 300));
+    ASSERT_TRUE(idx->contains(key, 100));
+    ASSERT_EQ(idx->size(), 4u);
+
+    delete idx;
+}
+
+TEST_F(test_shard_index, shard_index_churn) {
+    auto idx = new shard_index();
+
+    // Insert and erase keys with a sliding window, so tombstones accumulate and the table rebuilds in place.
+    const uint64 window = 1000;
+    for (uint64 i = 0; i < 200000; i++) {
+        idx->insert(this->make_key(i), i);
+        if (i >= window) {
+            ASSERT_TRUE(idx->erase(this->make_key(i - window), i - window));
+        }
+        ASSERT_LE(idx->size(), window + 1);
+    }
+    uint64 v;
+    for (uint64 i = 200000 - window; i < 200000; i++) {
+        ASSERT_TRUE(idx->contains(this->make_key(i), i));
+    }
+    ASSERT_FALSE(this->find_any(idx, this->make_key(0), v));
+    ASSERT_LE(idx->capacity(), window * 16);
+
+    delete idx;
+}
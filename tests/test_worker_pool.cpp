@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "worker_pool.h"
+
+class test_worker_pool : public ::testing::Test {
+
+public:
+    debug *dbg = new debug(VERBOSE_LVL_NONE);
+};
+
+TEST_F(test_worker_pool, worker_pool_run) {
+    auto pool = new worker_pool(4, false, this->dbg);
+    ASSERT_EQ(pool->size(), 4u);
+
+    std::vector<uint64> hits(1000, 0);
+    pool->run(hits.size(), [&hits](uint64 i) { hits[i]++; });
+    for (auto h : hits) {
+        ASSERT_EQ(h, 1u);
+    }
+
+    // Empty batch returns at once, batch smaller than the pool is fine.
+    pool->run(0, [](uint64) { FAIL(); });
+    std::atomic<uint64> sum{0};
+    pool->run(3, [&sum](uint64 i) { sum += i + 1; });
+    ASSERT_EQ(sum.load(), 6u);
+
+    delete pool;
+}
+
+TEST_F(test_worker_pool, worker_pool_concurrent) {
+    auto pool = new worker_pool(2, true, this->dbg);
+    std::atomic<uint64> sum{0};
+
+    // Batches of different callers share the workers.
+    std::vector<std::thread> callers;
+    for (uint c = 0; c < 4; c++) {
+        callers.emplace_back([pool, &sum]() {
+            for (uint r = 0; r < 50; r++) {
+                pool->run(64, [&sum](uint64 i) { sum += i; });
+            }
+        });
+    }
+    for (auto &thr : callers) {
+        thr.join();
+    }
+    ASSERT_EQ(sum.load(), 4u * 50 * (64 * 63 / 2));
+
+    delete pool;
+}
+
+TEST_F(test_worker_pool, worker_pool_steal) {
+    auto pool = new worker_pool(2, false, this->dbg);
+
+    // The first task blocks its worker, so the rest of its chunk goes to the other one.
+    std::vector<uint64> hits(16, 0);
+    pool->run(hits.size(), [&hits](uint64 i) {
+        if (i == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        hits[i]++;
+    });
+    for (auto h : hits) {
+        ASSERT_EQ(h, 1u);
+    }
+    ASSERT_GT(pool->get_steals(), 0u);
+
+    delete pool;
+}
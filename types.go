@@ -3,6 +3,21 @@ package cbigcache
 // Verbosity level type.
 type ConfigVerboseLevel uint
 
+// Storage engine type.
+type ConfigStorage string
+
+// Page allocation mode type.
+type ConfigPageAlloc string
+
+// Read mode type.
+type ConfigReadMode string
+
+// Eviction policy type.
+type ConfigEvictPolicy string
+
+// Background task type.
+type SchedTask uint
+
 // Error code type.
 type ErrorCode uint
 
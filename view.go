@@ -0,0 +1,104 @@
+package cbigcache
+
+/*
+#include <sys/types.h>
+#include "include/export.h"
+*/
+import "C"
+import (
+	"io"
+	"unsafe"
+)
+
+// View is a zero-copy view of the entry's data.
+// Segments point straight to the cache memory, the entry is pinned until Release: it may be evicted or overwritten
+// meanwhile, but its bytes stay intact. Segments must not be used after Release and must not be modified.
+type View struct {
+	// Owner cache.
+	cache *CBigCache
+	// Lease of the entry.
+	lease C.struct_shard_lease
+	// Segments of the data.
+	segs [][]byte
+}
+
+// Gets zero-copy view of the data for a given key.
+// The view must be released by Release, otherwise the entry's memory never returns to the cache.
+func (c *CBigCache) View(key string) (*View, error) {
+	if !c.alive {
+		return nil, ErrorCacheIsDead
+	}
+
+	ptrKey, keyLen := keyC(key)
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(c.handler))
+
+	v := &View{cache: c}
+	errCode := ErrorCode(C.cbc_get_ref(ptrCbc, ptrKey, keyLen, &v.lease))
+	if errCode != ErrorCodeOk {
+		return nil, errorRegistry[errCode]
+	}
+
+	// Wrap segments to the slices without copying.
+	cnt := int(v.lease.segs_cnt)
+	if cnt > 0 {
+		segs := unsafe.Slice(v.lease.segs, cnt)
+		v.segs = make([][]byte, cnt)
+		for i := range segs {
+			v.segs[i] = unsafe.Slice((*byte)(unsafe.Pointer(segs[i].ptr)), int(segs[i].len))
+		}
+	}
+	return v, nil
+}
+
+// Len returns total length of the data.
+func (v *View) Len() uint {
+	return uint(v.lease.len)
+}
+
+// Segments returns contiguous parts of the data in order.
+// Long and chained entries span several segments.
+func (v *View) Segments() [][]byte {
+	return v.segs
+}
+
+// Bytes returns the data as a single slice.
+// Single segment data returns without copying, otherwise segments are copied to the new slice.
+func (v *View) Bytes() []byte {
+	if len(v.segs) == 1 {
+		return v.segs[0]
+	}
+	buf := make([]byte, 0, v.Len())
+	for _, s := range v.segs {
+		buf = append(buf, s...)
+	}
+	return buf
+}
+
+// WriteTo writes the data to w segment by segment without intermediate copies.
+func (v *View) WriteTo(w io.Writer) (int64, error) {
+	var n int64
+	for _, s := range v.segs {
+		m, err := w.Write(s)
+		n += int64(m)
+		if err != nil {
+			return n, err
+		}
+	}
+	return n, nil
+}
+
+// Release unpins the entry.
+// Segments of the view become invalid.
+func (v *View) Release() error {
+	if v.cache == nil {
+		return ErrorOk
+	}
+	if !v.cache.alive {
+		return ErrorCacheIsDead
+	}
+	ptrCbc := (*C.CBigCache)(unsafe.Pointer(v.cache.handler))
+	errCode := ErrorCode(C.cbc_release(ptrCbc, &v.lease))
+	v.cache = nil
+	v.segs = nil
+	return errorRegistry[errCode]
+}